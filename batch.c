@@ -0,0 +1,105 @@
+#include <stdlib.h>
+#include <glib.h>
+
+#include "batch.h"
+
+struct batch_s
+{
+	GThreadPool* pool;
+	batch_func_t func;
+	gpointer     user_data;
+
+	size_t max_memory;
+	size_t in_use;
+	int    workers;
+	int    active; /* queued or running */
+	int    failed;
+	GMutex lock;
+	GCond  released;
+};
+
+typedef struct
+{
+	gpointer job;
+	size_t cost;
+}
+batch_item_t;
+
+void
+batch_run( gpointer data, gpointer user_data )
+{
+	batch_item_t* it;
+	batch_t* b;
+	int ok;
+
+	it = data;
+	b  = user_data;
+
+	ok = b->func(it->job, b->user_data);
+
+	g_mutex_lock(&b->lock);
+	b->in_use -= it->cost;
+	b->active--;
+	if( !ok )
+		b->failed++;
+	g_cond_broadcast(&b->released);
+	g_mutex_unlock(&b->lock);
+
+	free(it);
+}
+
+batch_t*
+batch_new( int workers, size_t max_memory,
+					 batch_func_t func, gpointer user_data )
+{
+	batch_t* b;
+
+	b = (batch_t*) malloc(sizeof(batch_t));
+	b->func = func;
+	b->user_data = user_data;
+	b->max_memory = max_memory;
+	b->in_use = 0;
+	b->workers = workers < 1 ? 1 : workers;
+	b->active = 0;
+	b->failed = 0;
+	g_mutex_init(&b->lock);
+	g_cond_init(&b->released);
+
+	b->pool = g_thread_pool_new(batch_run, b, b->workers, 1, 0);
+
+	return b;
+}
+
+void
+batch_push( batch_t* b, gpointer job, size_t cost )
+{
+	batch_item_t* it;
+
+	g_mutex_lock(&b->lock);
+	while( b->active >= b->workers ||
+				 (b->max_memory && b->in_use && b->in_use + cost > b->max_memory) )
+		g_cond_wait(&b->released, &b->lock);
+	b->in_use += cost;
+	b->active++;
+	g_mutex_unlock(&b->lock);
+
+	it = (batch_item_t*) malloc(sizeof(batch_item_t));
+	it->job = job;
+	it->cost = cost;
+	g_thread_pool_push(b->pool, it, 0);
+}
+
+int
+batch_finish( batch_t* b )
+{
+	int failed;
+
+	g_thread_pool_free(b->pool, 0, 1);
+
+	failed = b->failed;
+	g_mutex_clear(&b->lock);
+	g_cond_clear(&b->released);
+	free(b);
+
+	return failed;
+}
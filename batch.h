@@ -0,0 +1,25 @@
+/*
+	Include glib.h before including this file.
+
+	A pool of worker threads fed in order from a queue of jobs, with
+	admission control against a memory budget: each job states up front
+	how many bytes it will hold at its peak, and batch_push() blocks
+	until that fits under the budget alongside the jobs in flight. A job
+	larger than the whole budget is run on its own. batch_push() also
+	blocks while every worker is busy, so the producer never runs ahead
+	of the pool.
+*/
+
+typedef struct batch_s batch_t;
+
+/* return nonzero on success */
+typedef int (*batch_func_t)( gpointer job, gpointer user_data );
+
+/* workers < 1 means one; max_memory == 0 means no budget */
+batch_t* batch_new( int workers, size_t max_memory,
+										batch_func_t func, gpointer user_data );
+
+void batch_push( batch_t* b, gpointer job, size_t cost );
+
+/* wait for all jobs, free b, and return the number that failed */
+int batch_finish( batch_t* b );
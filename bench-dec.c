@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <pbc.h>
+
+#include "bswabe.h"
+#include "common.h"
+#include "threshold.h"
+#include "decrypt.h"
+
+/*
+	Compares the decryption strategies of decrypt.c on an AND of n
+	attributes and a threshold gate over them: bswabe's per-leaf
+	evaluation (DEC_NAIVE and DEC_FLATTEN), DEC_MERGE pairing each
+	attribute separately with preprocessed keys, DEC_MERGE as one
+	multi-pairing, and DEC_LSSS. No plan cache is used, so every
+	decryption includes planning.
+*/
+
+#define REPS 10
+
+double
+usec_since( gint64 start )
+{
+	return (double) (g_get_monotonic_time() - start) / REPS;
+}
+
+double
+time_dec( dec_pub_t* pub, dec_prv_t* prv, dec_cph_t* cph, element_t m,
+					dec_strategy_t strategy, int preprocess )
+{
+	dec_opts_t opts = { DEC_MERGE, 0, 0, 0, 0, 0 };
+	element_t r;
+	gint64 t0;
+	int i;
+
+	opts.strategy = strategy;
+	opts.preprocess = preprocess;
+
+	/* twice beforehand, as keys are preprocessed on their second use */
+	for( i = 0; i < 2; i++ )
+	{
+		if( !dec_decrypt(pub, prv, cph, r, &opts, 0) )
+			die("policy not satisfied\n");
+		if( element_cmp(r, m) )
+			die("wrong result with strategy %d\n", strategy);
+		element_clear(r);
+	}
+
+	t0 = g_get_monotonic_time();
+	for( i = 0; i < REPS; i++ )
+	{
+		dec_decrypt(pub, prv, cph, r, &opts, 0);
+		element_clear(r);
+	}
+
+	return usec_since(t0);
+}
+
+void
+bench( bswabe_pub_t* bpub, bswabe_msk_t* msk, dec_pub_t* pub, int n, int k )
+{
+	bswabe_prv_t* bprv;
+	bswabe_cph_t* bcph;
+	dec_prv_t* prv;
+	dec_cph_t* cph;
+	GString* policy;
+	char** attrs;
+	element_t m;
+	int i;
+
+	attrs = malloc((n + 1) * sizeof(char*));
+	policy = g_string_new("");
+	for( i = 0; i < n; i++ )
+	{
+		attrs[i] = g_strdup_printf("a%d", i);
+		g_string_append_printf(policy, "%s ", attrs[i]);
+	}
+	attrs[n] = 0;
+	g_string_append_printf(policy, "%dof%d", k, n);
+
+	bprv = bswabe_keygen(bpub, msk, attrs);
+	if( !(bcph = bswabe_enc(bpub, m, policy->str)) )
+		die("%s", bswabe_error());
+
+	prv = dec_prv_unserialize(pub, bswabe_prv_serialize(bprv), 1);
+	cph = dec_cph_unserialize(pub, bswabe_cph_serialize(bcph), 1);
+
+	printf("%4d of %-4d  %10.1f %10.1f %10.1f %10.1f %10.1f\n", k, n,
+				 time_dec(pub, prv, cph, m, DEC_NAIVE,   0),
+				 time_dec(pub, prv, cph, m, DEC_FLATTEN, 0),
+				 time_dec(pub, prv, cph, m, DEC_MERGE,   1),
+				 time_dec(pub, prv, cph, m, DEC_MERGE,   0),
+				 time_dec(pub, prv, cph, m, DEC_LSSS,    0));
+
+	dec_prv_free(prv);
+	dec_cph_free(cph);
+	bswabe_prv_free(bprv);
+	bswabe_cph_free(bcph);
+	element_clear(m);
+	for( i = 0; i < n; i++ )
+		free(attrs[i]);
+	free(attrs);
+	g_string_free(policy, 1);
+}
+
+int
+main( int argc, char** argv )
+{
+	bswabe_pub_t* bpub;
+	bswabe_msk_t* msk;
+	dec_pub_t* pub;
+	int i;
+
+	bswabe_setup(&bpub, &msk);
+	pub = dec_pub_unserialize(bswabe_pub_serialize(bpub), 1);
+
+	printf("usec per dec       naive    flatten   merge+pp      multi       lsss\n");
+
+	if( argc < 2 )
+	{
+		bench(bpub, msk, pub, 2, 2);
+		bench(bpub, msk, pub, 8, 8);
+		bench(bpub, msk, pub, 8, 4);
+		bench(bpub, msk, pub, 32, 32);
+	}
+	else
+		for( i = 1; i < argc; i++ )
+			bench(bpub, msk, pub, atoi(argv[i]), atoi(argv[i]));
+
+	dec_pub_free(pub);
+	bswabe_pub_free(bpub);
+	bswabe_msk_free(msk);
+
+	return 0;
+}
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <glib.h>
+#include <pbc.h>
+
+#include "common.h"
+#include "threshold.h"
+
+/*
+	Compares threshold.c against the per-element routines bswabe uses
+	(eval_poly() and lagrange_coef() in its core.c), reproduced below.
+*/
+
+#define REPS 10
+
+void
+naive_eval( element_t r, element_t* coef, int k, element_t x )
+{
+	element_t s;
+	element_t t;
+	int i;
+
+	element_init_same_as(s, r);
+	element_init_same_as(t, r);
+
+	element_set0(r);
+	element_set1(t);
+	for( i = 0; i < k; i++ )
+	{
+		element_mul(s, coef[i], t);
+		element_add(r, r, s);
+		element_mul(t, t, x);
+	}
+
+	element_clear(s);
+	element_clear(t);
+}
+
+void
+naive_lagrange( element_t r, int* s, int len, int i )
+{
+	element_t t;
+	int j;
+
+	element_init_same_as(t, r);
+
+	element_set1(r);
+	for( j = 0; j < len; j++ )
+	{
+		if( s[j] == i )
+			continue;
+		element_set_si(t, - s[j]);
+		element_mul(r, r, t);
+		element_set_si(t, i - s[j]);
+		element_invert(t, t);
+		element_mul(r, r, t);
+	}
+
+	element_clear(t);
+}
+
+double
+usec_since( gint64 start )
+{
+	return (double) (g_get_monotonic_time() - start) / REPS;
+}
+
+void
+bench( pairing_t p, int n )
+{
+	threshold_cache_t* c;
+	element_t* coef;
+	element_t* naive;
+	element_t* fast;
+	element_t* lambda;
+	element_t x;
+	int* s;
+	int k;
+	int i;
+	int r;
+	gint64 t0;
+	double t_eval[2];
+	double t_lag[3];
+
+	k = n / 2 ? n / 2 : 1;
+
+	coef  = malloc(k * sizeof(element_t));
+	naive = malloc(n * sizeof(element_t));
+	fast  = malloc(n * sizeof(element_t));
+	s     = malloc(k * sizeof(int));
+
+	for( i = 0; i < k; i++ )
+	{
+		element_init_Zr(coef[i], p);
+		element_random(coef[i]);
+		s[i] = 2 * i + 1;
+	}
+	for( i = 0; i < n; i++ )
+	{
+		element_init_Zr(naive[i], p);
+		element_init_Zr(fast[i],  p);
+	}
+	element_init_Zr(x, p);
+
+	/* share generation */
+
+	t0 = g_get_monotonic_time();
+	for( r = 0; r < REPS; r++ )
+		for( i = 0; i < n; i++ )
+		{
+			element_set_si(x, i + 1);
+			naive_eval(naive[i], coef, k, x);
+		}
+	t_eval[0] = usec_since(t0);
+
+	t0 = g_get_monotonic_time();
+	for( r = 0; r < REPS; r++ )
+		threshold_shares(fast, coef, k, n);
+	t_eval[1] = usec_since(t0);
+
+	for( i = 0; i < n; i++ )
+		if( element_cmp(naive[i], fast[i]) )
+			die("share mismatch at x = %d (n = %d)\n", i + 1, n);
+
+	/* lagrange coefficients for the odd indices */
+
+	t0 = g_get_monotonic_time();
+	for( r = 0; r < REPS; r++ )
+		for( i = 0; i < k; i++ )
+			naive_lagrange(naive[i], s, k, s[i]);
+	t_lag[0] = usec_since(t0);
+
+	t0 = g_get_monotonic_time();
+	for( r = 0; r < REPS; r++ )
+	{
+		c = threshold_cache_new(p);
+		threshold_lagrange(c, s, k);
+		threshold_cache_free(c);
+	}
+	t_lag[1] = usec_since(t0);
+
+	c = threshold_cache_new(p);
+	threshold_lagrange(c, s, k);
+	t0 = g_get_monotonic_time();
+	for( r = 0; r < REPS; r++ )
+		lambda = threshold_lagrange(c, s, k);
+	t_lag[2] = usec_since(t0);
+
+	for( i = 0; i < k; i++ )
+		if( element_cmp(naive[i], lambda[i]) )
+			die("lagrange mismatch at index %d (n = %d)\n", s[i], n);
+	threshold_cache_free(c);
+
+	printf("%4d of %-4d  shares %10.1f %10.1f   lagrange %10.1f %10.1f %8.1f\n",
+				 k, n, t_eval[0], t_eval[1], t_lag[0], t_lag[1], t_lag[2]);
+
+	for( i = 0; i < k; i++ )
+		element_clear(coef[i]);
+	for( i = 0; i < n; i++ )
+	{
+		element_clear(naive[i]);
+		element_clear(fast[i]);
+	}
+	element_clear(x);
+	free(coef);
+	free(naive);
+	free(fast);
+	free(s);
+}
+
+int
+main( int argc, char** argv )
+{
+	pbc_param_t par;
+	pairing_t p;
+	int i;
+
+	/* same curve parameters bswabe_setup() uses */
+	pbc_param_init_a_gen(par, 160, 512);
+	pairing_init_pbc_param(p, par);
+
+	printf("usec per gate     shares: naive  horner     "
+				 "lagrange: naive   batched   cached\n");
+
+	if( argc < 2 )
+	{
+		bench(p, 16);
+		bench(p, 64);
+		bench(p, 256);
+	}
+	else
+		for( i = 1; i < argc; i++ )
+			bench(p, atoi(argv[i]));
+
+	pairing_clear(p);
+	pbc_param_clear(par);
+
+	return 0;
+}
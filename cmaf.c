@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <glib.h>
+#include <pbc.h>
+
+#include "common.h"
+#include "cmaf.h"
+
+/* append n bytes read from f to a, or die if the stream ends first */
+void
+read_fully( FILE* f, GByteArray* a, uint64_t n )
+{
+	guint old;
+
+	old = a->len;
+	if( n > CMAF_MAX_CHUNK - MIN(old, CMAF_MAX_CHUNK) )
+		die("malformed box in input stream, %llu bytes is too large\n",
+				(unsigned long long) n);
+	g_byte_array_set_size(a, old + n);
+	if( fread(a->data + old, 1, n, f) != n )
+		die("truncated input stream\n");
+}
+
+uint64_t
+get_be( guint8* p, int n )
+{
+	uint64_t r;
+	int i;
+
+	r = 0;
+	for( i = 0; i < n; i++ )
+		r = r<<8 | p[i];
+
+	return r;
+}
+
+GByteArray*
+cmaf_read_chunk( FILE* f )
+{
+	GByteArray* c;
+	guint8 hdr[16];
+	uint64_t size;
+	int hlen;
+	int n;
+
+	c = g_byte_array_new();
+	while( (n = fread(hdr, 1, 8, f)) == 8 )
+	{
+		size = get_be(hdr, 4);
+		hlen = 8;
+		if( size == 1 )
+		{
+			if( fread(hdr + 8, 1, 8, f) != 8 )
+				die("truncated input stream\n");
+			size = get_be(hdr + 8, 8);
+			hlen = 16;
+		}
+		g_byte_array_append(c, hdr, hlen);
+
+		if( size == 0 )
+		{
+			/* box extends to the end of the stream */
+			guint8 buf[4096];
+
+			while( (n = fread(buf, 1, sizeof(buf), f)) > 0 )
+			{
+				if( c->len > CMAF_MAX_CHUNK - n )
+					die("malformed box in input stream, too large\n");
+				g_byte_array_append(c, buf, n);
+			}
+			return c;
+		}
+		else if( size < hlen )
+			die("malformed box in input stream\n");
+
+		read_fully(f, c, size - hlen);
+
+		if( !memcmp(hdr + 4, "mdat", 4) || !memcmp(hdr + 4, "moov", 4) )
+			return c;
+	}
+
+	if( n != 0 )
+		die("truncated input stream\n");
+
+	/* trailing boxes after the last mdat */
+	if( c->len )
+		return c;
+
+	g_byte_array_free(c, 1);
+	return 0;
+}
+
+void
+write_len( FILE* f, guint32 len )
+{
+	int i;
+
+	for( i = 3; i >= 0; i-- )
+		fputc((len & 0xff<<(i*8))>>(i*8), f);
+}
+
+void
+cmaf_write_header( FILE* f, GByteArray* cph_buf )
+{
+	write_len(f, cph_buf->len);
+	fwrite(cph_buf->data, 1, cph_buf->len, f);
+}
+
+void
+cmaf_write_record( FILE* f, GByteArray* aes_buf, unsigned char* tag )
+{
+	write_len(f, aes_buf->len);
+	fwrite(aes_buf->data, 1, aes_buf->len, f);
+	fwrite(tag, 1, CPABE_TAG_LEN, f);
+}
+
+GByteArray*
+cmaf_read_header( FILE* f )
+{
+	GByteArray* r;
+	guint8 len[4];
+	int n;
+
+	if( (n = fread(len, 1, 4, f)) != 4 )
+	{
+		if( n )
+			die("truncated input stream\n");
+		return 0;
+	}
+
+	r = g_byte_array_new();
+	read_fully(f, r, get_be(len, 4));
+
+	return r;
+}
+
+GByteArray*
+cmaf_read_record( FILE* f, unsigned char* tag )
+{
+	GByteArray* r;
+
+	if( (r = cmaf_read_header(f)) && fread(tag, 1, CPABE_TAG_LEN, f) != CPABE_TAG_LEN )
+		die("truncated input stream\n");
+
+	return r;
+}
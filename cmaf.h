@@ -0,0 +1,37 @@
+/*
+	Include glib.h before including this file.
+
+	Chunked encryption of fragmented MP4 (CMAF) arriving on a pipe. The
+	input is split on box boundaries into the init segment (everything
+	up to and including the moov) and then one chunk per moof and the
+	mdat that follows it, together with any boxes (styp, prft, emsg, ...)
+	in between. A chunk is handed out as soon as its mdat is complete.
+
+	The encrypted stream starts with the encapsulated key and is then a
+	sequence of records, each chunk encrypted with aes_128_cbc_encrypt_seq()
+	under that key with its one-based position in the stream as sequence
+	number, and followed by its cpabe_record_tag(). The stream ends with
+	a last record with no payload, whose tag alone says the stream is
+	complete. All lengths are 32-bit big endian:
+
+	  cph_len cph_buf  aes_len aes_buf tag  ...  0 tag
+
+	A chunk or record larger than CMAF_MAX_CHUNK is taken to be a
+	malformed stream rather than buffered.
+*/
+
+#define CMAF_MAX_CHUNK ((guint) 1 << 30)
+
+/* next chunk of boxes from f, or zero at the end of the stream */
+GByteArray* cmaf_read_chunk( FILE* f );
+
+void cmaf_write_header( FILE* f, GByteArray* cph_buf );
+void cmaf_write_record( FILE* f, GByteArray* aes_buf, unsigned char* tag );
+
+/*
+	Both return zero at the end of the stream. cmaf_read_record() leaves
+	the record's tag, CPABE_TAG_LEN bytes, in tag, and returns an empty
+	array for the last record.
+*/
+GByteArray* cmaf_read_header( FILE* f );
+GByteArray* cmaf_read_record( FILE* f, unsigned char* tag );
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE /* syncfs */
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdint.h>
@@ -7,16 +8,22 @@
 #include <assert.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <errno.h>
 #include <unistd.h>
 #include <glib.h>
 #include <openssl/aes.h>
 #include <openssl/sha.h>
+#include <openssl/evp.h>
+#include <openssl/core_names.h>
+#include <openssl/crypto.h>
 #include <pbc.h>
 
 #include "common.h"
 
 void
-init_aes( element_t k, int enc, AES_KEY* key, unsigned char* iv )
+session_key_bytes( element_t k, unsigned char* raw )
 {
   int key_len;
   unsigned char* key_buf;
@@ -24,26 +31,72 @@ init_aes( element_t k, int enc, AES_KEY* key, unsigned char* iv )
   key_len = element_length_in_bytes(k) < 17 ? 17 : element_length_in_bytes(k);
   key_buf = (unsigned char*) malloc(key_len);
   element_to_bytes(key_buf, k);
+  memcpy(raw, key_buf + 1, 16);
+  memset(key_buf, 0, key_len);
+  free(key_buf);
+}
+
+void
+init_aes( unsigned char* raw, int enc, AES_KEY* key, unsigned char* iv, guint32 seq )
+{
+  AES_KEY iv_key;
 
   if( enc )
-    AES_set_encrypt_key(key_buf + 1, 128, key);
+    AES_set_encrypt_key(raw, 128, key);
   else
-    AES_set_decrypt_key(key_buf + 1, 128, key);
-  free(key_buf);
+    AES_set_decrypt_key(raw, 128, key);
 
+  /* zero for whole files, else the encryption of seq (big endian) */
   memset(iv, 0, 16);
+  if( !seq )
+    return;
+  iv[12] = (seq & 0xff000000)>>24;
+  iv[13] = (seq & 0xff0000)>>16;
+  iv[14] = (seq & 0xff00)>>8;
+  iv[15] = (seq & 0xff)>>0;
+  AES_set_encrypt_key(raw, 128, &iv_key);
+  AES_encrypt(iv, iv, &iv_key);
+  memset(&iv_key, 0, sizeof(iv_key));
 }
 
 GByteArray*
 aes_128_cbc_encrypt( GByteArray* pt, element_t k )
+{
+  return aes_128_cbc_encrypt_seq(pt, k, 0);
+}
+
+GByteArray*
+aes_128_cbc_decrypt( GByteArray* ct, element_t k )
+{
+  return aes_128_cbc_decrypt_seq(ct, k, 0);
+}
+
+GByteArray*
+aes_128_cbc_decrypt_seq( GByteArray* ct, element_t k, guint32 seq )
+{
+  unsigned char raw[16];
+  GByteArray* pt;
+
+  session_key_bytes(k, raw);
+  pt = aes_128_cbc_decrypt_raw(ct, raw, seq);
+  memset(raw, 0, sizeof(raw));
+
+  return pt;
+}
+
+GByteArray*
+aes_128_cbc_encrypt_seq( GByteArray* pt, element_t k, guint32 seq )
 {
   AES_KEY key;
   unsigned char iv[16];
   GByteArray* ct;
   guint8 len[4];
   guint8 zero;
+  unsigned char raw[16];
 
-  init_aes(k, 1, &key, iv);
+  session_key_bytes(k, raw);
+  init_aes(raw, 1, &key, iv, seq);
+  memset(raw, 0, sizeof(raw));
 
   /* TODO make less crufty */
 
@@ -68,14 +121,14 @@ aes_128_cbc_encrypt( GByteArray* pt, element_t k )
 }
 
 GByteArray*
-aes_128_cbc_decrypt( GByteArray* ct, element_t k )
+aes_128_cbc_decrypt_raw( GByteArray* ct, unsigned char* raw, guint32 seq )
 {
   AES_KEY key;
   unsigned char iv[16];
   GByteArray* pt;
   unsigned int len;
 
-  init_aes(k, 0, &key, iv);
+  init_aes(raw, 0, &key, iv, seq);
 
   pt = g_byte_array_new();
   g_byte_array_set_size(pt, ct->len);
@@ -100,6 +153,36 @@ aes_128_cbc_decrypt( GByteArray* ct, element_t k )
   return pt;
 }
 
+int
+aes_128_cbc_check_raw( GByteArray* ct, unsigned char* raw, int file_len )
+{
+  AES_KEY key;
+  unsigned char iv[16];
+  unsigned char* pt;
+  guint32 len;
+  guint32 i;
+  int ok;
+
+  if( ct->len < 16 || ct->len % 16 )
+    return 0;
+
+  init_aes(raw, 0, &key, iv, 0);
+  pt = malloc(ct->len);
+  AES_cbc_encrypt(ct->data, pt, ct->len, &key, iv, AES_DECRYPT);
+
+  /* the real length, then the plaintext, then zeros up to a block */
+  len = pt[0]<<24 | pt[1]<<16 | pt[2]<<8 | pt[3];
+  ok = file_len >= 0 && len == (guint32) file_len &&
+    len <= ct->len - 4 && ct->len - 4 - len < 16;
+  for( i = 4 + len; ok && i < ct->len; i++ )
+    ok = !pt[i];
+
+  memset(pt, 0, ct->len);
+  free(pt);
+
+  return ok;
+}
+
 FILE*
 fopen_read_or_die( char* file )
 {
@@ -140,6 +223,12 @@ suck_file( char* file )
 	return a;
 }
 
+GByteArray*
+copy_buf( GByteArray* b )
+{
+	return g_byte_array_append(g_byte_array_sized_new(b->len), b->data, b->len);
+}
+
 char*
 suck_file_str( char* file )
 {
@@ -220,30 +309,506 @@ void read_cpabe_file( char* file,    GByteArray** cph_buf,
 	fclose(f);
 }
 
-void
-write_cpabe_file( char* file,   GByteArray* cph_buf,
-									int file_len, GByteArray* aes_buf )
+guint32
+get_len( guint8* p )
+{
+	return p[0]<<24 | p[1]<<16 | p[2]<<8 | p[3];
+}
+
+char*
+load_file( char* file, GByteArray** b )
 {
 	FILE* f;
-	int i;
+	struct stat s;
 
-	f = fopen_write_or_die(file);
+	if( !(f = fopen(file, "r")) )
+		return "can't read file";
+	if( fstat(fileno(f), &s) || s.st_size > G_MAXUINT )
+	{
+		fclose(f);
+		return "can't read file";
+	}
+
+	*b = g_byte_array_new();
+	g_byte_array_set_size(*b, s.st_size);
+	if( fread((*b)->data, 1, s.st_size, f) != (size_t) s.st_size )
+	{
+		g_byte_array_free(*b, 1);
+		fclose(f);
+		return "can't read file";
+	}
+	fclose(f);
 
-	/* write real file len as 32-bit big endian int */
-	for( i = 3; i >= 0; i-- )
-		fputc((file_len & 0xff<<(i*8))>>(i*8), f);
+	return 0;
+}
 
-	/* write aes_buf */
-	for( i = 3; i >= 0; i-- )
-		fputc((aes_buf->len & 0xff<<(i*8))>>(i*8), f);
-	fwrite(aes_buf->data, 1, aes_buf->len, f);
+char*
+load_cpabe_file( char* file, GByteArray** cph_buf,
+								 int* file_len, GByteArray** aes_buf )
+{
+	return load_cpabe_file_tag(file, cph_buf, file_len, aes_buf, 0);
+}
 
-	/* write cph_buf */
-	for( i = 3; i >= 0; i-- )
-		fputc((cph_buf->len & 0xff<<(i*8))>>(i*8), f);
-	fwrite(cph_buf->data, 1, cph_buf->len, f);
+char*
+load_cpabe_file_tag( char* file, GByteArray** cph_buf,
+										 int* file_len, GByteArray** aes_buf, GByteArray** tag )
+{
+	gchar* data;
+	gsize len;
+	guint32 aes_len;
+	guint32 cph_len;
+	gsize end;
+
+	if( !g_file_get_contents(file, &data, &len, 0) )
+		return "can't read file";
+
+	/* file_len, aes_len, aes_buf, cph_len, cph_buf */
+	aes_len = len >= 8 ? get_len((guint8*) data + 4) : 0;
+	cph_len = len >= 12 && aes_len <= len - 12 ?
+		get_len((guint8*) data + 8 + aes_len) : 0;
+	if( len < 12 || aes_len > len - 12 || cph_len > len - 12 - aes_len )
+	{
+		g_free(data);
+		return "not a cpabe file";
+	}
+
+	*file_len = get_len((guint8*) data);
+	*aes_buf = g_byte_array_new();
+	g_byte_array_append(*aes_buf, (guint8*) data + 8, aes_len);
+	*cph_buf = g_byte_array_new();
+	g_byte_array_append(*cph_buf, (guint8*) data + 12 + aes_len, cph_len);
+
+	/* anything else after cph_buf is ignored, as by older readers */
+	end = 12 + aes_len + cph_len;
+	if( tag )
+		*tag = 0;
+	if( tag && len - end == 8 + CPABE_TAG_LEN && !memcmp(data + end, CPABE_TAG_MAGIC, 8) )
+	{
+		*tag = g_byte_array_new();
+		g_byte_array_append(*tag, (guint8*) data + end + 8, CPABE_TAG_LEN);
+	}
+	g_free(data);
+
+	return 0;
+}
 
+char*
+load_cpabe_header( char* file, GByteArray** cph_buf )
+{
+	FILE* f;
+	struct stat st;
+	guint8 len[4];
+	guint32 aes_len;
+	guint32 cph_len;
+	char* err;
+
+	if( !(f = fopen(file, "r")) || fstat(fileno(f), &st) )
+	{
+		if( f )
+			fclose(f);
+		return "can't read file";
+	}
+
+	/* file_len, aes_len, aes_buf, cph_len, cph_buf */
+	err = "not a cpabe file";
+	*cph_buf = 0;
+	if( st.st_size >= 12 && fseek(f, 4, SEEK_SET) == 0 && fread(len, 1, 4, f) == 4 &&
+			(aes_len = get_len(len)) <= st.st_size - 12 &&
+			fseek(f, aes_len, SEEK_CUR) == 0 && fread(len, 1, 4, f) == 4 &&
+			(cph_len = get_len(len)) <= st.st_size - 12 - aes_len )
+	{
+		*cph_buf = g_byte_array_sized_new(cph_len);
+		g_byte_array_set_size(*cph_buf, cph_len);
+		if( fread((*cph_buf)->data, 1, cph_len, f) == cph_len )
+			err = 0;
+		else
+		{
+			g_byte_array_free(*cph_buf, 1);
+			err = "can't read file";
+		}
+	}
 	fclose(f);
+
+	return err;
+}
+
+typedef struct
+{
+	char* tmp;
+	char* file;
+	int   fd;
+	int   done;
+	int   failed;
+}
+commit_t;
+
+/*
+	Files waiting to be synced and renamed into place. Whichever writer
+	finds no commit in progress takes everything queued so far and
+	commits it as one group, so concurrent writers share their syncs.
+*/
+GMutex     commit_lock;
+GCond      committed;
+GPtrArray* commit_queue = 0;
+int        committing   = 0;
+
+void
+fsync_dir_or_die( char* file )
+{
+	char* dir;
+	int fd;
+
+	dir = g_path_get_dirname(file);
+	if( (fd = open(dir, O_RDONLY)) < 0 || fsync(fd) )
+		die("can't sync directory: %s\n", dir);
+	close(fd);
+	free(dir);
+}
+
+/*
+	A lone file costs an fsync of it and of its directory. A larger group
+	costs one syncfs per file system before the renames and one after.
+	A file that can't be synced or renamed is unlinked and marked failed
+	for its writer to report; a file system that can't sync is fatal.
+*/
+void
+commit_group( GPtrArray* group )
+{
+	GArray* devs;
+	struct stat st;
+	commit_t* c;
+	guint i;
+	guint j;
+
+	if( group->len == 1 )
+	{
+		c = g_ptr_array_index(group, 0);
+		if( fsync(c->fd) || rename(c->tmp, c->file) )
+		{
+			unlink(c->tmp);
+			c->failed = 1;
+			return;
+		}
+		fsync_dir_or_die(c->file);
+		return;
+	}
+
+	/* keep one descriptor per file system */
+	devs = g_array_new(0, 0, sizeof(int));
+	for( i = 0; i < group->len; i++ )
+	{
+		c = g_ptr_array_index(group, i);
+		if( fstat(c->fd, &st) )
+		{
+			unlink(c->tmp);
+			c->failed = 1;
+			continue;
+		}
+		for( j = 0; j < devs->len; j++ )
+		{
+			struct stat other;
+
+			fstat(g_array_index(devs, int, j), &other);
+			if( other.st_dev == st.st_dev )
+				break;
+		}
+		if( j == devs->len )
+			g_array_append_val(devs, c->fd);
+	}
+
+	for( j = 0; j < devs->len; j++ )
+		if( syncfs(g_array_index(devs, int, j)) )
+			die("can't sync file system\n");
+
+	for( i = 0; i < group->len; i++ )
+	{
+		c = g_ptr_array_index(group, i);
+		if( !c->failed && rename(c->tmp, c->file) )
+		{
+			unlink(c->tmp);
+			c->failed = 1;
+		}
+	}
+
+	for( j = 0; j < devs->len; j++ )
+		if( syncfs(g_array_index(devs, int, j)) )
+			die("can't sync file system\n");
+
+	g_array_free(devs, 1);
+}
+
+/*
+	Returns once file is durably in place under its final name, or zero
+	if it couldn't be put there.
+*/
+int
+commit_file( char* tmp, char* file, int fd )
+{
+	commit_t c;
+	GPtrArray* group;
+	guint i;
+
+	c.tmp    = tmp;
+	c.file   = file;
+	c.fd     = fd;
+	c.done   = 0;
+	c.failed = 0;
+
+	g_mutex_lock(&commit_lock);
+	if( !commit_queue )
+		commit_queue = g_ptr_array_new();
+	g_ptr_array_add(commit_queue, &c);
+
+	while( !c.done )
+		if( committing )
+			g_cond_wait(&committed, &commit_lock);
+		else
+		{
+			committing = 1;
+			group = commit_queue;
+			commit_queue = g_ptr_array_new();
+			g_mutex_unlock(&commit_lock);
+
+			commit_group(group);
+
+			g_mutex_lock(&commit_lock);
+			for( i = 0; i < group->len; i++ )
+				((commit_t*) g_ptr_array_index(group, i))->done = 1;
+			g_ptr_array_free(group, 1);
+			committing = 0;
+			g_cond_broadcast(&committed);
+		}
+	g_mutex_unlock(&commit_lock);
+
+	return !c.failed;
+}
+
+void
+put_be32( guint8* p, guint32 n )
+{
+	p[0] = (n & 0xff000000)>>24;
+	p[1] = (n & 0xff0000)>>16;
+	p[2] = (n & 0xff00)>>8;
+	p[3] = (n & 0xff)>>0;
+}
+
+/*
+	HMAC-SHA256 of hdr and then buf under a key derived from raw and the
+	8-byte label, never the AES key itself. Both are fed to the MAC where
+	they lie, so a large buf is not copied.
+*/
+void
+hmac_raw( unsigned char* raw, char* label, guint8* hdr, int hdr_len,
+					GByteArray* buf, unsigned char* tag )
+{
+	unsigned char seed[8 + 16];
+	unsigned char key[SHA256_DIGEST_LENGTH];
+	EVP_MAC* mac;
+	EVP_MAC_CTX* ctx;
+	OSSL_PARAM params[2];
+	size_t n;
+
+	memcpy(seed, label, 8);
+	memcpy(seed + 8, raw, 16);
+	SHA256(seed, sizeof(seed), key);
+
+	params[0] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, (char*) "SHA256", 0);
+	params[1] = OSSL_PARAM_construct_end();
+	if( !(mac = EVP_MAC_fetch(0, "HMAC", 0)) ||
+			!(ctx = EVP_MAC_CTX_new(mac)) ||
+			!EVP_MAC_init(ctx, key, sizeof(key), params) ||
+			!EVP_MAC_update(ctx, hdr, hdr_len) ||
+			!EVP_MAC_update(ctx, buf->data, buf->len) ||
+			!EVP_MAC_final(ctx, tag, &n, CPABE_TAG_LEN) )
+		die("can't compute HMAC-SHA256\n");
+	EVP_MAC_CTX_free(ctx);
+	EVP_MAC_free(mac);
+
+	memset(seed, 0, sizeof(seed));
+	memset(key, 0, sizeof(key));
+}
+
+void
+cpabe_tag( unsigned char* raw, int file_len, GByteArray* aes_buf, unsigned char* tag )
+{
+	guint8 len[4];
+
+	put_be32(len, file_len);
+	hmac_raw(raw, CPABE_TAG_MAGIC, len, 4, aes_buf, tag);
+}
+
+int
+cpabe_tag_ok( unsigned char* raw, int file_len, GByteArray* aes_buf, GByteArray* tag )
+{
+	unsigned char t[CPABE_TAG_LEN];
+
+	cpabe_tag(raw, file_len, aes_buf, t);
+
+	return !CRYPTO_memcmp(t, tag->data, CPABE_TAG_LEN);
+}
+
+void
+cpabe_record_tag( unsigned char* raw, guint32 seq, int last,
+									GByteArray* aes_buf, unsigned char* tag )
+{
+	guint8 hdr[5];
+
+	put_be32(hdr, seq);
+	hdr[4] = last ? 1 : 0;
+	hmac_raw(raw, CPABE_RECORD_MAGIC, hdr, 5, aes_buf, tag);
+}
+
+int
+cpabe_record_tag_ok( unsigned char* raw, guint32 seq, int last,
+										 GByteArray* aes_buf, unsigned char* tag )
+{
+	unsigned char t[CPABE_TAG_LEN];
+
+	cpabe_record_tag(raw, seq, last, aes_buf, t);
+
+	return !CRYPTO_memcmp(t, tag, CPABE_TAG_LEN);
+}
+
+void
+write_cpabe_file( char* file,   GByteArray* cph_buf,
+									int file_len, GByteArray* aes_buf, unsigned char* tag )
+{
+	char* err;
+
+	if( (err = save_cpabe_file(file, cph_buf, file_len, aes_buf, tag)) )
+		die("%s: %s\n", err, file);
+}
+
+char*
+save_cpabe_file( char* file,   GByteArray* cph_buf,
+								 int file_len, GByteArray* aes_buf, unsigned char* tag )
+{
+	guint8 hdr[12];
+	struct iovec iov[6];
+	struct iovec* v;
+	int n;
+	ssize_t w;
+	int fd;
+	char* tmp;
+
+	/* real file len, then aes_buf, then cph_buf, lengths 32-bit big endian */
+	put_be32(hdr,     file_len);
+	put_be32(hdr + 4, aes_buf->len);
+	put_be32(hdr + 8, cph_buf->len);
+
+	iov[0].iov_base = hdr;
+	iov[0].iov_len  = 8;
+	iov[1].iov_base = aes_buf->data;
+	iov[1].iov_len  = aes_buf->len;
+	iov[2].iov_base = hdr + 8;
+	iov[2].iov_len  = 4;
+	iov[3].iov_base = cph_buf->data;
+	iov[3].iov_len  = cph_buf->len;
+	iov[4].iov_base = (char*) CPABE_TAG_MAGIC;
+	iov[4].iov_len  = 8;
+	iov[5].iov_base = tag;
+	iov[5].iov_len  = CPABE_TAG_LEN;
+
+	/* readers never see a partly written file under the final name */
+	tmp = g_strdup_printf("%s.tmp", file);
+	if( (fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0 )
+	{
+		free(tmp);
+		return "can't write file";
+	}
+
+	for( v = iov, n = tag ? 6 : 4; n > 0; )
+	{
+		if( (w = writev(fd, v, n)) < 0 )
+		{
+			if( errno == EINTR )
+				continue;
+			close(fd);
+			unlink(tmp);
+			free(tmp);
+			return "can't write file";
+		}
+
+		/* short write: skip what went out and go again */
+		for( ; n > 0 && (size_t) w >= v->iov_len; v++, n-- )
+			w -= v->iov_len;
+		if( n > 0 )
+		{
+			v->iov_base = (char*) v->iov_base + w;
+			v->iov_len -= w;
+		}
+	}
+
+	n = !commit_file(tmp, file, fd);
+	n |= close(fd);
+	free(tmp);
+
+	return n ? "can't write file" : 0;
+}
+
+int
+write_file_synced( char* file, GByteArray* b )
+{
+	ssize_t w;
+	size_t off;
+	int fd;
+	char* tmp;
+
+	tmp = g_strdup_printf("%s.tmp", file);
+	if( (fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0 )
+	{
+		free(tmp);
+		return 0;
+	}
+
+	for( off = 0; off < b->len; off += w )
+		if( (w = write(fd, b->data + off, b->len - off)) < 0 )
+		{
+			if( errno == EINTR )
+			{
+				w = 0;
+				continue;
+			}
+			close(fd);
+			unlink(tmp);
+			free(tmp);
+			return 0;
+		}
+
+	w = !commit_file(tmp, file, fd);
+	w |= close(fd);
+	free(tmp);
+
+	return !w;
+}
+
+size_t
+parse_size( char* s )
+{
+	unsigned long long n;
+	char* end;
+	int shift;
+
+	errno = 0;
+	n = strtoull(s, &end, 10);
+	if( end == s || errno == ERANGE )
+		die("invalid size \"%s\"\n", s);
+
+	shift = 0;
+	switch( toupper(*end) )
+	{
+	case 'G': shift += 10;
+	case 'M': shift += 10;
+	case 'K': shift += 10;
+		end++;
+	}
+
+	if( *end )
+		die("invalid size \"%s\" (use a byte count with optional K, M or G)\n", s);
+	if( n > (SIZE_MAX >> shift) )
+		die("size \"%s\" is too large\n", s);
+
+	return (size_t) n << shift;
 }
 
 void
@@ -13,19 +13,105 @@ char*       suck_file_str( char* file );
 char*       suck_stdin();
 GByteArray* suck_file( char* file );
 
+/* as suck_file(), returning a message instead of exiting, or zero */
+char*       load_file( char* file, GByteArray** b );
+
 void        spit_file( char* file, GByteArray* b, int free );
 
+/* a copy of b, for the unserialize functions that free what they read */
+GByteArray* copy_buf( GByteArray* b );
+
+FILE* fopen_read_or_die( char* file );
+FILE* fopen_write_or_die( char* file );
+
 void read_cpabe_file( char* file,    GByteArray** cph_buf,
 											int* file_len, GByteArray** aes_buf );
 
+/*
+	As above, but returns a message instead of exiting if the file can't
+	be read or is malformed, and zero on success.
+*/
+char* load_cpabe_file( char* file,    GByteArray** cph_buf,
+											 int* file_len, GByteArray** aes_buf );
+
+/*
+	As above, also leaving in *tag the payload tag that follows cph_buf
+	in files written by this version, or zero for older files.
+*/
+char* load_cpabe_file_tag( char* file,    GByteArray** cph_buf,
+													 int* file_len, GByteArray** aes_buf, GByteArray** tag );
+
+/* As above, reading only cph_buf and seeking past the rest. */
+char* load_cpabe_header( char* file, GByteArray** cph_buf );
+
+/*
+	Written to FILE.tmp and renamed into place once synced, so a crash
+	leaves either the whole file or none of it. Threads writing at the
+	same time share their syncs. Unless tag is zero, it is appended
+	after cph_buf, where older readers ignore it.
+*/
 void write_cpabe_file( char* file,   GByteArray* cph_buf,
-											 int file_len, GByteArray* aes_buf );
+											 int file_len, GByteArray* aes_buf, unsigned char* tag );
+
+/* As above, but returns a message instead of exiting, and zero on success. */
+char* save_cpabe_file( char* file,   GByteArray* cph_buf,
+											 int file_len, GByteArray* aes_buf, unsigned char* tag );
+
+/* b written and synced in the same way, returning zero if it can't be */
+int  write_file_synced( char* file, GByteArray* b );
 
 void die(char* fmt, ...);
 
+/* parse a byte count with an optional K, M or G suffix */
+size_t parse_size( char* s );
+
 GByteArray* aes_128_cbc_encrypt( GByteArray* pt, element_t k );
 GByteArray* aes_128_cbc_decrypt( GByteArray* ct, element_t k );
 
+/*
+	As above, but with the IV the encryption of seq under the key, so
+	that many buffers can be encrypted under one key with IVs that can't
+	be predicted without it. Sequence number zero is the zero IV used
+	for whole files.
+*/
+GByteArray* aes_128_cbc_encrypt_seq( GByteArray* pt, element_t k, guint32 seq );
+GByteArray* aes_128_cbc_decrypt_seq( GByteArray* ct, element_t k, guint32 seq );
+
+/*
+	An HMAC-SHA256 of file_len and aes_buf under a key derived from the
+	AES key raw, stored after cph_buf. Changing the header changes the
+	key it decrypts to, so the tag covers it too.
+*/
+#define CPABE_TAG_MAGIC "cpabetag"
+#define CPABE_TAG_LEN   32
+
+void cpabe_tag( unsigned char* raw, int file_len, GByteArray* aes_buf, unsigned char* tag );
+int  cpabe_tag_ok( unsigned char* raw, int file_len, GByteArray* aes_buf, GByteArray* tag );
+
+/*
+	The tag of record seq of a stream: as above, but under a key derived
+	with a label of its own, over seq, whether the record is the last one
+	and aes_buf. Records can't be reordered, and a stream cut short
+	can't pass for a whole one.
+*/
+#define CPABE_RECORD_MAGIC "cpaberec"
+
+void cpabe_record_tag( unsigned char* raw, guint32 seq, int last,
+											 GByteArray* aes_buf, unsigned char* tag );
+int  cpabe_record_tag_ok( unsigned char* raw, guint32 seq, int last,
+													GByteArray* aes_buf, unsigned char* tag );
+
+/* the 16 bytes of an element used as AES key, and decryption with them */
+void        session_key_bytes( element_t k, unsigned char* raw );
+GByteArray* aes_128_cbc_decrypt_raw( GByteArray* ct, unsigned char* raw, guint32 seq );
+
+/*
+	Decrypts ct in memory only, returning whether the length stored in
+	it is file_len and the padding is intact. Without a tag this is all
+	that can be checked.
+*/
+int aes_128_cbc_check_raw( GByteArray* ct, unsigned char* raw, int file_len );
+
 #define CPABE_VERSION PACKAGE_NAME "%s " PACKAGE_VERSION "\n" \
 "\n" \
 "Parts Copyright (C) 2006, 2007 John Bethencourt and SRI International.\n" \
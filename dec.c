@@ -5,11 +5,20 @@
 #include <pbc.h>
 #include <pbc_random.h>
 
-#include "bswabe.h"
 #include "common.h"
+#include "threshold.h"
+#include "decrypt.h"
+#include "cmaf.h"
+#include "batch.h"
+#include "keycache.h"
+#include "mpd_policy.h"
 
 char* usage =
-"Usage: cpabe-dec [OPTION ...] PUB_KEY PRIV_KEY FILE\n"
+"Usage: cpabe-dec [OPTION ...] PUB_KEY PRIV_KEY FILE [FILE ...]\n"
+"  or:  cpabe-dec [OPTION ...] -R DIR PUB_KEY PRIV_KEY [FILE ...]\n"
+"  or:  cpabe-dec [OPTION ...] -S PUB_KEY PRIV_KEY\n"
+"  or:  cpabe-dec [OPTION ...] -K KEYRING PUB_KEY [FILE ...]\n"
+"  or:  cpabe-dec [OPTION ...] -x XML_FILE PUB_KEY PRIV_KEY [FILE ...]\n"
 "\n"
 "Decrypt FILE using private key PRIV_KEY and assuming public key\n"
 "PUB_KEY. If the name of FILE is X.cpabe, the decrypted file will\n"
@@ -17,6 +26,37 @@ char* usage =
 "decrypted in place. Use of the -o option overrides this\n"
 "behavior.\n"
 "\n"
+"Any number of files may be given, and -R adds every file under DIR\n"
+"whose name ends in .cpabe or _out. The keys are loaded once, the\n"
+"private key's pairings preprocessed once needed a second time, and the\n"
+"files decrypted in parallel; a file named X_out is written as X. A\n"
+"line is printed for each file, in the order given, and the exit\n"
+"status is nonzero if any of them failed.\n"
+"\n"
+"Unless -k is given, the encrypted files are removed as they are\n"
+"decrypted, by these forms as by the first: each one only once its\n"
+"plaintext has been synced to disk under its final name, so a run cut\n"
+"short leaves every file either still encrypted or decrypted in full.\n"
+"\n"
+"With -x, the files of the xml file are added as cpabe-enc -x wrote\n"
+"them, each BaseURL with _out appended, and decrypted like the files\n"
+"under -R. Those whose policy the key can't satisfy are skipped\n"
+"without reading more than their header, and don't count as failed.\n"
+"\n"
+"The third form decrypts a stream written by cpabe-enc -S from stdin,\n"
+"writing each chunk to stdout (or the -o file) as soon as it arrives\n"
+"and its tag has been checked. A stream that was altered, or that ends\n"
+"before the record cpabe-enc -S writes last, is an error.\n"
+"\n"
+"With -t, PRIV_KEY is the secret written by cpabe-keygen -t and each\n"
+"FILE has been through cpabe-transform, which did the pairings; a file\n"
+"named X.tcpabe is written as X. Finishing costs one exponentiation.\n"
+"\n"
+"With -K, any of the forms may take the directory KEYRING in place of\n"
+"PRIV_KEY. Every private key in it is loaded, and each file is\n"
+"decrypted with the key that satisfies its policy with the fewest\n"
+"pairings, judged from the policy alone.\n"
+"\n"
 "Mandatory arguments to long options are mandatory for short options too.\n\n"
 " -h, --help               print this message\n\n"
 " -v, --version            print version information\n\n"
@@ -24,39 +64,155 @@ char* usage =
 " -o, --output FILE        write output to FILE\n\n"
 " -d, --deterministic      use deterministic \"random\" numbers\n"
 "                          (only for debugging)\n\n"
-/* " -s, --no-opt-sat         pick an arbitrary way of satisfying the policy\n" */
-/* "                          (only for performance comparison)\n\n" */
-/* " -n, --naive-dec          use slower decryption algorithm\n" */
-/* "                          (only for performance comparison)\n\n" */
-/* " -f, --flatten            use slightly different decryption algorithm\n" */
-/* "                          (may result in higher or lower performance)\n\n" */
-/* " -r, --report-ops         report numbers of group operations\n" */
-/* "                          (only for performance evaluation)\n\n" */
+" -S, --stream             decrypt a CMAF stream chunk by chunk\n\n"
+" -K, --keyring DIR        use the private keys in DIR\n\n"
+" -t, --transformed        finish decrypting files from cpabe-transform\n\n"
+" -R, --recursive DIR      decrypt the encrypted files under DIR\n\n"
+" -x, --xml-input FILE     decrypt the files of the xml file FILE\n\n"
+" -j, --jobs N             decrypt up to N files at once\n\n"
+" -C, --cache-dir DIR      keep recovered session keys in DIR, so files\n"
+"                          with a header seen before skip the pairings\n"
+"                          (anyone who can read DIR can decrypt them)\n\n"
+" -e, --cache-entries N    keep up to N session keys (default 1024; the\n"
+"                          cache is in memory when decrypting many files\n"
+"                          and on disk only with -C)\n\n"
+" -l, --lock-cache         lock the session key cache into memory\n\n"
+" -p, --pairing-threads N  compute the pairings of a file on N threads\n"
+"                          (default: one per processor)\n\n"
+" -s, --no-opt-sat         pick an arbitrary way of satisfying the policy\n"
+"                          (only for performance comparison)\n\n"
+" -n, --naive-dec          use slower decryption algorithm\n"
+"                          (only for performance comparison)\n\n"
+" -f, --flatten            use slightly different decryption algorithm\n"
+"                          (may result in higher or lower performance)\n\n"
+" -L, --lsss               choose the leaves and their exponents by\n"
+"                          solving the policy as a secret sharing matrix\n"
+"                          (only for performance comparison)\n\n"
+" -r, --report-ops         report numbers of group operations\n"
+"                          (only for performance evaluation)\n\n"
 "";
 
-/* enum { */
-/* 	DEC_NAIVE, */
-/* 	DEC_FLATTEN, */
-/* 	DEC_MERGE, */
-/* } dec_strategy = DEC_MERGE;		 */
-
 char* pub_file   = 0;
 char* prv_file   = 0;
+char* keyring    = 0;
+int   transformed = 0;
 char* in_file    = 0;
 char* out_file   = 0;
-/* int   no_opt_sat = 0; */
-/* int   report_ops = 0; */
+GPtrArray* in_files = 0;
+int   many       = 0;
+int   jobs       = 1;
+int   report_ops = 0;
 int   keep       = 0;
+int   stream     = 0;
+char* cache_dir  = 0;
+int   cache_max  = 1024;
+int   cache_lock = 0;
+int   pair_threads = 0;
+int   from_xml   = 0;
+
+keycache_t* cache = 0;
+
+GByteArray* pub_buf;
+GPtrArray*  prv_bufs;
+GByteArray* retained_buf;
+
+/* only for choosing a key, each thread decrypts with its own copies */
+dec_pub_t* pub;
+GPtrArray* prvs;
+dec_opts_t opts = { DEC_MERGE, 0, 0, 0, 0, 0 };
+
+/* what each thread decrypting unserializes for itself */
+typedef struct
+{
+	dec_pub_t* pub;
+	GPtrArray* prvs;     /* in the order of prvs */
+	element_t  retained; /* with -t, instead of prvs */
+	dec_opts_t opts;     /* with Lagrange and plan caches of its own */
+}
+dec_thread_t;
+
+typedef struct
+{
+	char* file;
+	char* msg;  /* line to print once all files before this one are done */
+	int   done;
+	int   ok;
+}
+dec_job_t;
+
+dec_job_t* dec_jobs;
+int        dec_reported = 0;
+GMutex     report_lock;
+
+char* unsatisfied = "cannot decrypt, attributes in key do not satisfy policy";
+char* tampered    = "payload does not match its tag, file damaged or altered";
+
+/* adds the files cpabe-enc -x wrote for the BaseURLs of file */
+void
+add_xml( char* file )
+{
+	char** p;
+	char** f;
+	int np;
+	int nf;
+	int i;
+
+	if( parse_xml(file, &p, &np, &f, &nf) )
+		die("can't parse xml file: %s\n", file);
+
+	for( i = 0; i < nf; i++ )
+	{
+		g_ptr_array_add(in_files, g_strdup_printf("%s%s", f[i], SUFFIX));
+		free(f[i]);
+	}
+	for( i = 0; i < np; i++ )
+		free(p[i]);
+	free(p);
+	free(f);
+}
+
+/* adds the encrypted files under dir in name order */
+void
+add_dir( char* dir )
+{
+	GDir* d;
+	const char* name;
+	GSList* names;
+	GSList* l;
+	char* path;
+
+	if( !(d = g_dir_open(dir, 0, 0)) )
+		die("can't read directory: %s\n", dir);
 
-/* int num_pairings = 0; */
-/* int num_exps     = 0; */
-/* int num_muls     = 0; */
+	names = 0;
+	while( (name = g_dir_read_name(d)) )
+		names = g_slist_prepend(names, strdup(name));
+	g_dir_close(d);
+	names = g_slist_sort(names, (GCompareFunc) strcmp);
+
+	for( l = names; l; l = l->next )
+	{
+		path = g_build_filename(dir, l->data, (char*) 0);
+		if( g_file_test(path, G_FILE_TEST_IS_DIR) )
+		{
+			add_dir(path);
+			free(path);
+		}
+		else if( g_str_has_suffix(l->data, ".cpabe") || g_str_has_suffix(l->data, "_out") )
+			g_ptr_array_add(in_files, path);
+		else
+			free(path);
+		free(l->data);
+	}
+	g_slist_free(names);
+}
 
 void
 parse_args( int argc, char** argv )
 {
 	int i;
 
+	in_files = g_ptr_array_new();
 	for( i = 1; i < argc; i++ )
 		if(      !strcmp(argv[i], "-h") || !strcmp(argv[i], "--help") )
 		{
@@ -83,45 +239,131 @@ parse_args( int argc, char** argv )
 		{
 			pbc_random_set_deterministic(0);
 		}
-/* 		else if( !strcmp(argv[i], "-s") || !strcmp(argv[i], "--no-opt-sat") ) */
-/* 		{ */
-/* 			no_opt_sat = 1; */
-/* 		} */
-/* 		else if( !strcmp(argv[i], "-n") || !strcmp(argv[i], "--naive-dec") ) */
-/* 		{ */
-/* 			dec_strategy = DEC_NAIVE; */
-/* 		} */
-/* 		else if( !strcmp(argv[i], "-f") || !strcmp(argv[i], "--flatten") ) */
-/* 		{ */
-/* 			dec_strategy = DEC_FLATTEN; */
-/* 		} */
-/* 		else if( !strcmp(argv[i], "-r") || !strcmp(argv[i], "--report-ops") ) */
-/* 		{ */
-/* 			report_ops = 1; */
-/* 		} */
+		else if( !strcmp(argv[i], "-S") || !strcmp(argv[i], "--stream") )
+		{
+			stream = 1;
+		}
+		else if( !strcmp(argv[i], "-K") || !strcmp(argv[i], "--keyring") )
+		{
+			if( ++i >= argc )
+				die(usage);
+			else
+				keyring = argv[i];
+		}
+		else if( !strcmp(argv[i], "-t") || !strcmp(argv[i], "--transformed") )
+		{
+			transformed = 1;
+		}
+		else if( !strcmp(argv[i], "-R") || !strcmp(argv[i], "--recursive") )
+		{
+			if( ++i >= argc )
+				die(usage);
+			else
+			{
+				add_dir(argv[i]);
+				many = 1;
+			}
+		}
+		else if( !strcmp(argv[i], "-x") || !strcmp(argv[i], "--xml-input") )
+		{
+			if( ++i >= argc )
+				die(usage);
+			else
+			{
+				add_xml(argv[i]);
+				from_xml = 1;
+				many = 1;
+			}
+		}
+		else if( !strcmp(argv[i], "-j") || !strcmp(argv[i], "--jobs") )
+		{
+			if( ++i >= argc || (jobs = atoi(argv[i])) < 1 )
+				die(usage);
+		}
+		else if( !strcmp(argv[i], "-C") || !strcmp(argv[i], "--cache-dir") )
+		{
+			if( ++i >= argc )
+				die(usage);
+			else
+				cache_dir = argv[i];
+		}
+		else if( !strcmp(argv[i], "-e") || !strcmp(argv[i], "--cache-entries") )
+		{
+			if( ++i >= argc || (cache_max = atoi(argv[i])) < 1 )
+				die(usage);
+		}
+		else if( !strcmp(argv[i], "-l") || !strcmp(argv[i], "--lock-cache") )
+		{
+			cache_lock = 1;
+		}
+		else if( !strcmp(argv[i], "-p") || !strcmp(argv[i], "--pairing-threads") )
+		{
+			if( ++i >= argc || (pair_threads = atoi(argv[i])) < 1 )
+				die(usage);
+		}
+		else if( !strcmp(argv[i], "-s") || !strcmp(argv[i], "--no-opt-sat") )
+		{
+			opts.no_opt_sat = 1;
+		}
+		else if( !strcmp(argv[i], "-n") || !strcmp(argv[i], "--naive-dec") )
+		{
+			opts.strategy = DEC_NAIVE;
+		}
+		else if( !strcmp(argv[i], "-f") || !strcmp(argv[i], "--flatten") )
+		{
+			opts.strategy = DEC_FLATTEN;
+		}
+		else if( !strcmp(argv[i], "-L") || !strcmp(argv[i], "--lsss") )
+		{
+			opts.strategy = DEC_LSSS;
+		}
+		else if( !strcmp(argv[i], "-r") || !strcmp(argv[i], "--report-ops") )
+		{
+			report_ops = 1;
+		}
 		else if( !pub_file )
 		{
 			pub_file = argv[i];
 		}
-		else if( !prv_file )
+		else if( !prv_file && !keyring )
 		{
 			prv_file = argv[i];
 		}
-		else if( !in_file )
-		{
-			in_file = argv[i];
-		}
 		else
+			g_ptr_array_add(in_files, strdup(argv[i]));
+
+	if( transformed && (stream || keyring) )
+		die("cannot use -t with -S or -K\n");
+
+	if( stream )
+	{
+		if( !pub_file || (!prv_file && !keyring) || in_files->len )
 			die(usage);
+		return;
+	}
 
-	if( !pub_file || !prv_file || !in_file )
+	if( !pub_file || (!prv_file && !keyring) || (!in_files->len && !many) )
 		die(usage);
 
+	if( in_files->len > 1 )
+		many = 1;
+
+	if( many )
+	{
+		if( out_file )
+			die("cannot use -o with more than one file\n");
+		return;
+	}
+
+	in_file = g_ptr_array_index(in_files, 0);
+
 	if( !out_file )
 	{
 		if(  strlen(in_file) > 6 &&
 				!strcmp(in_file + strlen(in_file) - 6, ".cpabe") )
 			out_file = g_strndup(in_file, strlen(in_file) - 6);
+		else if( transformed && g_str_has_suffix(in_file, ".tcpabe") )
+			out_file = g_strndup(in_file, strlen(in_file) - 7);
 		else
 			out_file = strdup(in_file);
 	}
@@ -130,44 +372,463 @@ parse_args( int argc, char** argv )
 		die("cannot keep input file when decrypting file in place (try -o)\n");
 }
 
+char*
+out_name( char* in )
+{
+	if( g_str_has_suffix(in, ".cpabe") )
+		return g_strndup(in, strlen(in) - 6);
+	else if( transformed && g_str_has_suffix(in, ".tcpabe") )
+		return g_strndup(in, strlen(in) - 7);
+	else if( g_str_has_suffix(in, "_out") )
+		return g_strndup(in, strlen(in) - 4);
+	else
+		return strdup(in);
+}
+
+/* adds the private key in file to prvs, or returns zero if it is malformed */
+dec_prv_t*
+load_prv( char* file )
+{
+	GByteArray* b;
+	dec_prv_t* prv;
+
+	b = suck_file(file);
+	if( !(prv = dec_prv_unserialize(pub, copy_buf(b), 1)) )
+	{
+		g_byte_array_free(b, 1);
+		return 0;
+	}
+	g_ptr_array_add(prvs, prv);
+	g_ptr_array_add(prv_bufs, b);
+
+	return prv;
+}
+
+/* loads every private key in dir, in name order */
+void
+load_keyring( char* dir )
+{
+	GDir* d;
+	const char* name;
+	GSList* names;
+	GSList* l;
+	char* path;
+
+	if( !(d = g_dir_open(dir, 0, 0)) )
+		die("can't read directory: %s\n", dir);
+
+	names = 0;
+	while( (name = g_dir_read_name(d)) )
+		names = g_slist_prepend(names, strdup(name));
+	g_dir_close(d);
+	names = g_slist_sort(names, (GCompareFunc) strcmp);
+
+	for( l = names; l; l = l->next )
+	{
+		path = g_build_filename(dir, l->data, (char*) 0);
+		if( !g_file_test(path, G_FILE_TEST_IS_REGULAR) )
+			;
+		else if( !load_prv(path) )
+			fprintf(stderr, "skipping malformed private key: %s\n", path);
+		free(path);
+		free(l->data);
+	}
+	g_slist_free(names);
+
+	if( !prvs->len )
+		die("no private keys in %s\n", dir);
+}
+
+dec_thread_t*
+thread_new()
+{
+	dec_thread_t* t;
+	guint i;
+
+	t = (dec_thread_t*) malloc(sizeof(dec_thread_t));
+	t->pub = dec_pub_unserialize(copy_buf(pub_buf), 1);
+	t->prvs = g_ptr_array_new();
+	for( i = 0; i < prv_bufs->len; i++ )
+		g_ptr_array_add(t->prvs,
+										dec_prv_unserialize(t->pub, copy_buf(g_ptr_array_index(prv_bufs, i)), 1));
+	if( transformed )
+		dec_retained_unserialize(t->pub, copy_buf(retained_buf), t->retained);
+	t->opts = opts;
+	t->opts.lagrange = threshold_cache_new(t->pub->p);
+	t->opts.plans = dec_plancache_new(1024);
+
+	return t;
+}
+
+void
+thread_free( gpointer data )
+{
+	dec_thread_t* t;
+	guint i;
+
+	t = data;
+	dec_plancache_free(t->opts.plans);
+	threshold_cache_free(t->opts.lagrange);
+	if( transformed )
+		element_clear(t->retained);
+	for( i = 0; i < t->prvs->len; i++ )
+		dec_prv_free(g_ptr_array_index(t->prvs, i));
+	g_ptr_array_free(t->prvs, 1);
+	dec_pub_free(t->pub);
+	free(t);
+}
+
+GPrivate thread_keys = G_PRIVATE_INIT(thread_free);
+
+dec_thread_t*
+get_thread()
+{
+	dec_thread_t* t;
+
+	if( !(t = g_private_get(&thread_keys)) )
+	{
+		t = thread_new();
+		g_private_set(&thread_keys, t);
+	}
+
+	return t;
+}
+
+/*
+	Picks the key to decrypt the header in cph_buf with by looking at
+	its policy only, turning it away if no key can satisfy it. Returns
+	an error message, or zero if *prv may do.
+*/
+char*
+check_policy( GByteArray* cph_buf, dec_prv_t** prv )
+{
+	dec_summary_t* s;
+
+	*prv = 0;
+	if( transformed )
+		return 0;
+
+	if( !(s = dec_summary_read(cph_buf)) )
+		return "malformed ciphertext header";
+	*prv = dec_summary_pick(s, prvs, 0);
+	dec_summary_free(s);
+
+	return *prv ? 0 : unsatisfied;
+}
+
+/* as above, reading just the header of file */
+char*
+check_header( char* file, dec_prv_t** prv )
+{
+	GByteArray* cph_buf;
+	char* err;
+
+	if( (err = load_cpabe_header(file, &cph_buf)) )
+		return err;
+	err = check_policy(cph_buf, prv);
+	g_byte_array_free(cph_buf, 1);
+
+	return err;
+}
+
+/*
+	Recovers the AES key of the header in cph_buf into raw using prv,
+	from the cache if it has been seen before, adding the group
+	operations it took to ops. Returns an error message, or zero on
+	success.
+*/
+char*
+recover_key( GByteArray* cph_buf, dec_prv_t* prv, unsigned char* raw, dec_ops_t* ops )
+{
+	dec_thread_t* t;
+	dec_cph_t* cph;
+	element_t m;
+	guint i;
+	int ok = 0;
+
+	if( cache && keycache_get(cache, cph_buf, raw) )
+		return 0;
+
+	t = get_thread();
+	if( transformed )
+	{
+		ok = dec_finish(t->pub, cph_buf, t->retained, m);
+		if( !ok )
+			return "not a file from cpabe-transform";
+		if( ops )
+		{
+			ops->exps++;
+			ops->muls++;
+		}
+		session_key_bytes(m, raw);
+		element_clear(m);
+
+		return 0;
+	}
+
+	for( i = 0; g_ptr_array_index(prvs, i) != prv; i++ )
+		;
+	if( (cph = dec_cph_unserialize(t->pub, cph_buf, 0)) )
+	{
+		ok = dec_decrypt(t->pub, g_ptr_array_index(t->prvs, i), cph, m, &t->opts, ops);
+		dec_cph_free(cph);
+	}
+
+	if( !cph )
+		return "malformed ciphertext header";
+	if( !ok )
+		return "cannot decrypt, attributes in key do not satisfy policy";
+
+	session_key_bytes(m, raw);
+	element_clear(m);
+	if( cache )
+		keycache_put(cache, cph_buf, raw);
+
+	return 0;
+}
+
+char*
+format_ops( dec_ops_t* ops )
+{
+	return g_strdup_printf("pairings:        %5d\n"
+												 "exponentiations: %5d\n"
+												 "multiplications: %5d\n",
+												 ops->pairings, ops->exps, ops->muls);
+}
+
+void
+dec_stream( FILE* out, dec_ops_t* ops )
+{
+	GByteArray* cph_buf;
+	GByteArray* aes_buf;
+	GByteArray* plt;
+	unsigned char raw[16];
+	unsigned char tag[CPABE_TAG_LEN];
+	dec_prv_t* prv;
+	char* err;
+	guint32 seq;
+	int last;
+
+	if( !(cph_buf = cmaf_read_header(stdin)) )
+		die("empty input stream\n");
+
+	if( (err = check_policy(cph_buf, &prv)) || (err = recover_key(cph_buf, prv, raw, ops)) )
+		die("%s\n", err);
+	g_byte_array_free(cph_buf, 1);
+
+	/* nothing is written before its record's tag is checked */
+	last = 0;
+	for( seq = 1; (aes_buf = cmaf_read_record(stdin, tag)); seq++ )
+	{
+		last = !aes_buf->len;
+		if( !cpabe_record_tag_ok(raw, seq, last, aes_buf, tag) )
+			die("record %u does not match its tag, stream damaged or altered\n", seq);
+		if( last )
+		{
+			g_byte_array_free(aes_buf, 1);
+			break;
+		}
+
+		plt = aes_128_cbc_decrypt_raw(aes_buf, raw, seq);
+		g_byte_array_free(aes_buf, 1);
+
+		fwrite(plt->data, 1, plt->len, out);
+		g_byte_array_free(plt, 1);
+		if( fflush(out) )
+			die("can't write stream output\n");
+	}
+	memset(raw, 0, sizeof(raw));
+
+	if( !last )
+		die("stream ends before its last record, truncated\n");
+}
+
+/* print the lines of every file up to the first one still running */
+void
+dec_report( dec_job_t* job, char* msg, int ok )
+{
+	g_mutex_lock(&report_lock);
+	job->msg = msg;
+	job->ok = ok;
+	job->done = 1;
+	while( dec_reported < in_files->len && dec_jobs[dec_reported].done )
+	{
+		printf("%s\n", dec_jobs[dec_reported].msg);
+		free(dec_jobs[dec_reported].msg);
+		dec_reported++;
+	}
+	g_mutex_unlock(&report_lock);
+}
+
+int
+dec_file( gpointer data, gpointer user_data )
+{
+	dec_job_t* job;
+	GByteArray* cph_buf;
+	GByteArray* aes_buf;
+	GByteArray* plt;
+	GByteArray* tag;
+	unsigned char raw[16];
+	dec_ops_t ops = { 0, 0, 0 };
+	dec_prv_t* prv;
+	char* err;
+	char* out;
+	char* msg;
+	int file_len;
+	int ok;
+
+	job = data;
+	if( (err = check_header(job->file, &prv)) == unsatisfied && from_xml )
+	{
+		dec_report(job, g_strdup_printf("%s: skipped, attributes in key do not satisfy policy",
+																		job->file), 1);
+		return 1;
+	}
+	if( err || (err = load_cpabe_file_tag(job->file, &cph_buf, &file_len, &aes_buf, &tag)) )
+	{
+		dec_report(job, g_strdup_printf("%s: %s", job->file, err), 0);
+		return 0;
+	}
+
+	err = recover_key(cph_buf, prv, raw, &ops);
+	g_byte_array_free(cph_buf, 1);
+	if( !err && tag && !cpabe_tag_ok(raw, file_len, aes_buf, tag) )
+		err = tampered;
+	if( tag )
+		g_byte_array_free(tag, 1);
+
+	if( err )
+	{
+		g_byte_array_free(aes_buf, 1);
+		memset(raw, 0, sizeof(raw));
+		dec_report(job, g_strdup_printf("%s: %s", job->file, err), 0);
+		return 0;
+	}
+
+	plt = aes_128_cbc_decrypt_raw(aes_buf, raw, 0);
+	g_byte_array_set_size(plt, file_len);
+	g_byte_array_free(aes_buf, 1);
+	memset(raw, 0, sizeof(raw));
+
+	out = out_name(job->file);
+	if( (ok = write_file_synced(out, plt)) )
+	{
+		/* only now can the plaintext outlive a crash */
+		if( !keep && strcmp(job->file, out) )
+			unlink(job->file);
+		if( report_ops )
+			msg = g_strdup_printf("%s: decrypted to %s (%d pairings, %d exps, %d muls)",
+														job->file, out, ops.pairings, ops.exps, ops.muls);
+		else
+			msg = g_strdup_printf("%s: decrypted to %s", job->file, out);
+		dec_report(job, msg, 1);
+	}
+	else
+		dec_report(job, g_strdup_printf("%s: can't write file: %s", job->file, out), 0);
+
+	g_byte_array_free(plt, 1);
+	free(out);
+
+	return ok;
+}
+
 int
 main( int argc, char** argv )
 {
-	bswabe_pub_t* pub;
-	bswabe_prv_t* prv;
 	int file_len;
 	GByteArray* aes_buf;
 	GByteArray* plt;
 	GByteArray* cph_buf;
-	bswabe_cph_t* cph;
-	element_t m;
+	GByteArray* tag;
+	unsigned char raw[16];
+	dec_ops_t ops = { 0, 0, 0 };
+	dec_prv_t* prv;
+	char* err;
 
 	parse_args(argc, argv);
 
-	pub = bswabe_pub_unserialize(suck_file(pub_file), 1);
-	prv = bswabe_prv_unserialize(pub, suck_file(prv_file), 1);
+	pub_buf = suck_file(pub_file);
+	if( !(pub = dec_pub_unserialize(copy_buf(pub_buf), 1)) )
+		die("malformed public key: %s\n", pub_file);
+	prvs = g_ptr_array_new();
+	prv_bufs = g_ptr_array_new();
+	if( transformed )
+	{
+		element_t z;
+
+		retained_buf = suck_file(prv_file);
+		if( !dec_retained_unserialize(pub, copy_buf(retained_buf), z) )
+			die("malformed secret key: %s\n", prv_file);
+		element_clear(z);
+	}
+	else if( keyring )
+		load_keyring(keyring);
+	else if( !load_prv(prv_file) )
+		die("malformed private key: %s\n", prv_file);
+	opts.pool = dec_pool_new(pub, pair_threads ? pair_threads : g_get_num_processors());
+	opts.preprocess = many;
+
+	if( stream )
+	{
+		FILE* out;
+
+		out = out_file ? fopen_write_or_die(out_file) : stdout;
+		dec_stream(out, &ops);
+		if( fclose(out) )
+			die("can't write stream output\n");
+		if( report_ops )
+			fprintf(stderr, "%s", format_ops(&ops));
+
+		return 0;
+	}
+
+	if( many || cache_dir )
+		cache = keycache_new(cache_max, cache_dir, cache_lock);
+
+	if( many )
+	{
+		batch_t* b;
+		guint i;
+
+		dec_jobs = (dec_job_t*) calloc(in_files->len, sizeof(dec_job_t));
+		b = batch_new(jobs, 0, dec_file, 0);
+		for( i = 0; i < in_files->len; i++ )
+		{
+			dec_jobs[i].file = g_ptr_array_index(in_files, i);
+			batch_push(b, &dec_jobs[i], 0);
+		}
+
+		i = batch_finish(b);
+		keycache_free(cache);
+
+		return i ? 1 : 0;
+	}
 
-	read_cpabe_file(in_file, &cph_buf, &file_len, &aes_buf);
+	if( (err = check_header(in_file, &prv)) )
+		die("%s\n", err);
+	if( (err = load_cpabe_file_tag(in_file, &cph_buf, &file_len, &aes_buf, &tag)) )
+		die("%s: %s\n", err, in_file);
 
-	cph = bswabe_cph_unserialize(pub, cph_buf, 1);
-	if( !bswabe_dec(pub, prv, cph, m) )
-		die("%s", bswabe_error());
-	bswabe_cph_free(cph);
+	if( (err = recover_key(cph_buf, prv, raw, &ops)) )
+		die("%s\n", err);
+	g_byte_array_free(cph_buf, 1);
+	if( tag && !cpabe_tag_ok(raw, file_len, aes_buf, tag) )
+		die("%s\n", tampered);
 
-	plt = aes_128_cbc_decrypt(aes_buf, m);
+	plt = aes_128_cbc_decrypt_raw(aes_buf, raw, 0);
 	g_byte_array_set_size(plt, file_len);
 	g_byte_array_free(aes_buf, 1);
 
-	spit_file(out_file, plt, 1);
+	if( !write_file_synced(out_file, plt) )
+		die("can't write file: %s\n", out_file);
+	g_byte_array_free(plt, 1);
 
-	if( !keep )
+	if( !keep && strcmp(in_file, out_file) )
 		unlink(in_file);
 
 	/* report ops if necessary */
-/* 	if( report_ops ) */
-/* 		printf("pairings:        %5d\n" */
-/* 					 "exponentiations: %5d\n" */
-/* 					 "multiplications: %5d\n", num_pairings, num_exps, num_muls); */
+	if( report_ops )
+		printf("%s", format_ops(&ops));
 
 	return 0;
 }
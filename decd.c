@@ -0,0 +1,646 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <glib.h>
+#include <pbc.h>
+#include <pbc_random.h>
+
+#include "common.h"
+#include "threshold.h"
+#include "decrypt.h"
+#include "keycache.h"
+#include "segcache.h"
+#include "mpd_policy.h"
+
+char* usage =
+"Usage: cpabe-decd [OPTION ...] SOCKET PUB_KEY PRIV_KEY [PRIV_KEY ...]\n"
+"   or: cpabe-decd [OPTION ...] -H PORT DIR PUB_KEY PRIV_KEY [PRIV_KEY ...]\n"
+"\n"
+"Serve decryption requests on the Unix socket SOCKET, keeping public key\n"
+"PUB_KEY and the private keys PRIV_KEY loaded between requests. A file\n"
+"is decrypted with the private key that satisfies its policy with the\n"
+"fewest pairings, judged from the policy alone.\n"
+"\n"
+"Each request is one line holding the path of an encrypted file. The\n"
+"reply is a line \"OK LENGTH\" followed by LENGTH bytes of plaintext, or\n"
+"a line \"ERR MESSAGE\". Any number of requests may be sent over one\n"
+"connection, and connections are served concurrently. Only the user\n"
+"running the daemon may connect to SOCKET, and plaintext is only ever\n"
+"sent back over it, never written to a file.\n"
+"\n"
+"With -H, serve the files under DIR over HTTP on 127.0.0.1:PORT instead.\n"
+"A request for X is answered with the decryption of X_out if there is\n"
+"such a file, as made by cpabe-enc -x, and with X itself otherwise, so\n"
+"a player can be pointed at the MPD in DIR. Decrypted segments are kept\n"
+"in memory, and once two segments of a Representation have been asked\n"
+"for in order, the ones after them are decrypted ahead of the player.\n"
+"\n"
+"Mandatory arguments to long options are mandatory for short options too.\n\n"
+" -h, --help               print this message\n\n"
+" -v, --version            print version information\n\n"
+" -j, --jobs N             serve up to N connections at once\n\n"
+" -C, --cache-dir DIR      also keep recovered session keys in DIR\n"
+"                          (anyone who can read DIR can decrypt them)\n\n"
+" -e, --cache-entries N    keep up to N session keys (default 1024)\n\n"
+" -l, --lock-cache         lock the session key cache into memory\n\n"
+" -p, --pairing-threads N  compute the pairings of a file on N threads\n"
+"                          (default: one per processor)\n\n"
+" -H, --http PORT          serve DIR over HTTP on PORT (see above)\n\n"
+" -M, --segment-cache SIZE keep up to SIZE bytes of decrypted segments\n"
+"                          (with -H; default 64M)\n\n"
+" -a, --lookahead N        decrypt up to N segments ahead of the player\n"
+"                          (with -H; default 3, 0 to disable)\n\n"
+" -d, --deterministic      use deterministic \"random\" numbers\n"
+"                          (only for debugging)\n\n"
+"";
+
+char*   sock_file = 0;
+char*   pub_file  = 0;
+GSList* prv_files = 0;
+int     jobs      = 4;
+char*   cache_dir  = 0;
+int     cache_max  = 1024;
+int     cache_lock = 0;
+int     pair_threads = 0;
+int     http_port = 0;
+size_t  seg_max   = 64 << 20;
+int     lookahead = 3;
+char*   root      = 0;
+
+keycache_t* cache;
+segcache_t* segments;
+
+GByteArray* pub_buf;
+GPtrArray*  prv_bufs;
+
+/* only for choosing a key, each thread decrypts with its own copies */
+dec_pub_t* pub;
+GPtrArray* prvs;
+dec_opts_t opts = { DEC_MERGE, 0, 0, 0, 0, 0 };
+
+/* what each thread decrypting unserializes for itself */
+typedef struct
+{
+	dec_pub_t* pub;
+	GPtrArray* prvs; /* in the order of prvs */
+	dec_opts_t opts; /* with Lagrange and plan caches of its own */
+}
+decd_state_t;
+
+void
+parse_args( int argc, char** argv )
+{
+	int i;
+
+	for( i = 1; i < argc; i++ )
+		if(      !strcmp(argv[i], "-h") || !strcmp(argv[i], "--help") )
+		{
+			printf("%s", usage);
+			exit(0);
+		}
+		else if( !strcmp(argv[i], "-v") || !strcmp(argv[i], "--version") )
+		{
+			printf(CPABE_VERSION, "-decd");
+			exit(0);
+		}
+		else if( !strcmp(argv[i], "-j") || !strcmp(argv[i], "--jobs") )
+		{
+			if( ++i >= argc || (jobs = atoi(argv[i])) < 1 )
+				die(usage);
+		}
+		else if( !strcmp(argv[i], "-C") || !strcmp(argv[i], "--cache-dir") )
+		{
+			if( ++i >= argc )
+				die(usage);
+			else
+				cache_dir = argv[i];
+		}
+		else if( !strcmp(argv[i], "-e") || !strcmp(argv[i], "--cache-entries") )
+		{
+			if( ++i >= argc || (cache_max = atoi(argv[i])) < 1 )
+				die(usage);
+		}
+		else if( !strcmp(argv[i], "-l") || !strcmp(argv[i], "--lock-cache") )
+		{
+			cache_lock = 1;
+		}
+		else if( !strcmp(argv[i], "-p") || !strcmp(argv[i], "--pairing-threads") )
+		{
+			if( ++i >= argc || (pair_threads = atoi(argv[i])) < 1 )
+				die(usage);
+		}
+		else if( !strcmp(argv[i], "-H") || !strcmp(argv[i], "--http") )
+		{
+			if( ++i >= argc || (http_port = atoi(argv[i])) < 1 || http_port > 65535 )
+				die(usage);
+		}
+		else if( !strcmp(argv[i], "-M") || !strcmp(argv[i], "--segment-cache") )
+		{
+			if( ++i >= argc )
+				die(usage);
+			else
+				seg_max = parse_size(argv[i]);
+		}
+		else if( !strcmp(argv[i], "-a") || !strcmp(argv[i], "--lookahead") )
+		{
+			if( ++i >= argc || (lookahead = atoi(argv[i])) < 0 )
+				die(usage);
+		}
+		else if( !strcmp(argv[i], "-d") || !strcmp(argv[i], "--deterministic") )
+		{
+			pbc_random_set_deterministic(0);
+		}
+		else if( !sock_file )
+		{
+			sock_file = argv[i];
+		}
+		else if( !pub_file )
+		{
+			pub_file = argv[i];
+		}
+		else
+			prv_files = g_slist_append(prv_files, argv[i]);
+
+	if( !sock_file || !pub_file || !prv_files )
+		die(usage);
+
+	if( http_port )
+	{
+		root = sock_file;
+		sock_file = 0;
+	}
+}
+
+decd_state_t*
+state_new()
+{
+	decd_state_t* st;
+	guint i;
+
+	st = (decd_state_t*) malloc(sizeof(decd_state_t));
+	st->pub = dec_pub_unserialize(copy_buf(pub_buf), 1);
+	st->prvs = g_ptr_array_new();
+	for( i = 0; i < prv_bufs->len; i++ )
+		g_ptr_array_add(st->prvs,
+										dec_prv_unserialize(st->pub, copy_buf(g_ptr_array_index(prv_bufs, i)), 1));
+	st->opts = opts;
+	st->opts.lagrange = threshold_cache_new(st->pub->p);
+	st->opts.plans = dec_plancache_new(1024);
+
+	return st;
+}
+
+void
+state_free( gpointer data )
+{
+	decd_state_t* st;
+	guint i;
+
+	st = data;
+	dec_plancache_free(st->opts.plans);
+	threshold_cache_free(st->opts.lagrange);
+	for( i = 0; i < st->prvs->len; i++ )
+		dec_prv_free(g_ptr_array_index(st->prvs, i));
+	g_ptr_array_free(st->prvs, 1);
+	dec_pub_free(st->pub);
+	free(st);
+}
+
+GPrivate thread_state = G_PRIVATE_INIT(state_free);
+
+decd_state_t*
+get_state()
+{
+	decd_state_t* st;
+
+	if( !(st = g_private_get(&thread_state)) )
+	{
+		st = state_new();
+		g_private_set(&thread_state, st);
+	}
+
+	return st;
+}
+
+/* returns an error message or zero, leaving the plaintext in *plt */
+char*
+decrypt_file( char* file, GByteArray** plt )
+{
+	GByteArray* cph_buf;
+	GByteArray* aes_buf;
+	GByteArray* tag;
+	dec_summary_t* summary;
+	decd_state_t* st;
+	dec_prv_t* prv;
+	dec_cph_t* cph;
+	element_t m;
+	unsigned char raw[16];
+	char* err;
+	int file_len;
+	int found;
+	guint i;
+
+	if( (err = load_cpabe_header(file, &cph_buf)) )
+		return err;
+	if( !(summary = dec_summary_read(cph_buf)) )
+		err = "malformed ciphertext header";
+	else
+	{
+		if( !(prv = dec_summary_pick(summary, prvs, 0)) )
+			err = "attributes in keys do not satisfy policy";
+		dec_summary_free(summary);
+	}
+	g_byte_array_free(cph_buf, 1);
+	if( err )
+		return err;
+
+	if( (err = load_cpabe_file_tag(file, &cph_buf, &file_len, &aes_buf, &tag)) )
+		return err;
+
+	if( !(found = keycache_get(cache, cph_buf, raw)) )
+	{
+		st = get_state();
+		for( i = 0; g_ptr_array_index(prvs, i) != prv; i++ )
+			;
+		if( (cph = dec_cph_unserialize(st->pub, cph_buf, 0)) )
+		{
+			found = dec_decrypt(st->pub, g_ptr_array_index(st->prvs, i), cph, m, &st->opts, 0);
+			dec_cph_free(cph);
+		}
+
+		if( !cph )
+		{
+			g_byte_array_free(cph_buf, 1);
+			g_byte_array_free(aes_buf, 1);
+			if( tag )
+				g_byte_array_free(tag, 1);
+			return "malformed ciphertext header";
+		}
+
+		if( found )
+		{
+			session_key_bytes(m, raw);
+			element_clear(m);
+			keycache_put(cache, cph_buf, raw);
+		}
+	}
+	g_byte_array_free(cph_buf, 1);
+
+	if( !found )
+		err = "attributes in keys do not satisfy policy";
+	else if( tag && !cpabe_tag_ok(raw, file_len, aes_buf, tag) )
+		err = "payload does not match its tag";
+	else if( !tag && !aes_128_cbc_check_raw(aes_buf, raw, file_len) )
+		err = "payload length or padding is wrong";
+	if( tag )
+		g_byte_array_free(tag, 1);
+	if( err )
+	{
+		g_byte_array_free(aes_buf, 1);
+		memset(raw, 0, sizeof(raw));
+		return err;
+	}
+
+	*plt = aes_128_cbc_decrypt_raw(aes_buf, raw, 0);
+	g_byte_array_set_size(*plt, file_len);
+	g_byte_array_free(aes_buf, 1);
+	memset(raw, 0, sizeof(raw));
+
+	return 0;
+}
+
+/* the segcache_load_t for -H, path being relative to root */
+char*
+load_segment( char* path, GByteArray** plt )
+{
+	char* file;
+	char* err;
+
+	file = g_strdup_printf("%s/%s%s", root, path, SUFFIX);
+	err = decrypt_file(file, plt);
+	free(file);
+
+	return err;
+}
+
+/*
+	Decodes %XX escapes in the path of a request target in place, dropping
+	any query, and returns it without its leading slash, or zero if it is
+	malformed or steps outside root.
+*/
+char*
+request_path( char* target )
+{
+	char** parts;
+	char* s;
+	char* d;
+	int bad;
+	int i;
+
+	if( target[0] != '/' )
+		return 0;
+	if( (s = strchr(target, '?')) )
+		*s = 0;
+
+	for( s = d = target; *s; s++, d++ )
+		if( *s == '%' && g_ascii_isxdigit(s[1]) && g_ascii_isxdigit(s[2]) )
+		{
+			*d = g_ascii_xdigit_value(s[1]) << 4 | g_ascii_xdigit_value(s[2]);
+			if( !*d )
+				return 0;
+			s += 2;
+		}
+		else
+			*d = *s;
+	*d = 0;
+
+	bad = 0;
+	parts = g_strsplit(target, "/", 0);
+	for( i = 0; parts[i]; i++ )
+		if( !strcmp(parts[i], "..") )
+			bad = 1;
+	g_strfreev(parts);
+
+	return bad ? 0 : target + 1;
+}
+
+char*
+content_type( char* path )
+{
+	if( g_str_has_suffix(path, ".mpd") )
+		return "application/dash+xml";
+	if( g_str_has_suffix(path, ".mp4") || g_str_has_suffix(path, ".m4s") ||
+			g_str_has_suffix(path, ".m4v") || g_str_has_suffix(path, ".m4a") )
+		return "video/mp4";
+	return "application/octet-stream";
+}
+
+void
+http_reply( FILE* out, int code, char* reason, char* type,
+						unsigned char* body, size_t len, int head, int keep )
+{
+	fprintf(out, "HTTP/1.1 %d %s\r\n"
+					"Content-Type: %s\r\n"
+					"Content-Length: %lu\r\n"
+					"Connection: %s\r\n"
+					"\r\n",
+					code, reason, type, (unsigned long) len, keep ? "keep-alive" : "close");
+	if( !head )
+		fwrite(body, 1, len, out);
+}
+
+void
+http_error( FILE* out, int code, char* reason, int head, int keep )
+{
+	char* body;
+
+	body = g_strdup_printf("%d %s\n", code, reason);
+	http_reply(out, code, reason, "text/plain", (unsigned char*) body, strlen(body), head, keep);
+	free(body);
+}
+
+/* answers one request for path, which has been checked by request_path */
+void
+http_get( FILE* out, char* path, int head, int keep )
+{
+	GByteArray* plt;
+	char* file;
+	char* err;
+	gchar* data;
+	gsize len;
+
+	file = g_strdup_printf("%s/%s%s", root, path, SUFFIX);
+	if( *path && g_file_test(file, G_FILE_TEST_IS_REGULAR) )
+	{
+		if( !(err = segcache_get(segments, path, &plt)) )
+		{
+			http_reply(out, 200, "OK", content_type(path), plt->data, plt->len, head, keep);
+			g_byte_array_unref(plt);
+		}
+		else if( strstr(err, "do not satisfy") )
+			http_error(out, 403, "Forbidden", head, keep);
+		else
+		{
+			fprintf(stderr, "%s: %s\n", file, err);
+			http_error(out, 500, "Internal Server Error", head, keep);
+		}
+	}
+	else
+	{
+		free(file);
+		file = g_strdup_printf("%s/%s", root, path);
+		if( *path && g_file_test(file, G_FILE_TEST_IS_REGULAR) &&
+				g_file_get_contents(file, &data, &len, 0) )
+		{
+			http_reply(out, 200, "OK", content_type(path), (unsigned char*) data, len, head, keep);
+			g_free(data);
+		}
+		else
+			http_error(out, 404, "Not Found", head, keep);
+	}
+	free(file);
+}
+
+/*
+	Serves HTTP/1.x requests on one connection until the client closes it
+	or asks for it to be closed.
+*/
+void
+serve_http( FILE* in, FILE* out )
+{
+	char* line;
+	size_t size;
+	ssize_t n;
+	char** req;
+	char* path;
+	int head;
+	int keep;
+
+	line = 0;
+	size = 0;
+	while( getline(&line, &size, in) > 0 )
+	{
+		req = g_strsplit(g_strstrip(line), " ", 0);
+
+		if( !req[0] || !req[1] || !req[2] || req[3] || !g_str_has_prefix(req[2], "HTTP/1.") )
+			keep = -1;
+		else
+			keep = strcmp(req[2], "HTTP/1.0") != 0;
+
+		/* only whether to keep the connection open matters in the headers */
+		while( (n = getline(&line, &size, in)) > 0 && strcmp(g_strstrip(line), "") )
+			if( !g_ascii_strncasecmp(line, "Connection:", 11) )
+			{
+				if( !g_ascii_strcasecmp(g_strstrip(line + 11), "close") )
+					keep = keep < 0 ? keep : 0;
+				else if( !g_ascii_strcasecmp(g_strstrip(line + 11), "keep-alive") )
+					keep = keep < 0 ? keep : 1;
+			}
+		if( n <= 0 )
+			keep = 0;
+
+		if( keep < 0 )
+		{
+			http_error(out, 400, "Bad Request", 0, 0);
+			keep = 0;
+		}
+		else if( (head = !strcmp(req[0], "HEAD")) || !strcmp(req[0], "GET") )
+		{
+			if( (path = request_path(req[1])) )
+				http_get(out, path, head, keep);
+			else
+				http_error(out, 400, "Bad Request", head, keep);
+		}
+		else
+			http_error(out, 405, "Method Not Allowed", 0, keep);
+
+		g_strfreev(req);
+		if( fflush(out) || !keep )
+			break;
+	}
+
+	free(line);
+}
+
+void
+serve( gpointer data, gpointer user_data )
+{
+	FILE* in;
+	FILE* out;
+	char* line;
+	size_t size;
+	ssize_t n;
+	char* err;
+	GByteArray* plt;
+	int fd;
+
+	fd = GPOINTER_TO_INT(data) - 1;
+	in  = fdopen(fd, "r");
+	out = fdopen(dup(fd), "w");
+
+	if( http_port )
+	{
+		serve_http(in, out);
+		fclose(in);
+		fclose(out);
+		return;
+	}
+
+	line = 0;
+	size = 0;
+	while( (n = getline(&line, &size, in)) > 0 )
+	{
+		if( line[n - 1] == '\n' )
+			line[--n] = 0;
+
+		/* the old "path\ttarget" form let any client write anywhere we can */
+		if( strchr(line, '\t') )
+			fprintf(out, "ERR output paths are not accepted: %s\n", line);
+		else if( (err = decrypt_file(line, &plt)) )
+			fprintf(out, "ERR %s: %s\n", err, line);
+		else
+		{
+			fprintf(out, "OK %u\n", plt->len);
+			fwrite(plt->data, 1, plt->len, out);
+			g_byte_array_free(plt, 1);
+		}
+
+		if( fflush(out) )
+			break;
+	}
+
+	free(line);
+	fclose(in);
+	fclose(out);
+}
+
+int
+main( int argc, char** argv )
+{
+	struct sockaddr_un addr;
+	struct sockaddr_in in_addr;
+	GThreadPool* pool;
+	GByteArray* b;
+	dec_prv_t* prv;
+	GSList* l;
+	mode_t mask;
+	int fd;
+	int c;
+
+	parse_args(argc, argv);
+
+	pub_buf = suck_file(pub_file);
+	if( !(pub = dec_pub_unserialize(copy_buf(pub_buf), 1)) )
+		die("malformed public key: %s\n", pub_file);
+	prvs = g_ptr_array_new();
+	prv_bufs = g_ptr_array_new();
+	for( l = prv_files; l; l = l->next )
+	{
+		b = suck_file(l->data);
+		g_ptr_array_add(prv_bufs, b);
+		if( !(prv = dec_prv_unserialize(pub, copy_buf(b), 1)) )
+			die("malformed private key: %s\n", (char*) l->data);
+		g_ptr_array_add(prvs, prv);
+	}
+	opts.pool = dec_pool_new(pub, pair_threads ? pair_threads : g_get_num_processors());
+	opts.preprocess = 1;
+
+	cache = keycache_new(cache_max, cache_dir, cache_lock);
+
+	/* a client that hangs up mid-reply must not take the daemon down */
+	signal(SIGPIPE, SIG_IGN);
+
+	if( http_port )
+	{
+		if( !g_file_test(root, G_FILE_TEST_IS_DIR) )
+			die("not a directory: %s\n", root);
+		segments = segcache_new(load_segment, seg_max, lookahead, jobs);
+
+		/* only ever on the loopback interface, there is no access control */
+		memset(&in_addr, 0, sizeof(in_addr));
+		in_addr.sin_family = AF_INET;
+		in_addr.sin_port = htons(http_port);
+		in_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		c = 1;
+		if( (fd = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+				setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &c, sizeof(c)) ||
+				bind(fd, (struct sockaddr*) &in_addr, sizeof(in_addr)) ||
+				listen(fd, 64) )
+			die("can't listen on port %d\n", http_port);
+	}
+	else
+	{
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		if( strlen(sock_file) >= sizeof(addr.sun_path) )
+			die("socket path too long: %s\n", sock_file);
+		strcpy(addr.sun_path, sock_file);
+
+		/* only our user may connect, anyone who can connect can decrypt */
+		unlink(sock_file);
+		mask = umask(077);
+		c = (fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+			bind(fd, (struct sockaddr*) &addr, sizeof(addr)) ||
+			listen(fd, 64);
+		umask(mask);
+		if( c )
+			die("can't listen on socket: %s\n", sock_file);
+	}
+
+	pool = g_thread_pool_new(serve, 0, jobs, 0, 0);
+	while( (c = accept(fd, 0, 0)) >= 0 || errno == EINTR )
+		if( c >= 0 )
+			g_thread_pool_push(pool, GINT_TO_POINTER(c + 1), 0); /* never null */
+
+	die("can't accept connections\n");
+
+	return 1;
+}
@@ -0,0 +1,2405 @@
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <pbc.h>
+#include <openssl/sha.h>
+
+#include "threshold.h"
+#include "decrypt.h"
+
+typedef struct
+{
+	GByteArray* b;
+	guint off;
+	int   bad;
+}
+reader_t;
+
+guint32
+read_uint32( reader_t* r )
+{
+	guint8* p;
+
+	if( r->bad || r->b->len - r->off < 4 )
+	{
+		r->bad = 1;
+		return 0;
+	}
+
+	p = r->b->data + r->off;
+	r->off += 4;
+
+	return p[0]<<24 | p[1]<<16 | p[2]<<8 | p[3];
+}
+
+/* e must already be initialized in the group it is read into */
+void
+read_element( reader_t* r, element_t e )
+{
+	guint32 len;
+
+	len = read_uint32(r);
+	if( r->bad || len != element_length_in_bytes(e) || r->b->len - r->off < len )
+	{
+		r->bad = 1;
+		return;
+	}
+
+	element_from_bytes(e, r->b->data + r->off);
+	r->off += len;
+}
+
+char*
+read_string( reader_t* r )
+{
+	guint8* end;
+	char* s;
+
+	if( r->bad || !(end = memchr(r->b->data + r->off, 0, r->b->len - r->off)) )
+	{
+		r->bad = 1;
+		return strdup("");
+	}
+
+	s = strdup((char*) r->b->data + r->off);
+	r->off = end - r->b->data + 1;
+
+	return s;
+}
+
+dec_pub_t*
+dec_pub_unserialize( GByteArray* b, int free_b )
+{
+	dec_pub_t* pub;
+	reader_t r;
+	char* desc;
+
+	r.b = b;
+	r.off = 0;
+	r.bad = 0;
+
+	pub = (dec_pub_t*) malloc(sizeof(dec_pub_t));
+	desc = read_string(&r);
+	if( r.bad || pairing_init_set_buf(pub->p, desc, strlen(desc)) )
+	{
+		free(desc);
+		free(pub);
+		if( free_b )
+			g_byte_array_free(b, 1);
+		return 0;
+	}
+	pub->desc = desc;
+
+	element_init_G1(pub->g,           pub->p);
+	element_init_G1(pub->h,           pub->p);
+	element_init_G2(pub->gp,          pub->p);
+	element_init_GT(pub->g_hat_alpha, pub->p);
+
+	read_element(&r, pub->g);
+	read_element(&r, pub->h);
+	read_element(&r, pub->gp);
+	read_element(&r, pub->g_hat_alpha);
+
+	if( free_b )
+		g_byte_array_free(b, 1);
+
+	if( r.bad )
+	{
+		dec_pub_free(pub);
+		return 0;
+	}
+
+	return pub;
+}
+
+#define PRV_INDEX_MAGIC "cpabe-indexed-prv"
+
+/* reads the length of an element of len bytes and skips it */
+void
+skip_element_len( reader_t* r, guint32 len )
+{
+	if( read_uint32(r) != len || r->bad || r->b->len - r->off < len )
+		r->bad = 1;
+	else
+		r->off += len;
+}
+
+/*
+	The index of an indexed key: the attribute of each component and
+	where its elements are. Each is checked to be in bounds so loading
+	it later can't fail.
+*/
+void
+read_prv_index( reader_t* r, dec_prv_t* prv, dec_pub_t* pub )
+{
+	dec_prv_comp_t c;
+	reader_t e;
+	element_t dp;
+	guint32 n;
+	guint32 i;
+
+	element_init_G1(dp, pub->p);
+	e.b = r->b;
+	e.bad = 0;
+
+	n = read_uint32(r);
+	for( i = 0; i < n && !r->bad; i++ )
+	{
+		c.attr = read_string(r);
+		c.off = e.off = read_uint32(r);
+		c.loaded = 0;
+		g_array_append_val(prv->comps, c);
+
+		skip_element_len(&e, element_length_in_bytes(prv->d));
+		skip_element_len(&e, element_length_in_bytes(dp));
+		if( e.bad )
+			r->bad = 1;
+	}
+
+	element_clear(dp);
+}
+
+dec_prv_t*
+dec_prv_unserialize( dec_pub_t* pub, GByteArray* b, int free_b )
+{
+	dec_prv_t* prv;
+	dec_prv_comp_t c;
+	dec_prv_comp_t* cp;
+	reader_t r;
+	GString* attrs;
+	guint32 n;
+	guint32 i;
+
+	r.b = b;
+	r.off = 0;
+	r.bad = 0;
+
+	prv = (dec_prv_t*) malloc(sizeof(dec_prv_t));
+	prv->pp = 0;
+	prv->p = pub->p;
+	prv->raw = 0;
+	prv->attrs = g_hash_table_new(g_str_hash, g_str_equal);
+	prv->comps = g_array_new(0, 1, sizeof(dec_prv_comp_t));
+	element_init_G2(prv->d, pub->p);
+
+	if( b->len > strlen(PRV_INDEX_MAGIC) &&
+			!memcmp(b->data, PRV_INDEX_MAGIC, strlen(PRV_INDEX_MAGIC) + 1) )
+	{
+		r.off = strlen(PRV_INDEX_MAGIC) + 1;
+		read_element(&r, prv->d);
+		read_prv_index(&r, prv, pub);
+
+		/* the components are loaded from it as they are needed */
+		if( free_b )
+			prv->raw = b;
+		else
+			prv->raw = g_byte_array_append(g_byte_array_sized_new(b->len), b->data, b->len);
+		free_b = 0;
+	}
+	else
+	{
+		read_element(&r, prv->d);
+		n = read_uint32(&r);
+		for( i = 0; i < n && !r.bad; i++ )
+		{
+			c.attr = read_string(&r);
+			c.loaded = 1;
+			element_init_G2(c.d,  pub->p);
+			element_init_G1(c.dp, pub->p);
+			read_element(&r, c.d);
+			read_element(&r, c.dp);
+			g_array_append_val(prv->comps, c);
+		}
+	}
+
+	attrs = g_string_new("");
+	for( i = 0; i < prv->comps->len; i++ )
+	{
+		cp = &g_array_index(prv->comps, dec_prv_comp_t, i);
+		g_string_append_len(attrs, cp->attr, strlen(cp->attr) + 1);
+		if( !g_hash_table_lookup_extended(prv->attrs, cp->attr, 0, 0) )
+			g_hash_table_insert(prv->attrs, cp->attr, GINT_TO_POINTER(i));
+	}
+	SHA256((unsigned char*) attrs->str, attrs->len, prv->id);
+	g_string_free(attrs, 1);
+
+	if( free_b )
+		g_byte_array_free(b, 1);
+
+	if( r.bad )
+	{
+		dec_prv_free(prv);
+		return 0;
+	}
+
+	return prv;
+}
+
+dec_prv_comp_t*
+dec_prv_comp( dec_prv_t* prv, int i )
+{
+	dec_prv_comp_t* c;
+	reader_t r;
+
+	c = &g_array_index(prv->comps, dec_prv_comp_t, i);
+	if( !c->loaded )
+	{
+		r.b = prv->raw;
+		r.off = c->off;
+		r.bad = 0;
+		element_init_G2(c->d,  prv->p);
+		element_init_G1(c->dp, prv->p);
+		read_element(&r, c->d);
+		read_element(&r, c->dp);
+		c->loaded = 1;
+	}
+
+	return c;
+}
+
+/* appends the leaves to leaves and everything but the elements to shape */
+dec_policy_t*
+read_policy( reader_t* r, dec_pub_t* pub, GPtrArray* leaves, GString* shape, int depth )
+{
+	dec_policy_t* p;
+	guint32 n;
+	guint32 i;
+
+	p = (dec_policy_t*) malloc(sizeof(dec_policy_t));
+	p->k = read_uint32(r);
+	p->attr = 0;
+	p->children = g_ptr_array_new();
+	p->satl = 0;
+
+	n = read_uint32(r);
+	if( !r->bad )
+		g_string_append_len(shape, (char*) r->b->data + r->off - 8, 8);
+	if( n == 0 )
+	{
+		p->attr = read_string(r);
+		element_init_G1(p->c,  pub->p);
+		element_init_G2(p->cp, pub->p);
+		read_element(r, p->c);
+		read_element(r, p->cp);
+		p->leafi = leaves->len;
+		g_ptr_array_add(leaves, p);
+		g_string_append_len(shape, p->attr, strlen(p->attr) + 1);
+	}
+	else if( depth >= DEC_MAX_DEPTH )
+		r->bad = 1;
+	else
+		for( i = 0; i < n && !r->bad; i++ )
+			g_ptr_array_add(p->children, read_policy(r, pub, leaves, shape, depth + 1));
+
+	if( n && (p->k < 1 || p->k > n) )
+		r->bad = 1;
+
+	return p;
+}
+
+void
+dec_policy_free( dec_policy_t* p )
+{
+	guint i;
+
+	if( p->attr )
+	{
+		free(p->attr);
+		element_clear(p->c);
+		element_clear(p->cp);
+	}
+
+	for( i = 0; i < p->children->len; i++ )
+		dec_policy_free(g_ptr_array_index(p->children, i));
+	g_ptr_array_free(p->children, 1);
+
+	if( p->satl )
+		g_array_free(p->satl, 1);
+
+	free(p);
+}
+
+dec_cph_t*
+dec_cph_unserialize( dec_pub_t* pub, GByteArray* b, int free_b )
+{
+	dec_cph_t* cph;
+	reader_t r;
+	GString* shape;
+
+	r.b = b;
+	r.off = 0;
+	r.bad = 0;
+
+	cph = (dec_cph_t*) malloc(sizeof(dec_cph_t));
+	element_init_GT(cph->cs, pub->p);
+	element_init_G1(cph->c,  pub->p);
+	read_element(&r, cph->cs);
+	read_element(&r, cph->c);
+	cph->leaves = g_ptr_array_new();
+	shape = g_string_new("");
+	cph->p = read_policy(&r, pub, cph->leaves, shape, 0);
+	SHA256((unsigned char*) shape->str, shape->len, cph->shape);
+	g_string_free(shape, 1);
+
+	if( free_b )
+		g_byte_array_free(b, 1);
+
+	if( r.bad )
+	{
+		dec_cph_free(cph);
+		return 0;
+	}
+
+	return cph;
+}
+
+typedef struct
+{
+	int k;
+	int n;    /* number of children, zero for a leaf */
+	int leaf; /* index in attrs if a leaf */
+	int kids; /* index in dec_summary_t.kids of the first child */
+}
+summary_node_t;
+
+struct dec_summary_s
+{
+	GArray*    nodes; /* summary_node_t's, each after its children */
+	GArray*    kids;  /* indices in nodes of the children of each gate */
+	GPtrArray* attrs; /* of the leaves, depth first */
+};
+
+void
+skip_element( reader_t* r )
+{
+	guint32 len;
+
+	len = read_uint32(r);
+	if( r->bad || r->b->len - r->off < len )
+		r->bad = 1;
+	else
+		r->off += len;
+}
+
+/* returns the index of the node read */
+int
+read_summary( reader_t* r, dec_summary_t* s, int depth )
+{
+	summary_node_t node;
+	int* kids;
+	guint32 i;
+
+	node.k = read_uint32(r);
+	node.n = read_uint32(r);
+	node.leaf = -1;
+	node.kids = s->kids->len;
+	if( r->bad )
+		return -1;
+
+	if( node.n == 0 )
+	{
+		node.leaf = s->attrs->len;
+		g_ptr_array_add(s->attrs, read_string(r));
+		skip_element(r);
+		skip_element(r);
+	}
+	else if( node.k < 1 || node.k > node.n || node.n > (r->b->len - r->off) / 8 ||
+					 depth >= DEC_MAX_DEPTH )
+		r->bad = 1;
+	else
+	{
+		kids = malloc(node.n * sizeof(int));
+		for( i = 0; i < node.n && !r->bad; i++ )
+			kids[i] = read_summary(r, s, depth + 1);
+		node.kids = s->kids->len;
+		g_array_append_vals(s->kids, kids, node.n);
+		free(kids);
+	}
+
+	g_array_append_val(s->nodes, node);
+
+	return s->nodes->len - 1;
+}
+
+dec_summary_t*
+dec_summary_read( GByteArray* b )
+{
+	dec_summary_t* s;
+	reader_t r;
+
+	r.b = b;
+	r.off = 0;
+	r.bad = 0;
+
+	s = (dec_summary_t*) malloc(sizeof(dec_summary_t));
+	s->nodes = g_array_new(0, 0, sizeof(summary_node_t));
+	s->kids = g_array_new(0, 0, sizeof(int));
+	s->attrs = g_ptr_array_new();
+
+	skip_element(&r); /* cs */
+	skip_element(&r); /* c */
+	read_summary(&r, s, 0);
+
+	if( r.bad )
+	{
+		dec_summary_free(s);
+		return 0;
+	}
+
+	return s;
+}
+
+int
+dec_summary_satisfied( dec_summary_t* s, dec_prv_t* prv )
+{
+	summary_node_t* node;
+	guint64* has;
+	int* stack;
+	int top;
+	int sat;
+	guint i;
+	int j;
+
+	/* which leaves the key has */
+	has = calloc(s->attrs->len / 64 + 1, sizeof(guint64));
+	for( i = 0; i < s->attrs->len; i++ )
+		if( g_hash_table_lookup_extended(prv->attrs, g_ptr_array_index(s->attrs, i), 0, 0) )
+			has[i / 64] |= (guint64) 1 << (i % 64);
+
+	/* children come before their parent, so a stack of results will do */
+	stack = malloc(s->nodes->len * sizeof(int));
+	top = 0;
+	for( i = 0; i < s->nodes->len; i++ )
+	{
+		node = &g_array_index(s->nodes, summary_node_t, i);
+		if( node->n == 0 )
+			sat = (has[node->leaf / 64] >> (node->leaf % 64)) & 1;
+		else
+		{
+			sat = 0;
+			for( j = 0; j < node->n; j++ )
+				sat += stack[--top];
+			sat = sat >= node->k;
+		}
+		stack[top++] = sat;
+	}
+	sat = stack[0];
+
+	free(stack);
+	free(has);
+
+	return sat;
+}
+
+#define KID(s, node, i) g_array_index((s)->kids, int, (node)->kids + (i))
+
+/*
+	Marks in used the key components of the leaves pick_sat_min_leaves()
+	would pick under node, given the fewest leaves under each node.
+*/
+void
+summary_pick( dec_summary_t* s, dec_prv_t* prv, int node, int* min_leaves, int* used )
+{
+	summary_node_t* p;
+	int* c;
+	int i;
+	int j;
+	int t;
+
+	p = &g_array_index(s->nodes, summary_node_t, node);
+	if( p->n == 0 )
+	{
+		used[GPOINTER_TO_INT(g_hash_table_lookup(prv->attrs,
+			g_ptr_array_index(s->attrs, p->leaf)))] = 1;
+		return;
+	}
+
+	/* satisfiable children by increasing leaf count, keeping their order on ties */
+	c = malloc(p->n * sizeof(int));
+	for( i = 0, j = 0; i < p->n; i++ )
+		if( min_leaves[KID(s, p, i)] )
+		{
+			for( t = j++; t > 0 && min_leaves[c[t - 1]] > min_leaves[KID(s, p, i)]; t-- )
+				c[t] = c[t - 1];
+			c[t] = KID(s, p, i);
+		}
+
+	for( i = 0; i < p->k; i++ )
+		summary_pick(s, prv, c[i], min_leaves, used);
+	free(c);
+}
+
+/* pairings dec_decrypt() would do with DEC_MERGE, or -1 if unsatisfied */
+int
+summary_cost( dec_summary_t* s, dec_prv_t* prv )
+{
+	summary_node_t* p;
+	int* min_leaves; /* zero if unsatisfied */
+	int* best;
+	int* used;
+	int cost;
+	guint i;
+	int j;
+	int t;
+	int u;
+	int l;
+
+	min_leaves = calloc(s->nodes->len, sizeof(int));
+	best = malloc((s->kids->len + 1) * sizeof(int));
+	for( i = 0; i < s->nodes->len; i++ )
+	{
+		p = &g_array_index(s->nodes, summary_node_t, i);
+		if( p->n == 0 )
+		{
+			min_leaves[i] = g_hash_table_lookup_extended(prv->attrs,
+				g_ptr_array_index(s->attrs, p->leaf), 0, 0);
+			continue;
+		}
+
+		/* the k smallest counts of satisfiable children */
+		for( j = 0, t = 0; j < p->n; j++ )
+			if( (l = min_leaves[KID(s, p, j)]) )
+			{
+				for( u = t++; u > 0 && best[u - 1] > l; u-- )
+					best[u] = best[u - 1];
+				best[u] = l;
+			}
+		if( t >= p->k )
+			for( j = 0; j < p->k; j++ )
+				min_leaves[i] += best[j];
+	}
+	free(best);
+
+	if( !min_leaves[s->nodes->len - 1] )
+	{
+		free(min_leaves);
+		return -1;
+	}
+
+	used = calloc(prv->comps->len, sizeof(int));
+	summary_pick(s, prv, s->nodes->len - 1, min_leaves, used);
+	for( i = 0, cost = 1; i < prv->comps->len; i++ )
+		cost += 2 * used[i];
+	free(used);
+	free(min_leaves);
+
+	return cost;
+}
+
+dec_prv_t*
+dec_summary_pick( dec_summary_t* s, GPtrArray* prvs, int* pairings )
+{
+	dec_prv_t* prv;
+	int cost;
+	int c;
+	guint i;
+
+	prv = 0;
+	cost = -1;
+	for( i = 0; i < prvs->len; i++ )
+		if( (c = summary_cost(s, g_ptr_array_index(prvs, i))) >= 0 &&
+				(cost < 0 || c < cost) )
+		{
+			prv = g_ptr_array_index(prvs, i);
+			cost = c;
+		}
+
+	if( pairings )
+		*pairings = cost;
+
+	return prv;
+}
+
+void
+dec_summary_free( dec_summary_t* s )
+{
+	guint i;
+
+	for( i = 0; i < s->attrs->len; i++ )
+		free(g_ptr_array_index(s->attrs, i));
+	g_ptr_array_free(s->attrs, 1);
+	g_array_free(s->kids, 1);
+	g_array_free(s->nodes, 1);
+	free(s);
+}
+
+void
+dec_pub_free( dec_pub_t* pub )
+{
+	element_clear(pub->g);
+	element_clear(pub->h);
+	element_clear(pub->gp);
+	element_clear(pub->g_hat_alpha);
+	pairing_clear(pub->p);
+	free(pub->desc);
+	free(pub);
+}
+
+typedef struct
+{
+	int ready;
+	int seen; /* paired once already, so preprocessed the next time */
+	pairing_pp_t d;
+	pairing_pp_t dp;
+}
+comp_pp_t;
+
+struct dec_prv_pp_s
+{
+	int d_ready;
+	int d_seen;
+	pairing_pp_t d;
+	comp_pp_t* comps;
+};
+
+void
+comp_pp_clear( comp_pp_t* c )
+{
+	if( c->ready )
+	{
+		pairing_pp_clear(c->d);
+		pairing_pp_clear(c->dp);
+	}
+}
+
+void
+dec_prv_free( dec_prv_t* prv )
+{
+	dec_prv_comp_t* c;
+	guint i;
+
+	if( prv->pp )
+	{
+		if( prv->pp->d_ready )
+			pairing_pp_clear(prv->pp->d);
+		for( i = 0; i < prv->comps->len; i++ )
+			comp_pp_clear(&prv->pp->comps[i]);
+		free(prv->pp->comps);
+		free(prv->pp);
+	}
+
+	element_clear(prv->d);
+	for( i = 0; i < prv->comps->len; i++ )
+	{
+		c = &g_array_index(prv->comps, dec_prv_comp_t, i);
+		free(c->attr);
+		if( c->loaded )
+		{
+			element_clear(c->d);
+			element_clear(c->dp);
+		}
+	}
+	if( prv->raw )
+		g_byte_array_free(prv->raw, 1);
+	g_hash_table_destroy(prv->attrs);
+	g_array_free(prv->comps, 1);
+	free(prv);
+}
+
+void
+dec_cph_free( dec_cph_t* cph )
+{
+	element_clear(cph->cs);
+	element_clear(cph->c);
+	dec_policy_free(cph->p);
+	g_ptr_array_free(cph->leaves, 1);
+	free(cph);
+}
+
+/* state of one dec_decrypt() */
+typedef struct
+{
+	dec_pub_t*  pub;
+	dec_prv_t*  prv;
+	dec_opts_t* opts;
+	dec_ops_t*  ops;
+	int         use_pp;
+}
+dec_ctx_t;
+
+struct dec_prv_pp_s*
+prv_pp( dec_prv_t* prv )
+{
+	if( !prv->pp )
+	{
+		prv->pp = malloc(sizeof(struct dec_prv_pp_s));
+		prv->pp->d_ready = 0;
+		prv->pp->d_seen = 0;
+		prv->pp->comps = calloc(prv->comps->len, sizeof(comp_pp_t));
+	}
+
+	return prv->pp;
+}
+
+/*
+	Key component i preprocessed, which it is the second time it is
+	paired, or zero if it is to be paired as it is this time.
+*/
+comp_pp_t*
+comp_pp( dec_ctx_t* ctx, int i )
+{
+	dec_prv_comp_t* c;
+	comp_pp_t* cpp;
+
+	if( !ctx->use_pp )
+		return 0;
+
+	cpp = &prv_pp(ctx->prv)->comps[i];
+	if( !cpp->ready && !cpp->seen++ )
+		return 0;
+	if( !cpp->ready )
+	{
+		c = dec_prv_comp(ctx->prv, i);
+		pairing_pp_init(cpp->d,  c->d,  ctx->pub->p);
+		pairing_pp_init(cpp->dp, c->dp, ctx->pub->p);
+		cpp->ready = 1;
+	}
+
+	return cpp;
+}
+
+/* e(z, d) / e(zp, dp) for key component i, in the pairing of ctx */
+void
+pair_comp( element_t t, dec_ctx_t* ctx, int i, element_t z, element_t zp )
+{
+	dec_prv_comp_t* c;
+	comp_pp_t* cpp;
+	element_t s;
+
+	c = dec_prv_comp(ctx->prv, i);
+	element_init_GT(s, ctx->pub->p);
+
+	if( (cpp = comp_pp(ctx, i)) )
+	{
+		pairing_pp_apply(t, z,  cpp->d);
+		pairing_pp_apply(s, zp, cpp->dp);
+	}
+	else
+	{
+		pairing_apply(t, z,  c->d,  ctx->pub->p);
+		pairing_apply(s, zp, c->dp, ctx->pub->p);
+	}
+
+	element_invert(s, s);
+	element_mul(t, t, s);
+	element_clear(s);
+}
+
+void
+check_sat( dec_policy_t* p, dec_prv_t* prv )
+{
+	gpointer attri;
+	guint i;
+	int l;
+
+	p->satisfiable = 0;
+	if( p->children->len == 0 )
+	{
+		if( g_hash_table_lookup_extended(prv->attrs, p->attr, 0, &attri) )
+		{
+			p->satisfiable = 1;
+			p->attri = GPOINTER_TO_INT(attri);
+		}
+	}
+	else
+	{
+		l = 0;
+		for( i = 0; i < p->children->len; i++ )
+		{
+			check_sat(g_ptr_array_index(p->children, i), prv);
+			if( ((dec_policy_t*) g_ptr_array_index(p->children, i))->satisfiable )
+				l++;
+		}
+
+		if( l >= p->k )
+			p->satisfiable = 1;
+	}
+}
+
+#define CHILD(p, i) ((dec_policy_t*) g_ptr_array_index((p)->children, (i)))
+
+void
+pick_sat_naive( dec_policy_t* p )
+{
+	guint i;
+	int k;
+
+	if( p->children->len == 0 )
+		return;
+
+	if( p->satl )
+		g_array_free(p->satl, 1);
+	p->satl = g_array_new(0, 0, sizeof(int));
+
+	for( i = 0; i < p->children->len && p->satl->len < p->k; i++ )
+		if( CHILD(p, i)->satisfiable )
+		{
+			pick_sat_naive(CHILD(p, i));
+			k = i + 1;
+			g_array_append_val(p->satl, k);
+		}
+}
+
+void
+pick_sat_min_leaves( dec_policy_t* p )
+{
+	guint i;
+	int* c;
+	int j;
+	int t;
+
+	if( p->children->len == 0 )
+	{
+		p->min_leaves = 1;
+		return;
+	}
+
+	/* satisfiable children by increasing leaf count, keeping their order on ties */
+	c = malloc(p->children->len * sizeof(int));
+	for( i = 0, j = 0; i < p->children->len; i++ )
+		if( CHILD(p, i)->satisfiable )
+		{
+			pick_sat_min_leaves(CHILD(p, i));
+			for( t = j++; t > 0 && CHILD(p, c[t - 1])->min_leaves > CHILD(p, i)->min_leaves; t-- )
+				c[t] = c[t - 1];
+			c[t] = i;
+		}
+
+	if( p->satl )
+		g_array_free(p->satl, 1);
+	p->satl = g_array_new(0, 0, sizeof(int));
+	p->min_leaves = 0;
+
+	for( i = 0; i < p->k; i++ )
+	{
+		p->min_leaves += CHILD(p, c[i])->min_leaves;
+		t = c[i] + 1;
+		g_array_append_val(p->satl, t);
+	}
+
+	free(c);
+}
+
+/*
+	Lagrange coefficients of the children in p->satl, from the cache if
+	there is one. Returns an array of p->satl->len elements of Zr which
+	the caller must pass to lagrange_free().
+*/
+element_t*
+lagrange( dec_ctx_t* ctx, dec_policy_t* p )
+{
+	element_t* r;
+	element_t t;
+	int* s;
+	guint i;
+	guint j;
+
+	s = (int*) p->satl->data;
+	if( ctx->opts->lagrange )
+		return threshold_lagrange(ctx->opts->lagrange, s, p->satl->len);
+
+	r = malloc(p->satl->len * sizeof(element_t));
+	element_init_Zr(t, ctx->pub->p);
+	for( i = 0; i < p->satl->len; i++ )
+	{
+		element_init_Zr(r[i], ctx->pub->p);
+		element_set1(r[i]);
+		for( j = 0; j < p->satl->len; j++ )
+		{
+			if( j == i )
+				continue;
+			element_set_si(t, - s[j]);
+			element_mul(r[i], r[i], t);
+			element_set_si(t, s[i] - s[j]);
+			element_invert(t, t);
+			element_mul(r[i], r[i], t);
+			ctx->ops->muls += 2;
+		}
+	}
+	element_clear(t);
+
+	return r;
+}
+
+void
+lagrange_free( dec_ctx_t* ctx, dec_policy_t* p, element_t* r )
+{
+	guint i;
+
+	if( ctx->opts->lagrange )
+		return;
+
+	for( i = 0; i < p->satl->len; i++ )
+		element_clear(r[i]);
+	free(r);
+}
+
+void
+dec_leaf_pair( element_t r, dec_ctx_t* ctx, dec_policy_t* p )
+{
+	pair_comp(r, ctx, p->attri, p->c, p->cp);
+	ctx->ops->pairings += 2;
+	ctx->ops->muls++;
+}
+
+void
+dec_node_naive( element_t r, dec_ctx_t* ctx, dec_policy_t* p )
+{
+	element_t* lambda;
+	element_t s;
+	guint i;
+
+	if( p->children->len == 0 )
+	{
+		dec_leaf_pair(r, ctx, p);
+		return;
+	}
+
+	lambda = lagrange(ctx, p);
+	element_init_GT(s, ctx->pub->p);
+	element_set1(r);
+	for( i = 0; i < p->satl->len; i++ )
+	{
+		dec_node_naive(s, ctx, CHILD(p, g_array_index(p->satl, int, i) - 1));
+		element_pow_zn(s, s, lambda[i]);
+		element_mul(r, r, s);
+		ctx->ops->exps++;
+		ctx->ops->muls++;
+	}
+	element_clear(s);
+	lagrange_free(ctx, p, lambda);
+}
+
+void
+dec_node_flatten( element_t r, element_t exp, dec_ctx_t* ctx, dec_policy_t* p )
+{
+	element_t* lambda;
+	element_t expnew;
+	element_t s;
+	guint i;
+
+	if( p->children->len == 0 )
+	{
+		element_init_GT(s, ctx->pub->p);
+		dec_leaf_pair(s, ctx, p);
+		element_pow_zn(s, s, exp);
+		element_mul(r, r, s);
+		element_clear(s);
+		ctx->ops->exps++;
+		ctx->ops->muls++;
+		return;
+	}
+
+	lambda = lagrange(ctx, p);
+	element_init_Zr(expnew, ctx->pub->p);
+	for( i = 0; i < p->satl->len; i++ )
+	{
+		element_mul(expnew, exp, lambda[i]);
+		ctx->ops->muls++;
+		dec_node_flatten(r, expnew, ctx, CHILD(p, g_array_index(p->satl, int, i) - 1));
+	}
+	element_clear(expnew);
+	lagrange_free(ctx, p, lambda);
+}
+
+typedef struct
+{
+	int leaf;      /* index in dec_cph_t.leaves */
+	int attri;     /* key component */
+	int one;       /* exp is one, so the leaf is used as it is */
+	element_t exp; /* Zr */
+}
+plan_step_t;
+
+typedef struct
+{
+	int satisfiable;
+	GArray* steps; /* plan_step_t's, grouped by attri */
+}
+dec_plan_t;
+
+struct dec_plancache_s
+{
+	GHashTable* plans;    /* plan key -> dec_plan_t */
+	GHashTable* matrices; /* policy shape -> lsss_t, for DEC_LSSS */
+	int         max_plans;
+	GMutex      lock;
+};
+
+/* shape of the policy, attributes of the key, no_opt_sat, strategy */
+#define PLAN_KEY_LEN 66
+
+guint
+plan_key_hash( gconstpointer k )
+{
+	guint a;
+	guint b;
+
+	memcpy(&a, k, sizeof(a));
+	memcpy(&b, (char*) k + 32, sizeof(b));
+
+	return a ^ b ^ ((guint8*) k)[64] ^ ((guint8*) k)[65] << 8;
+}
+
+gboolean
+plan_key_equal( gconstpointer a, gconstpointer b )
+{
+	return !memcmp(a, b, PLAN_KEY_LEN);
+}
+
+void
+plan_free( dec_plan_t* plan )
+{
+	guint i;
+
+	if( plan->steps )
+	{
+		for( i = 0; i < plan->steps->len; i++ )
+			element_clear(g_array_index(plan->steps, plan_step_t, i).exp);
+		g_array_free(plan->steps, 1);
+	}
+	free(plan);
+}
+
+/*
+	A policy as a linear secret sharing matrix, with a row for each leaf.
+	The gate of k children under a node whose share is v.(s, r1, ...)
+	adds k - 1 columns for the coefficients of its polynomial, and child
+	x gets v with x, x^2, ..., x^(k - 1) in them. The rows are sparse,
+	each nonzero only in the columns of the gates above its leaf.
+*/
+typedef struct
+{
+	int col;
+	element_t v; /* Zr */
+}
+lsss_entry_t;
+
+typedef struct
+{
+	int cols;
+	GPtrArray* rows; /* GArray's of lsss_entry_t by increasing col */
+}
+lsss_t;
+
+void
+lsss_free( lsss_t* m )
+{
+	GArray* row;
+	guint i;
+	guint j;
+
+	for( i = 0; i < m->rows->len; i++ )
+	{
+		row = g_ptr_array_index(m->rows, i);
+		for( j = 0; j < row->len; j++ )
+			element_clear(g_array_index(row, lsss_entry_t, j).v);
+		g_array_free(row, 1);
+	}
+	g_ptr_array_free(m->rows, 1);
+	free(m);
+}
+
+guint
+shape_hash( gconstpointer k )
+{
+	guint a;
+
+	memcpy(&a, k, sizeof(a));
+
+	return a;
+}
+
+gboolean
+shape_equal( gconstpointer a, gconstpointer b )
+{
+	return !memcmp(a, b, 32);
+}
+
+dec_plancache_t*
+dec_plancache_new( int max_plans )
+{
+	dec_plancache_t* c;
+
+	c = (dec_plancache_t*) malloc(sizeof(dec_plancache_t));
+	c->plans = g_hash_table_new_full(plan_key_hash, plan_key_equal,
+																	 free, (GDestroyNotify) plan_free);
+	c->matrices = g_hash_table_new_full(shape_hash, shape_equal,
+																			free, (GDestroyNotify) lsss_free);
+	c->max_plans = max_plans;
+	g_mutex_init(&c->lock);
+
+	return c;
+}
+
+void
+dec_plancache_free( dec_plancache_t* c )
+{
+	g_hash_table_destroy(c->plans);
+	g_hash_table_destroy(c->matrices);
+	g_mutex_clear(&c->lock);
+	free(c);
+}
+
+/* the exponent of each leaf used is the product of the coefficients above it */
+void
+plan_leaves( dec_ctx_t* ctx, dec_policy_t* p, element_t exp, GArray* steps )
+{
+	element_t* lambda;
+	element_t expnew;
+	plan_step_t st;
+	guint i;
+
+	if( p->children->len == 0 )
+	{
+		st.leaf = p->leafi;
+		st.attri = p->attri;
+		st.one = element_is1(exp);
+		element_init_Zr(st.exp, ctx->pub->p);
+		element_set(st.exp, exp);
+		g_array_append_val(steps, st);
+		return;
+	}
+
+	lambda = lagrange(ctx, p);
+	element_init_Zr(expnew, ctx->pub->p);
+	for( i = 0; i < p->satl->len; i++ )
+	{
+		element_mul(expnew, exp, lambda[i]);
+		ctx->ops->muls++;
+		plan_leaves(ctx, CHILD(p, g_array_index(p->satl, int, i) - 1), expnew, steps);
+	}
+	element_clear(expnew);
+	lagrange_free(ctx, p, lambda);
+}
+
+int
+cmp_step( const void* a, const void* b )
+{
+	const plan_step_t* x;
+	const plan_step_t* y;
+
+	x = a;
+	y = b;
+	if( x->attri != y->attri )
+		return x->attri - y->attri;
+
+	return x->leaf - y->leaf;
+}
+
+dec_plan_t*
+compile_plan( dec_ctx_t* ctx, dec_cph_t* cph )
+{
+	dec_plan_t* plan;
+	element_t one;
+
+	plan = (dec_plan_t*) malloc(sizeof(dec_plan_t));
+	plan->steps = 0;
+
+	check_sat(cph->p, ctx->prv);
+	if( !(plan->satisfiable = cph->p->satisfiable) )
+		return plan;
+
+	if( ctx->opts->no_opt_sat )
+		pick_sat_naive(cph->p);
+	else
+		pick_sat_min_leaves(cph->p);
+
+	plan->steps = g_array_new(0, 0, sizeof(plan_step_t));
+	element_init_Zr(one, ctx->pub->p);
+	element_set1(one);
+	plan_leaves(ctx, cph->p, one, plan->steps);
+	element_clear(one);
+	g_array_sort(plan->steps, cmp_step);
+
+	return plan;
+}
+
+void
+lsss_rows( lsss_t* m, dec_policy_t* p, GArray* v, pairing_ptr pairing )
+{
+	lsss_entry_t e;
+	GArray* row;
+	guint first;
+	guint i;
+	guint j;
+
+	if( p->children->len == 0 )
+	{
+		row = g_array_sized_new(0, 0, sizeof(lsss_entry_t), v->len);
+		for( j = 0; j < v->len; j++ )
+		{
+			e.col = g_array_index(v, lsss_entry_t, j).col;
+			element_init_Zr(e.v, pairing);
+			element_set(e.v, g_array_index(v, lsss_entry_t, j).v);
+			g_array_append_val(row, e);
+		}
+		g_ptr_array_index(m->rows, p->leafi) = row;
+		return;
+	}
+
+	first = m->cols;
+	m->cols += p->k - 1;
+	for( i = 0; i < p->children->len; i++ )
+	{
+		for( j = 1; j < p->k; j++ )
+		{
+			e.col = first + j - 1;
+			element_init_Zr(e.v, pairing);
+			if( j == 1 )
+				element_set_si(e.v, i + 1);
+			else
+				element_mul_si(e.v, g_array_index(v, lsss_entry_t, v->len - 1).v, i + 1);
+			g_array_append_val(v, e);
+		}
+		lsss_rows(m, CHILD(p, i), v, pairing);
+		for( j = 1; j < p->k; j++ )
+			element_clear(g_array_index(v, lsss_entry_t, v->len - j).v);
+		g_array_set_size(v, v->len - (p->k - 1));
+	}
+}
+
+lsss_t*
+lsss_compile( dec_cph_t* cph, pairing_ptr pairing )
+{
+	lsss_t* m;
+	GArray* v;
+	lsss_entry_t e;
+
+	m = (lsss_t*) malloc(sizeof(lsss_t));
+	m->cols = 1;
+	m->rows = g_ptr_array_sized_new(cph->leaves->len);
+	g_ptr_array_set_size(m->rows, cph->leaves->len);
+
+	/* column zero is the secret */
+	v = g_array_new(0, 0, sizeof(lsss_entry_t));
+	e.col = 0;
+	element_init_Zr(e.v, pairing);
+	element_set1(e.v);
+	g_array_append_val(v, e);
+	lsss_rows(m, cph->p, v, pairing);
+	element_clear(e.v);
+	g_array_free(v, 1);
+
+	return m;
+}
+
+/* the matrix of the policy of cph, compiled once per shape if there is a cache */
+lsss_t*
+lsss_get( dec_ctx_t* ctx, dec_cph_t* cph, int* cached )
+{
+	dec_plancache_t* c;
+	lsss_t* m;
+
+	*cached = 0;
+	m = 0;
+	if( (c = ctx->opts->plans) )
+	{
+		g_mutex_lock(&c->lock);
+		m = g_hash_table_lookup(c->matrices, cph->shape);
+		g_mutex_unlock(&c->lock);
+	}
+	if( m )
+	{
+		*cached = 1;
+		return m;
+	}
+
+	m = lsss_compile(cph, ctx->pub->p);
+	if( c )
+	{
+		g_mutex_lock(&c->lock);
+		if( g_hash_table_size(c->matrices) < c->max_plans &&
+				!g_hash_table_lookup(c->matrices, cph->shape) )
+		{
+			g_hash_table_insert(c->matrices, memcpy(malloc(32), cph->shape, 32), m);
+			*cached = 1;
+		}
+		g_mutex_unlock(&c->lock);
+	}
+
+	return m;
+}
+
+/*
+	Solves w M_S = (1, 0, ..., 0) for the rows M_S of the leaves given,
+	by Gaussian elimination on the transposed system over only the
+	columns those rows touch, skipping the zeros the sparse rows leave.
+	Only the leaves that end up as pivots get a nonzero w, the first
+	independent rows in the order given. Returns zero if there is no
+	solution.
+*/
+int
+lsss_solve( dec_ctx_t* ctx, lsss_t* m, GArray* leaves, element_t* w )
+{
+	element_t** a;
+	element_t* swap;
+	element_t t;
+	element_t u;
+	lsss_entry_t* e;
+	GArray* row;
+	int* col;
+	int ncols;
+	int n;
+	int i;
+	int j;
+	int r;
+	int pr;
+	int ok;
+	guint k;
+
+	/* dense index of each column used */
+	n = leaves->len;
+	col = malloc(m->cols * sizeof(int));
+	for( i = 0; i < m->cols; i++ )
+		col[i] = -1;
+	ncols = 0;
+	for( i = 0; i < n; i++ )
+	{
+		row = g_ptr_array_index(m->rows, g_array_index(leaves, dec_policy_t*, i)->leafi);
+		for( k = 0; k < row->len; k++ )
+			if( col[(e = &g_array_index(row, lsss_entry_t, k))->col] < 0 )
+				col[e->col] = ncols++;
+	}
+
+	/* a[c] is the equation of column c, with the right hand side last */
+	a = malloc(ncols * sizeof(element_t*));
+	for( j = 0; j < ncols; j++ )
+	{
+		a[j] = malloc((n + 1) * sizeof(element_t));
+		for( i = 0; i <= n; i++ )
+			element_init_Zr(a[j][i], ctx->pub->p);
+	}
+	for( i = 0; i < n; i++ )
+	{
+		row = g_ptr_array_index(m->rows, g_array_index(leaves, dec_policy_t*, i)->leafi);
+		for( k = 0; k < row->len; k++ )
+		{
+			e = &g_array_index(row, lsss_entry_t, k);
+			element_set(a[col[e->col]][i], e->v);
+		}
+	}
+	element_set1(a[col[0]][n]);
+
+	element_init_Zr(t, ctx->pub->p);
+	element_init_Zr(u, ctx->pub->p);
+	for( r = 0, i = 0; i < n && r < ncols; i++ )
+	{
+		for( pr = r; pr < ncols && element_is0(a[pr][i]); pr++ )
+			;
+		if( pr == ncols )
+			continue;
+		if( pr != r )
+		{
+			swap = a[pr];
+			a[pr] = a[r];
+			a[r] = swap;
+		}
+
+		element_invert(t, a[r][i]);
+		for( k = i; k <= n; k++ )
+			if( !element_is0(a[r][k]) )
+			{
+				element_mul(a[r][k], a[r][k], t);
+				ctx->ops->muls++;
+			}
+
+		for( j = 0; j < ncols; j++ )
+			if( j != r && !element_is0(a[j][i]) )
+			{
+				element_set(t, a[j][i]);
+				for( k = i; k <= n; k++ )
+					if( !element_is0(a[r][k]) )
+					{
+						element_mul(u, t, a[r][k]);
+						element_sub(a[j][k], a[j][k], u);
+						ctx->ops->muls++;
+					}
+			}
+		r++;
+	}
+
+	/* free unknowns are left at zero, and leftover rows must be 0 = 0 */
+	for( i = 0; i < n; i++ )
+		element_set0(w[i]);
+	ok = 1;
+	for( j = 0; j < ncols; j++ )
+	{
+		for( i = 0; i < n && element_is0(a[j][i]); i++ )
+			;
+		if( i < n )
+			element_set(w[i], a[j][n]);
+		else if( !element_is0(a[j][n]) )
+			ok = 0;
+	}
+
+	element_clear(t);
+	element_clear(u);
+	for( j = 0; j < ncols; j++ )
+	{
+		for( i = 0; i <= n; i++ )
+			element_clear(a[j][i]);
+		free(a[j]);
+	}
+	free(a);
+	free(col);
+
+	return ok;
+}
+
+/* by the number of columns their rows touch, so leaves under fewer gates come first */
+gint
+cmp_row_len( gconstpointer a, gconstpointer b, gpointer data )
+{
+	lsss_t* m;
+	guint la;
+	guint lb;
+
+	m = data;
+	la = ((GArray*) g_ptr_array_index(m->rows, (*(dec_policy_t**) a)->leafi))->len;
+	lb = ((GArray*) g_ptr_array_index(m->rows, (*(dec_policy_t**) b)->leafi))->len;
+
+	return la < lb ? -1 : la > lb ? 1 : 0;
+}
+
+/*
+	As compile_plan(), but with both the leaves to use and their
+	exponents found from the matrix: it is solved over the rows of every
+	leaf whose attribute the key has, and the leaves whose exponent comes
+	out zero are left out. The rows are taken shortest first, which for
+	nested thresholds favours the leaves closer to the root. No gate is
+	looked at to pick children, so no_opt_sat makes no difference.
+*/
+dec_plan_t*
+compile_lsss_plan( dec_ctx_t* ctx, dec_cph_t* cph )
+{
+	dec_plan_t* plan;
+	dec_policy_t* leaf;
+	lsss_t* m;
+	GArray* leaves;
+	element_t* w;
+	plan_step_t st;
+	int cached;
+	guint i;
+
+	plan = (dec_plan_t*) malloc(sizeof(dec_plan_t));
+	plan->steps = 0;
+
+	/* only to turn away keys that can't satisfy it before any algebra */
+	check_sat(cph->p, ctx->prv);
+	if( !(plan->satisfiable = cph->p->satisfiable) )
+		return plan;
+
+	leaves = g_array_new(0, 0, sizeof(dec_policy_t*));
+	for( i = 0; i < cph->leaves->len; i++ )
+		if( (leaf = g_ptr_array_index(cph->leaves, i))->satisfiable )
+			g_array_append_val(leaves, leaf);
+
+	w = malloc(leaves->len * sizeof(element_t));
+	for( i = 0; i < leaves->len; i++ )
+		element_init_Zr(w[i], ctx->pub->p);
+
+	m = lsss_get(ctx, cph, &cached);
+	g_array_sort_with_data(leaves, cmp_row_len, m);
+	if( (plan->satisfiable = lsss_solve(ctx, m, leaves, w)) )
+	{
+		plan->steps = g_array_new(0, 0, sizeof(plan_step_t));
+		for( i = 0; i < leaves->len; i++ )
+		{
+			if( element_is0(w[i]) )
+				continue;
+			st.leaf = g_array_index(leaves, dec_policy_t*, i)->leafi;
+			st.attri = g_array_index(leaves, dec_policy_t*, i)->attri;
+			st.one = element_is1(w[i]);
+			element_init_Zr(st.exp, ctx->pub->p);
+			element_set(st.exp, w[i]);
+			g_array_append_val(plan->steps, st);
+		}
+		g_array_sort(plan->steps, cmp_step);
+	}
+	if( !cached )
+		lsss_free(m);
+
+	for( i = 0; i < leaves->len; i++ )
+		element_clear(w[i]);
+	free(w);
+	g_array_free(leaves, 1);
+
+	return plan;
+}
+
+struct dec_pool_s
+{
+	GThreadPool* threads;
+	char* desc;
+	int size; /* threads, counting the calling one */
+};
+
+/* the pairing of a pool thread, and the key components it has preprocessed */
+typedef struct
+{
+	dec_pool_t* pool;
+	pairing_t p;
+	GHashTable* pps; /* SHA-256 of d and dp -> comp_pp_t */
+}
+pool_pairing_t;
+
+void
+pps_free( gpointer data )
+{
+	comp_pp_clear(data);
+	free(data);
+}
+
+void
+pool_pairing_free( gpointer data )
+{
+	pool_pairing_t* pp;
+
+	pp = data;
+	g_hash_table_destroy(pp->pps);
+	pairing_clear(pp->p);
+	free(pp);
+}
+
+guint
+sha256_hash( gconstpointer d )
+{
+	guint h;
+
+	memcpy(&h, d, sizeof(h));
+
+	return h;
+}
+
+gboolean
+sha256_equal( gconstpointer a, gconstpointer b )
+{
+	return !memcmp(a, b, SHA256_DIGEST_LENGTH);
+}
+
+GPrivate thread_pairing = G_PRIVATE_INIT(pool_pairing_free);
+
+typedef struct
+{
+	GMutex lock;
+	GCond  done;
+	int    left;
+}
+pair_batch_t;
+
+typedef struct
+{
+	unsigned char* in;  /* d, dp, z, zp for each of n components */
+	int n;
+	unsigned char* out; /* the product of e(z, d) / e(zp, dp) */
+	int use_pp;
+	pair_batch_t* batch;
+}
+pair_task_t;
+
+/*
+	As comp_pp(), for the component d, dp serialized at in, preprocessed
+	in this thread the second time this thread pairs it.
+*/
+comp_pp_t*
+thread_comp_pp( pool_pairing_t* pp, unsigned char* in, element_t d, element_t dp )
+{
+	comp_pp_t* cpp;
+	unsigned char digest[SHA256_DIGEST_LENGTH];
+
+	SHA256(in, element_length_in_bytes(d) + element_length_in_bytes(dp), digest);
+	if( !(cpp = g_hash_table_lookup(pp->pps, digest)) )
+	{
+		cpp = (comp_pp_t*) calloc(1, sizeof(comp_pp_t));
+		cpp->seen = 1;
+		g_hash_table_insert(pp->pps,
+			memcpy(malloc(SHA256_DIGEST_LENGTH), digest, SHA256_DIGEST_LENGTH), cpp);
+		return 0;
+	}
+	if( !cpp->ready )
+	{
+		pairing_pp_init(cpp->d,  d,  pp->p);
+		pairing_pp_init(cpp->dp, dp, pp->p);
+		cpp->ready = 1;
+	}
+
+	return cpp;
+}
+
+void
+pair_task( gpointer data, gpointer user_data )
+{
+	pair_task_t* task;
+	pool_pairing_t* pp;
+	comp_pp_t* cpp;
+	unsigned char* b;
+	unsigned char* comp;
+	element_t* d; /* d and dp of each component left to the multi-pairing */
+	element_t* z; /* z and zp^-1 of each */
+	element_t t;
+	element_t s;
+	int m;
+	int i;
+
+	task = data;
+	pp = g_private_get(&thread_pairing);
+	if( !pp || pp->pool != user_data )
+	{
+		pp = (pool_pairing_t*) malloc(sizeof(pool_pairing_t));
+		pp->pool = user_data;
+		pairing_init_set_buf(pp->p, pp->pool->desc, strlen(pp->pool->desc));
+		pp->pps = g_hash_table_new_full(sha256_hash, sha256_equal, free, pps_free);
+		g_private_replace(&thread_pairing, pp);
+	}
+
+	element_init_GT(t, pp->p);
+	element_init_GT(s, pp->p);
+	element_set1(t);
+
+	/* components preprocessed here pair on their own, the rest go in one product */
+	d = malloc(2 * task->n * sizeof(element_t));
+	z = malloc(2 * task->n * sizeof(element_t));
+	b = task->in;
+	m = 0;
+	for( i = 0; i < task->n; i++ )
+	{
+		comp = b;
+		element_init_G2(d[m],     pp->p);
+		element_init_G1(d[m + 1], pp->p);
+		element_init_G1(z[m],     pp->p);
+		element_init_G2(z[m + 1], pp->p);
+		b += element_from_bytes(d[m],     b);
+		b += element_from_bytes(d[m + 1], b);
+		b += element_from_bytes(z[m],     b);
+		b += element_from_bytes(z[m + 1], b);
+
+		if( task->use_pp && (cpp = thread_comp_pp(pp, comp, d[m], d[m + 1])) )
+		{
+			pairing_pp_apply(s, z[m], cpp->d);
+			element_mul(t, t, s);
+			pairing_pp_apply(s, z[m + 1], cpp->dp);
+			element_invert(s, s);
+			element_mul(t, t, s);
+			element_clear(d[m]);
+			element_clear(d[m + 1]);
+			element_clear(z[m]);
+			element_clear(z[m + 1]);
+		}
+		else
+		{
+			/* e(zp, dp)^-1 = e(zp^-1, dp) */
+			element_invert(z[m + 1], z[m + 1]);
+			m += 2;
+		}
+	}
+
+	if( m )
+	{
+		element_prod_pairing(s, z, d, m);
+		element_mul(t, t, s);
+	}
+	element_to_bytes(task->out, t);
+	element_clear(t);
+	element_clear(s);
+
+	for( i = 0; i < m; i++ )
+	{
+		element_clear(d[i]);
+		element_clear(z[i]);
+	}
+	free(d);
+	free(z);
+
+	g_mutex_lock(&task->batch->lock);
+	if( !--task->batch->left )
+		g_cond_signal(&task->batch->done);
+	g_mutex_unlock(&task->batch->lock);
+}
+
+dec_pool_t*
+dec_pool_new( dec_pub_t* pub, int threads )
+{
+	dec_pool_t* pool;
+
+	pool = (dec_pool_t*) malloc(sizeof(dec_pool_t));
+	pool->desc = strdup(pub->desc);
+	pool->size = threads > 1 ? threads : 1;
+	pool->threads = threads > 1 ?
+		g_thread_pool_new(pair_task, pool, threads - 1, 1, 0) : 0;
+
+	return pool;
+}
+
+void
+dec_pool_free( dec_pool_t* pool )
+{
+	if( pool->threads )
+		g_thread_pool_free(pool->threads, 0, 1);
+	free(pool->desc);
+	free(pool);
+}
+
+/* hand the product for n key components to the pool, as an element of GT like t */
+pair_task_t*
+push_pairs( dec_pool_t* pool, pair_batch_t* batch, dec_ctx_t* ctx, int* attri,
+						element_t* z, element_t* zp, int n, element_t t )
+{
+	pair_task_t* task;
+	dec_prv_comp_t* c;
+	unsigned char* b;
+	int len;
+	int i;
+
+	len = 0;
+	for( i = 0; i < n; i++ )
+	{
+		c = dec_prv_comp(ctx->prv, attri[i]);
+		len += element_length_in_bytes(c->d) + element_length_in_bytes(c->dp) +
+			element_length_in_bytes(z[i]) + element_length_in_bytes(zp[i]);
+	}
+
+	task = (pair_task_t*) malloc(sizeof(pair_task_t));
+	task->in = malloc(len);
+	task->n = n;
+	task->out = malloc(element_length_in_bytes(t));
+	task->use_pp = ctx->use_pp;
+	task->batch = batch;
+
+	b = task->in;
+	for( i = 0; i < n; i++ )
+	{
+		c = dec_prv_comp(ctx->prv, attri[i]);
+		b += element_to_bytes(b, c->d);
+		b += element_to_bytes(b, c->dp);
+		b += element_to_bytes(b, z[i]);
+		b += element_to_bytes(b, zp[i]);
+	}
+
+	g_mutex_lock(&batch->lock);
+	batch->left++;
+	g_mutex_unlock(&batch->lock);
+	g_thread_pool_push(pool->threads, task, 0);
+
+	return task;
+}
+
+/* as comp_pp(), for D */
+int
+d_pp( dec_ctx_t* ctx )
+{
+	if( !ctx->use_pp )
+		return 0;
+
+	if( !prv_pp(ctx->prv)->d_ready && !ctx->prv->pp->d_seen++ )
+		return 0;
+	if( !ctx->prv->pp->d_ready )
+	{
+		pairing_pp_init(ctx->prv->pp->d, ctx->prv->d, ctx->pub->p);
+		ctx->prv->pp->d_ready = 1;
+	}
+
+	return 1;
+}
+
+/* 1 / e(c, D), in the pairing of ctx */
+void
+pair_d( element_t t, dec_ctx_t* ctx, element_t c )
+{
+	if( d_pp(ctx) )
+		pairing_pp_apply(t, c, ctx->prv->pp->d);
+	else
+		pairing_apply(t, c, ctx->prv->d, ctx->pub->p);
+	element_invert(t, t);
+}
+
+/*
+	The product of e(z, d) / e(zp, dp) for n key components, times
+	1 / e(C, D), in the calling thread. Those already preprocessed are
+	paired on their own, and the rest all in one multi-pairing, sharing
+	a single final exponentiation.
+*/
+void
+pair_local( element_t t, dec_ctx_t* ctx, dec_cph_t* cph, int* attri,
+						element_t* z, element_t* zp, int n )
+{
+	dec_prv_comp_t* c;
+	element_t* in1;
+	element_t* in2;
+	element_t s;
+	int m;
+	int i;
+
+	element_init_GT(s, ctx->pub->p);
+	element_set1(t);
+
+	in1 = malloc((2 * n + 1) * sizeof(element_t));
+	in2 = malloc((2 * n + 1) * sizeof(element_t));
+	m = 0;
+	for( i = 0; i < n; i++ )
+		if( comp_pp(ctx, attri[i]) )
+		{
+			pair_comp(s, ctx, attri[i], z[i], zp[i]);
+			element_mul(t, t, s);
+			ctx->ops->muls++;
+		}
+		else
+		{
+			c = dec_prv_comp(ctx->prv, attri[i]);
+			element_init_same_as(in1[m],     z[i]);
+			element_init_same_as(in1[m + 1], zp[i]);
+			element_init_same_as(in2[m],     c->d);
+			element_init_same_as(in2[m + 1], c->dp);
+			element_set(in1[m], z[i]);
+			element_invert(in1[m + 1], zp[i]);
+			element_set(in2[m], c->d);
+			element_set(in2[m + 1], c->dp);
+			m += 2;
+		}
+
+	if( d_pp(ctx) )
+	{
+		pair_d(s, ctx, cph->c);
+		element_mul(t, t, s);
+		ctx->ops->muls++;
+	}
+	else
+	{
+		element_init_same_as(in1[m], cph->c);
+		element_init_same_as(in2[m], ctx->prv->d);
+		element_invert(in1[m], cph->c);
+		element_set(in2[m], ctx->prv->d);
+		m++;
+	}
+
+	if( m )
+	{
+		element_prod_pairing(s, in1, in2, m);
+		element_mul(t, t, s);
+	}
+	element_clear(s);
+
+	for( i = 0; i < m; i++ )
+	{
+		element_clear(in1[i]);
+		element_clear(in2[i]);
+	}
+	free(in1);
+	free(in2);
+}
+
+/* r = the product of b[i]^e[i], three at a time by multi-exponentiation */
+void
+multi_pow( element_t r, element_ptr* b, element_ptr* e, int n, dec_ctx_t* ctx )
+{
+	element_t s;
+	int i;
+
+	element_init_same_as(s, r);
+	for( i = 0; i < n; i += 3 )
+	{
+		if( n - i >= 3 )
+			element_pow3_zn(s, b[i], e[i], b[i + 1], e[i + 1], b[i + 2], e[i + 2]);
+		else if( n - i == 2 )
+			element_pow2_zn(s, b[i], e[i], b[i + 1], e[i + 1]);
+		else
+			element_pow_zn(s, b[i], e[i]);
+		ctx->ops->exps++;
+
+		if( i == 0 )
+			element_set(r, s);
+		else
+		{
+			element_mul(r, r, s);
+			ctx->ops->muls++;
+		}
+	}
+	element_clear(s);
+}
+
+/* z = the product of c^exp and zp of cp^exp over the n leaves of an attribute */
+void
+raise_leaves( element_t z, element_t zp, dec_ctx_t* ctx, dec_cph_t* cph,
+							plan_step_t* st, int n )
+{
+	dec_policy_t* leaf;
+	element_ptr* c;
+	element_ptr* cp;
+	element_ptr* e;
+	int m;
+	int i;
+
+	c  = malloc(n * sizeof(element_ptr));
+	cp = malloc(n * sizeof(element_ptr));
+	e  = malloc(n * sizeof(element_ptr));
+
+	/* leaves with exponent one are multiplied in afterwards */
+	m = 0;
+	for( i = 0; i < n; i++ )
+		if( !st[i].one )
+		{
+			leaf = g_ptr_array_index(cph->leaves, st[i].leaf);
+			c[m] = leaf->c;
+			cp[m] = leaf->cp;
+			e[m++] = st[i].exp;
+		}
+
+	if( m )
+	{
+		multi_pow(z,  c,  e, m, ctx);
+		multi_pow(zp, cp, e, m, ctx);
+	}
+
+	for( i = 0; i < n; i++ )
+		if( st[i].one )
+		{
+			leaf = g_ptr_array_index(cph->leaves, st[i].leaf);
+			if( !m++ )
+			{
+				element_set(z, leaf->c);
+				element_set(zp, leaf->cp);
+			}
+			else
+			{
+				element_mul(z, z, leaf->c);
+				element_mul(zp, zp, leaf->cp);
+				ctx->ops->muls += 2;
+			}
+		}
+
+	free(c);
+	free(cp);
+	free(e);
+}
+
+/*
+	r = A / e(C, D). The leaves of each attribute are raised to their
+	exponents and multiplied together, so each attribute is paired once.
+	The attributes are split between the threads of the pool, if any,
+	with the calling thread taking the last share and e(C, D). Each share
+	is one multi-pairing of the components its thread has not
+	preprocessed, and a pairing of its own for each one it has.
+*/
+void
+run_plan( element_t r, dec_ctx_t* ctx, dec_cph_t* cph, dec_plan_t* plan )
+{
+	plan_step_t* st;
+	dec_pool_t* pool;
+	pair_batch_t batch;
+	pair_task_t* task;
+	GPtrArray* tasks;
+	element_t* z;  /* G1 */
+	element_t* zp; /* G2 */
+	element_t t;
+	int* attri;
+	int* first;
+	int groups;
+	int share; /* attributes per task */
+	int local; /* the first attribute paired by this thread */
+	int i;
+	int g;
+
+	/* the steps are sorted by attribute, so each attribute is a run of them */
+	attri = malloc((plan->steps->len + 1) * sizeof(int));
+	first = malloc((plan->steps->len + 1) * sizeof(int));
+	groups = 0;
+	for( i = 0; i < plan->steps->len; i++ )
+	{
+		st = &g_array_index(plan->steps, plan_step_t, i);
+		if( i == 0 || st[-1].attri != st->attri )
+		{
+			attri[groups] = st->attri;
+			first[groups++] = i;
+		}
+	}
+	first[groups] = plan->steps->len;
+
+	z  = malloc(groups * sizeof(element_t));
+	zp = malloc(groups * sizeof(element_t));
+	for( g = 0; g < groups; g++ )
+	{
+		element_init_G1(z[g],  ctx->pub->p);
+		element_init_G2(zp[g], ctx->pub->p);
+		raise_leaves(z[g], zp[g], ctx, cph,
+								 &g_array_index(plan->steps, plan_step_t, first[g]),
+								 first[g + 1] - first[g]);
+	}
+	ctx->ops->pairings += 2 * groups + 1;
+
+	pool = ctx->opts->pool && ctx->opts->pool->threads ? ctx->opts->pool : 0;
+	share = !pool ? 1 : (groups + pool->size) / pool->size;
+	local = !pool ? 0 : MAX(groups - (share - 1), 0);
+
+	element_init_GT(t, ctx->pub->p);
+	tasks = g_ptr_array_new();
+	if( pool )
+	{
+		g_mutex_init(&batch.lock);
+		g_cond_init(&batch.done);
+		batch.left = 0;
+		for( g = 0; g < local; g += share )
+			g_ptr_array_add(tasks, push_pairs(pool, &batch, ctx, attri + g,
+																				z + g, zp + g, MIN(share, local - g), t));
+	}
+
+	pair_local(r, ctx, cph, attri + local, z + local, zp + local, groups - local);
+
+	if( pool )
+	{
+		g_mutex_lock(&batch.lock);
+		while( batch.left )
+			g_cond_wait(&batch.done, &batch.lock);
+		g_mutex_unlock(&batch.lock);
+		g_mutex_clear(&batch.lock);
+		g_cond_clear(&batch.done);
+	}
+
+	for( i = 0; i < tasks->len; i++ )
+	{
+		task = g_ptr_array_index(tasks, i);
+		element_from_bytes(t, task->out);
+		element_mul(r, r, t);
+		free(task->in);
+		free(task->out);
+		free(task);
+	}
+	ctx->ops->muls += tasks->len;
+	g_ptr_array_free(tasks, 1);
+
+	for( g = 0; g < groups; g++ )
+	{
+		element_clear(z[g]);
+		element_clear(zp[g]);
+	}
+	free(z);
+	free(zp);
+	free(attri);
+	free(first);
+	element_clear(t);
+}
+
+/*
+	r = A / e(C, D) with DEC_MERGE or DEC_LSSS, from a cached plan if
+	there is one.
+	Returns zero if prv does not satisfy the policy.
+*/
+int
+dec_merge( element_t r, dec_ctx_t* ctx, dec_cph_t* cph )
+{
+	dec_plancache_t* c;
+	dec_plan_t* plan;
+	unsigned char key[PLAN_KEY_LEN];
+	int cached;
+	int ok;
+
+	c = ctx->opts->plans;
+	plan = 0;
+	if( c )
+	{
+		memcpy(key, cph->shape, 32);
+		memcpy(key + 32, ctx->prv->id, 32);
+		key[64] = ctx->opts->no_opt_sat;
+		key[65] = ctx->opts->strategy;
+
+		g_mutex_lock(&c->lock);
+		plan = g_hash_table_lookup(c->plans, key);
+		g_mutex_unlock(&c->lock);
+	}
+
+	if( !(cached = plan != 0) )
+	{
+		plan = ctx->opts->strategy == DEC_LSSS ?
+			compile_lsss_plan(ctx, cph) : compile_plan(ctx, cph);
+		if( c )
+		{
+			g_mutex_lock(&c->lock);
+			if( g_hash_table_size(c->plans) < c->max_plans &&
+					!g_hash_table_lookup(c->plans, key) )
+			{
+				g_hash_table_insert(c->plans, memcpy(malloc(PLAN_KEY_LEN), key, PLAN_KEY_LEN), plan);
+				cached = 1;
+			}
+			g_mutex_unlock(&c->lock);
+		}
+	}
+
+	if( (ok = plan->satisfiable) )
+		run_plan(r, ctx, cph, plan);
+
+	if( !cached )
+		plan_free(plan);
+
+	return ok;
+}
+
+int
+dec_transform( dec_pub_t* pub, dec_prv_t* prv, dec_cph_t* cph,
+							 element_t w, dec_opts_t* opts, dec_ops_t* ops )
+{
+	dec_opts_t default_opts;
+	dec_ops_t ignored;
+	dec_ctx_t ctx;
+	element_t t;
+
+	if( !opts )
+	{
+		default_opts.strategy = DEC_MERGE;
+		default_opts.no_opt_sat = 0;
+		default_opts.lagrange = 0;
+		default_opts.plans = 0;
+		default_opts.pool = 0;
+		default_opts.preprocess = 0;
+		opts = &default_opts;
+	}
+
+	ctx.pub = pub;
+	ctx.prv = prv;
+	ctx.opts = opts;
+	ctx.ops = ops ? ops : &ignored;
+	ctx.use_pp = opts->preprocess && pairing_is_symmetric(pub->p);
+
+	element_init_GT(w, pub->p);
+	if( opts->strategy == DEC_MERGE || opts->strategy == DEC_LSSS )
+	{
+		if( !dec_merge(w, &ctx, cph) )
+		{
+			element_clear(w);
+			return 0;
+		}
+		return 1;
+	}
+
+	check_sat(cph->p, prv);
+	if( !cph->p->satisfiable )
+	{
+		element_clear(w);
+		return 0;
+	}
+
+	if( opts->no_opt_sat )
+		pick_sat_naive(cph->p);
+	else
+		pick_sat_min_leaves(cph->p);
+
+	if( opts->strategy == DEC_NAIVE )
+		dec_node_naive(w, &ctx, cph->p);
+	else
+	{
+		element_t one;
+
+		element_init_Zr(one, pub->p);
+		element_set1(one);
+		element_set1(w);
+		dec_node_flatten(w, one, &ctx, cph->p);
+		element_clear(one);
+	}
+
+	/* w = A / e(C, D) */
+	element_init_GT(t, pub->p);
+	pair_d(t, &ctx, cph->c);
+	element_mul(w, w, t);
+	element_clear(t);
+	ctx.ops->pairings++;
+	ctx.ops->muls++;
+
+	return 1;
+}
+
+int
+dec_decrypt( dec_pub_t* pub, dec_prv_t* prv, dec_cph_t* cph,
+						 element_t m, dec_opts_t* opts, dec_ops_t* ops )
+{
+	if( !dec_transform(pub, prv, cph, m, opts, ops) )
+		return 0;
+
+	/* m = cs * A / e(C, D) */
+	element_mul(m, cph->cs, m);
+	if( ops )
+		ops->muls++;
+
+	return 1;
+}
+
+void
+write_uint32( GByteArray* b, guint32 k )
+{
+	guint8 x[4];
+
+	x[0] = k >> 24;
+	x[1] = k >> 16;
+	x[2] = k >> 8;
+	x[3] = k;
+	g_byte_array_append(b, x, 4);
+}
+
+void
+write_element( GByteArray* b, element_t e )
+{
+	guint32 len;
+	guint off;
+
+	len = element_length_in_bytes(e);
+	write_uint32(b, len);
+	off = b->len;
+	g_byte_array_set_size(b, off + len);
+	element_to_bytes(b->data + off, e);
+}
+
+void
+write_string( GByteArray* b, char* s )
+{
+	g_byte_array_append(b, (guint8*) s, strlen(s) + 1);
+}
+
+GByteArray*
+dec_prv_serialize( dec_prv_t* prv, int indexed )
+{
+	dec_prv_comp_t* c;
+	GByteArray* b;
+	guint index;
+	guint off;
+	guint i;
+
+	b = g_byte_array_new();
+	if( indexed )
+		write_string(b, PRV_INDEX_MAGIC);
+	write_element(b, prv->d);
+	write_uint32(b, prv->comps->len);
+
+	if( !indexed )
+	{
+		for( i = 0; i < prv->comps->len; i++ )
+		{
+			c = dec_prv_comp(prv, i);
+			write_string(b, c->attr);
+			write_element(b, c->d);
+			write_element(b, c->dp);
+		}
+
+		return b;
+	}
+
+	/* the index, with the offsets filled in as the components are written */
+	index = b->len;
+	for( i = 0; i < prv->comps->len; i++ )
+	{
+		write_string(b, g_array_index(prv->comps, dec_prv_comp_t, i).attr);
+		write_uint32(b, 0);
+	}
+
+	for( i = 0; i < prv->comps->len; i++ )
+	{
+		c = dec_prv_comp(prv, i);
+		index += strlen(c->attr) + 1;
+		off = b->len;
+		b->data[index++] = (off & 0xff000000)>>24;
+		b->data[index++] = (off & 0xff0000)>>16;
+		b->data[index++] = (off & 0xff00)>>8;
+		b->data[index++] = (off & 0xff)>>0;
+		write_element(b, c->d);
+		write_element(b, c->dp);
+	}
+
+	return b;
+}
+
+void
+dec_prv_blind( dec_pub_t* pub, dec_prv_t* prv, element_t z )
+{
+	dec_prv_comp_t* c;
+	element_t zi;
+	guint i;
+
+	element_init_Zr(z, pub->p);
+	element_init_Zr(zi, pub->p);
+	do
+		element_random(z);
+	while( element_is0(z) );
+	element_invert(zi, z);
+
+	element_pow_zn(prv->d, prv->d, zi);
+	for( i = 0; i < prv->comps->len; i++ )
+	{
+		c = dec_prv_comp(prv, i);
+		element_pow_zn(c->d,  c->d,  zi);
+		element_pow_zn(c->dp, c->dp, zi);
+	}
+	element_clear(zi);
+}
+
+#define TRANSFORMED_MAGIC "cpabe-transformed"
+
+GByteArray*
+dec_transformed_serialize( dec_cph_t* cph, element_t w )
+{
+	GByteArray* b;
+
+	b = g_byte_array_new();
+	write_string(b, TRANSFORMED_MAGIC);
+	write_element(b, cph->cs);
+	write_element(b, w);
+
+	return b;
+}
+
+GByteArray*
+dec_retained_serialize( element_t z )
+{
+	GByteArray* b;
+
+	b = g_byte_array_new();
+	write_element(b, z);
+
+	return b;
+}
+
+int
+dec_retained_unserialize( dec_pub_t* pub, GByteArray* b, element_t z )
+{
+	reader_t r;
+
+	r.b = b;
+	r.off = 0;
+	r.bad = 0;
+
+	element_init_Zr(z, pub->p);
+	read_element(&r, z);
+	g_byte_array_free(b, 1);
+
+	if( r.bad )
+		element_clear(z);
+
+	return !r.bad;
+}
+
+int
+dec_finish( dec_pub_t* pub, GByteArray* b, element_t z, element_t m )
+{
+	reader_t r;
+	element_t w;
+	char* magic;
+
+	r.b = b;
+	r.off = 0;
+	r.bad = 0;
+
+	magic = read_string(&r);
+	if( strcmp(magic, TRANSFORMED_MAGIC) )
+		r.bad = 1;
+	free(magic);
+
+	element_init_GT(m, pub->p);
+	element_init_GT(w, pub->p);
+	read_element(&r, m);
+	read_element(&r, w);
+
+	/* m = cs * w^z */
+	element_pow_zn(w, w, z);
+	element_mul(m, m, w);
+	element_clear(w);
+
+	if( r.bad )
+		element_clear(m);
+
+	return !r.bad;
+}
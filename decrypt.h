@@ -0,0 +1,238 @@
+/*
+	Include glib.h, pbc.h and threshold.h before including this file.
+
+	Decryption of bswabe ciphertexts inside cpabe-dec, reading the keys
+	and ciphertexts in the format libbswabe serializes them to, so that
+	how a policy is satisfied and evaluated can be chosen per call and
+	its cost counted. This is the code libbswabe runs in bswabe_dec(),
+	with the alternatives it keeps commented out made selectable:
+
+	  DEC_NAIVE    evaluate the tree bottom up, two pairings and one
+	               exponentiation in GT per leaf and gate input
+	  DEC_FLATTEN  push the Lagrange coefficients down to the leaves, so
+	               each leaf costs two pairings and one exponentiation
+	  DEC_MERGE    push them down into G1 and G2 and merge leaves that
+	               share an attribute, so each attribute used costs two
+	               pairings however often it occurs
+	  DEC_LSSS     as DEC_MERGE, but with the leaves to use and their
+	               exponents found by solving the policy compiled to a
+	               linear secret sharing matrix, kept per policy shape,
+	               over the rows of all the leaves the key has
+
+	Other than with DEC_LSSS, children are picked to satisfy each gate
+	with the fewest leaves, unless no_opt_sat is set, in which case the
+	first satisfiable ones are taken, as libbswabe's pick_sat_naive()
+	does.
+
+	With DEC_MERGE and DEC_LSSS, which leaves to use and the exponent each is raised
+	to depend only on the shape of the policy and the attributes of the
+	key, so they are compiled into a plan which may be kept in a plan
+	cache and run again for every ciphertext of the same shape. The
+	leaves of an attribute are raised to their exponents three at a time
+	by multi-exponentiation, and the pairings, e(C, D) included, are
+	computed as one multi-pairing with a single final exponentiation, or
+	one per thread if a pool of threads is given to spread them over.
+
+	The components of a key are always the same argument of their
+	pairings, so with preprocess set each is preprocessed the second
+	time it is paired and the result kept with the key (and with each
+	pool thread), making every later pairing with it cheaper, though
+	each then pays its own final exponentiation. Components not (yet)
+	preprocessed still go in the one multi-pairing, so a key used only
+	once costs no more than without preprocess. It needs a symmetric
+	pairing, as the type A curves cpabe-setup makes are; otherwise it
+	is ignored. cpabe-decd, cpabe-verify, and cpabe-dec and
+	cpabe-transform given more than one file set it; a single file is
+	decrypted with the multi-pairing alone.
+*/
+
+typedef struct
+{
+	char* desc;            /* parameters of p */
+	pairing_t p;
+	element_t g;           /* G1 */
+	element_t h;           /* G1 */
+	element_t gp;          /* G2 */
+	element_t g_hat_alpha; /* GT */
+}
+dec_pub_t;
+
+typedef struct
+{
+	char* attr;
+	element_t d;  /* G2 */
+	element_t dp; /* G1 */
+	int loaded;   /* d and dp are initialized, see dec_prv_comp() */
+	guint off;    /* of d in dec_prv_t.raw */
+}
+dec_prv_comp_t;
+
+typedef struct
+{
+	element_t d;   /* G2 */
+	GArray* comps; /* dec_prv_comp_t's */
+	pairing_ptr p;
+	GByteArray* raw;      /* an indexed key the comps are loaded from, or null */
+	unsigned char id[32]; /* SHA-256 of the attributes, in order */
+	GHashTable* attrs;    /* attribute -> index in comps */
+	struct dec_prv_pp_s* pp; /* preprocessed pairings, made as needed */
+}
+dec_prv_t;
+
+typedef struct dec_policy_s
+{
+	int k;               /* one if leaf, otherwise threshold */
+	char* attr;          /* attribute string if leaf, otherwise null */
+	element_t c;         /* G1, only for leaves */
+	element_t cp;        /* G2, only for leaves */
+	GPtrArray* children; /* dec_policy_t's, len == 0 for leaves */
+	int leafi;           /* index in dec_cph_t.leaves if leaf */
+
+	/* filled in by each dec_decrypt() */
+	int satisfiable;
+	int min_leaves;
+	int attri;           /* index of the key component for a leaf */
+	GArray* satl;        /* one-based indices of the children used */
+}
+dec_policy_t;
+
+typedef struct
+{
+	element_t cs; /* GT */
+	element_t c;  /* G1 */
+	dec_policy_t* p;
+	GPtrArray* leaves;       /* the leaves of p, depth first */
+	unsigned char shape[32]; /* SHA-256 of p without its elements */
+}
+dec_cph_t;
+
+typedef enum
+{
+	DEC_NAIVE,
+	DEC_FLATTEN,
+	DEC_MERGE,
+	DEC_LSSS
+}
+dec_strategy_t;
+
+typedef struct dec_plancache_s dec_plancache_t;
+typedef struct dec_pool_s dec_pool_t;
+
+typedef struct
+{
+	dec_strategy_t strategy;
+	int no_opt_sat;
+	threshold_cache_t* lagrange; /* may be null to compute them each time */
+	dec_plancache_t* plans;      /* may be null to plan each time */
+	dec_pool_t* pool;            /* may be null to pair in the calling thread */
+	int preprocess;
+}
+dec_opts_t;
+
+typedef struct
+{
+	int pairings;
+	int exps;
+	int muls;
+}
+dec_ops_t;
+
+/*
+	All return zero if b is malformed, and free b if free is nonzero. A
+	policy with gates nested deeper than DEC_MAX_DEPTH counts as
+	malformed, as it does for dec_summary_read().
+*/
+#define DEC_MAX_DEPTH 256
+
+dec_pub_t* dec_pub_unserialize( GByteArray* b, int free );
+dec_prv_t* dec_prv_unserialize( dec_pub_t* pub, GByteArray* b, int free );
+dec_cph_t* dec_cph_unserialize( dec_pub_t* pub, GByteArray* b, int free );
+
+/*
+	Private keys may also be in an indexed form, written by
+	dec_prv_serialize() with indexed set, which lists the attribute of
+	each component and where to find it before any of the components.
+	Only the index is read by dec_prv_unserialize(), and each component
+	is unserialized by dec_prv_comp() the first time it is used, so a
+	key with hundreds of components (as numerical attributes make) costs
+	little more to load than the few a policy uses.
+*/
+dec_prv_comp_t* dec_prv_comp( dec_prv_t* prv, int i );
+GByteArray*     dec_prv_serialize( dec_prv_t* prv, int indexed );
+
+void dec_pub_free( dec_pub_t* pub );
+void dec_prv_free( dec_prv_t* prv );
+void dec_cph_free( dec_cph_t* cph );
+
+/*
+	The shape and leaf attributes of the policy of a serialized cph,
+	read without unserializing any of its elements, so that a key which
+	can't satisfy it may be turned away without any group operations.
+*/
+typedef struct dec_summary_s dec_summary_t;
+
+/* returns zero if b is malformed */
+dec_summary_t* dec_summary_read( GByteArray* b );
+int            dec_summary_satisfied( dec_summary_t* s, dec_prv_t* prv );
+
+/*
+	Of the dec_prv_t's in prvs, the one that satisfies s with the fewest
+	pairings under DEC_MERGE, the first on ties, or zero if none does.
+	The pairings it would take are left in *pairings unless it is null.
+*/
+dec_prv_t*     dec_summary_pick( dec_summary_t* s, GPtrArray* prvs, int* pairings );
+void           dec_summary_free( dec_summary_t* s );
+
+/*
+	A cache of up to max_plans plans by (policy shape, key attributes,
+	no_opt_sat), and for DEC_LSSS of up to max_plans matrices by policy
+	shape. Once it is full further plans are used once and dropped. It
+	may be shared between threads, but only by those decrypting with the
+	same dec_pub_t: the plans hold elements of its pairing, so the cache
+	must also be freed before it is.
+*/
+dec_plancache_t* dec_plancache_new( int max_plans );
+void             dec_plancache_free( dec_plancache_t* c );
+
+/*
+	A pool of threads, each with its own pairing initialized like that
+	of pub, for the pairings of DEC_MERGE. The calling thread does one
+	of them itself, so threads - 1 are started. It may be shared by
+	several dec_decrypt() calls at once.
+*/
+dec_pool_t* dec_pool_new( dec_pub_t* pub, int threads );
+void        dec_pool_free( dec_pool_t* pool );
+
+/*
+	Outsourced decryption, after Green, Hohenberger and Waters. The key
+	blinded by dec_prv_blind() is a transformation key, with every
+	element raised to 1 / z for a random z which the user keeps. Anyone
+	holding it can run dec_transform() on a ciphertext to get
+	w = e(g, g)^(-alpha s / z), but only the holder of z can finish with
+	dec_finish(), which costs one exponentiation: m = cs * w^z.
+*/
+void        dec_prv_blind( dec_pub_t* pub, dec_prv_t* prv, element_t z );
+
+GByteArray* dec_retained_serialize( element_t z );
+int         dec_retained_unserialize( dec_pub_t* pub, GByteArray* b, element_t z );
+
+/* cs and w, in the form dec_finish() reads */
+GByteArray* dec_transformed_serialize( dec_cph_t* cph, element_t w );
+
+/* returns zero if b is malformed, otherwise m is initialized */
+int         dec_finish( dec_pub_t* pub, GByteArray* b, element_t z, element_t m );
+
+/* dec_decrypt() without multiplying by cs, which with prv blinded is w */
+int dec_transform( dec_pub_t* pub, dec_prv_t* prv, dec_cph_t* cph,
+									 element_t w, dec_opts_t* opts, dec_ops_t* ops );
+
+/*
+	Recover the session element of cph into m, which is initialized on
+	success. Returns zero if prv does not satisfy the policy. opts may be
+	null for DEC_MERGE with the fewest leaves, and the operations done
+	are added to ops unless it is null. A cph may be decrypted any number
+	of times but by one thread at a time, and the same goes for prv when
+	preprocessing or indexed and for opts->lagrange.
+*/
+int dec_decrypt( dec_pub_t* pub, dec_prv_t* prv, dec_cph_t* cph,
+								 element_t m, dec_opts_t* opts, dec_ops_t* ops );
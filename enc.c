@@ -1,5 +1,6 @@
 #include <string.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include <glib.h>
 #include <pbc.h>
 #include <pbc_random.h>
@@ -8,15 +9,39 @@
 #include "common.h"
 #include "policy_lang.h"
 #include "mpd_policy.h"
+#include "batch.h"
+#include "journal.h"
+#include "spool.h"
+#include "watch.h"
+#include "cmaf.h"
 
 char* usage =
 "Usage: cpabe-enc [OPTION ...] PUB_KEY FILE [POLICY]\n"
+"  or:  cpabe-enc -c SPOOL -x XML_FILE [-x XML_FILE ...]\n"
+"  or:  cpabe-enc [OPTION ...] -w SPOOL PUB_KEY\n"
+"  or:  cpabe-enc [OPTION ...] -W XML_FILE PUB_KEY\n"
+"  or:  cpabe-enc [OPTION ...] -S PUB_KEY POLICY\n"
 "\n"
 "Encrypt FILE under the decryption policy POLICY using public key\n"
 "PUB_KEY. The encrypted file will be written to FILE.cpabe unless\n"
 "the -o option is used. The original file will be removed. If POLICY\n"
 "is not specified, the policy will be read from stdin.\n"
 "\n"
+"The second form queues the files of the xml files as items in the\n"
+"directory SPOOL, which may be on storage shared between hosts. The\n"
+"third form starts a worker that claims items from SPOOL and encrypts\n"
+"them until none are left. Any number of workers may share a spool.\n"
+"Claims left by a worker that died are returned to the queue when a\n"
+"worker starts: at once if it ran on the same host, else after a day.\n"
+"\n"
+"The fourth form follows a live xml file, encrypting each segment of a\n"
+"Representation as soon as it is written to the file or directory\n"
+"named by the Representation's BaseURL. It runs until killed.\n"
+"\n"
+"The fifth form reads fragmented MP4 from stdin, as written by a live\n"
+"encoder, and writes each chunk to stdout (or the -o file) as soon as\n"
+"its mdat has been read and encrypted.\n"
+"\n"
 "Mandatory arguments to long options are mandatory for short options too.\n\n"
 " -h, --help               print this message\n\n"
 " -v, --version            print version information\n\n"
@@ -25,6 +50,16 @@ char* usage =
 " -d, --deterministic      use deterministic \"random\" numbers\n"
 " -x, --xml-file           get the policy attributes from a xml file"
 "                          (only for debugging)\n\n"
+" -j, --jobs N             encrypt up to N files of the xml file at once\n\n"
+" -m, --max-memory SIZE    hold back files of the xml file while their\n"
+"                          buffers would push memory use above SIZE\n"
+"                          bytes (K, M and G suffixes are accepted)\n\n"
+" -r, --resume             skip the files of the xml file that an earlier\n"
+"                          run recorded as done in XML_FILE.journal\n\n"
+" -c, --coordinator SPOOL  queue the files of the xml files in SPOOL\n\n"
+" -w, --worker SPOOL       encrypt the files queued in SPOOL\n\n"
+" -W, --watch XML_FILE     encrypt new segments of XML_FILE as they land\n\n"
+" -S, --stream             encrypt a CMAF stream chunk by chunk\n\n"
 "";
 
 char* pub_file = 0;
@@ -39,6 +74,81 @@ int policies_counter = 0;
 char** files_names = 0;
 int files_counter = 0;
 
+int    jobs       = 1;
+size_t max_memory = 0;
+char*  xml_file   = 0;
+int    resume     = 0;
+char*  coordinator = 0;
+char*  worker      = 0;
+char*  live_xml    = 0;
+int    stream      = 0;
+
+journal_t* journal = 0;
+
+typedef struct
+{
+	int   i;
+	char* file;
+	char* policy; /* already in postfix form */
+	char* key;    /* journal key, if journaling */
+	char* claim;  /* spool claim, if a worker */
+	int   warm;   /* use and replenish a key from warm_keys */
+}
+enc_job_t;
+
+typedef struct
+{
+	GByteArray* cph_buf;
+	element_t m;
+}
+session_t;
+
+bswabe_pub_t* pub;
+
+/* bswabe shares the pairing and random state of pub between threads */
+GMutex crypto_lock;
+
+/*
+	In watch mode, one key per policy is encapsulated ahead of time so
+	that bswabe_enc() is off the path between a segment landing and its
+	encrypted copy being written. Guarded by crypto_lock.
+*/
+GHashTable* warm_keys = 0;
+
+void
+add_xml( char* file )
+{
+	char** p;
+	char** f;
+	int np;
+	int nf;
+	int n;
+	int i;
+
+	if( !xml_file )
+		xml_file = file;
+
+	if( parse_xml(file, &p, &np, &f, &nf) )
+		die("can't parse xml file: %s\n", file);
+
+	/* keep files and policies paired up across several xml files */
+	n = np < nf ? np : nf;
+	policies    = realloc(policies,    (policies_counter + n) * sizeof(char*));
+	files_names = realloc(files_names, (files_counter    + n) * sizeof(char*));
+	for( i = 0; i < n; i++ )
+	{
+		policies[policies_counter++] = p[i];
+		files_names[files_counter++] = f[i];
+	}
+
+	for( ; i < np; i++ )
+		free(p[i]);
+	for( i = n; i < nf; i++ )
+		free(f[i]);
+	free(p);
+	free(f);
+}
+
 void
 parse_args( int argc, char** argv )
 {
@@ -75,8 +185,49 @@ parse_args( int argc, char** argv )
             if( ++i >= argc )
 				die(usage);
 			else
-                parse_xml(argv[i], &policies, &policies_counter, &files_names, &files_counter);
+                add_xml(argv[i]);
         }
+		else if( !strcmp(argv[i], "-j") || !strcmp(argv[i], "--jobs") )
+		{
+			if( ++i >= argc || (jobs = atoi(argv[i])) < 1 )
+				die(usage);
+		}
+		else if( !strcmp(argv[i], "-c") || !strcmp(argv[i], "--coordinator") )
+		{
+			if( ++i >= argc )
+				die(usage);
+			else
+				coordinator = argv[i];
+		}
+		else if( !strcmp(argv[i], "-w") || !strcmp(argv[i], "--worker") )
+		{
+			if( ++i >= argc )
+				die(usage);
+			else
+				worker = argv[i];
+		}
+		else if( !strcmp(argv[i], "-W") || !strcmp(argv[i], "--watch") )
+		{
+			if( ++i >= argc )
+				die(usage);
+			else
+				live_xml = argv[i];
+		}
+		else if( !strcmp(argv[i], "-S") || !strcmp(argv[i], "--stream") )
+		{
+			stream = 1;
+		}
+		else if( !strcmp(argv[i], "-r") || !strcmp(argv[i], "--resume") )
+		{
+			resume = 1;
+		}
+		else if( !strcmp(argv[i], "-m") || !strcmp(argv[i], "--max-memory") )
+		{
+			if( ++i >= argc )
+				die(usage);
+			else
+				max_memory = parse_size(argv[i]);
+		}
 		else if( !pub_file )
 		{
 			pub_file = argv[i];
@@ -92,9 +243,32 @@ parse_args( int argc, char** argv )
 		else
 			die(usage);
 
-	if( !pub_file || (!in_file && (!policies && !files_names))) {
-        die(usage);
-    }
+	if( coordinator )
+	{
+		if( !xml_file || pub_file || worker )
+			die(usage);
+		return;
+	}
+
+	if( stream )
+	{
+		/* stdin carries the media, so the policy must be given */
+		if( !pub_file || !in_file || policy || xml_file || worker || live_xml )
+			die(usage);
+		policy = parse_policy_lang(in_file);
+		in_file = 0;
+		return;
+	}
+
+	if( worker || live_xml )
+	{
+		if( !pub_file || in_file || xml_file || (worker && live_xml) )
+			die(usage);
+		return;
+	}
+
+	if( !pub_file || (!in_file && !xml_file) )
+		die(usage);
 
 	if( !out_file && !files_names)
 		out_file = g_strdup_printf("%s.cpabe", in_file);
@@ -104,55 +278,306 @@ parse_args( int argc, char** argv )
     
 }
 
+/*
+	Peak bytes held while encrypting a file of the given size: the
+	plaintext, its padded copy while aes_128_cbc_encrypt() grows it,
+	and the ciphertext. A file that can't be stat'ed costs nothing here;
+	enc_file() reports it when it fails to read it.
+*/
+size_t
+enc_cost( char* file )
+{
+	struct stat st;
+
+	if( stat(file, &st) )
+		return 0;
+
+	return 3 * ((size_t) st.st_size + 16);
+}
+
+/* call with crypto_lock held */
+session_t*
+session_new( char* policy )
+{
+	session_t* k;
+	bswabe_cph_t* cph;
+
+	k = (session_t*) malloc(sizeof(session_t));
+	if( !(cph = bswabe_enc(pub, k->m, policy)) )
+		die("%s", bswabe_error());
+	k->cph_buf = bswabe_cph_serialize(cph);
+	bswabe_cph_free(cph);
+
+	return k;
+}
+
+void
+session_free( gpointer data )
+{
+	session_t* k;
+
+	k = data;
+	g_byte_array_free(k->cph_buf, 1);
+	element_clear(k->m);
+	free(k);
+}
+
+void
+enc_job_free( enc_job_t* job )
+{
+	free(job->file);
+	free(job->policy);
+	free(job->key);
+	free(job->claim);
+	free(job);
+}
+
+int
+enc_file( gpointer data, gpointer user_data )
+{
+	enc_job_t* job;
+	session_t* k;
+	int file_len;
+	GByteArray* plt;
+	GByteArray* aes_buf;
+	unsigned char raw[16];
+	unsigned char tag[CPABE_TAG_LEN];
+	char* out;
+	char* err;
+
+	job = data;
+	printf("[%d] Trying to encrypt file %s.\n", job->i, job->file);
+
+	/* a file that can't be read fails on its own, the batch goes on */
+	if( (err = load_file(job->file, &plt)) )
+	{
+		fprintf(stderr, "[%d] %s: %s\n", job->i, err, job->file);
+		enc_job_free(job);
+		return 0;
+	}
+
+	g_mutex_lock(&crypto_lock);
+	if( job->warm && (k = g_hash_table_lookup(warm_keys, job->policy)) )
+		g_hash_table_steal(warm_keys, job->policy);
+	else
+		k = session_new(job->policy);
+	g_mutex_unlock(&crypto_lock);
+
+	file_len = plt->len;
+	aes_buf = aes_128_cbc_encrypt(plt, k->m);
+	g_byte_array_free(plt, 1);
+
+	session_key_bytes(k->m, raw);
+	cpabe_tag(raw, file_len, aes_buf, tag);
+	memset(raw, 0, sizeof(raw));
+
+	/* neither journaled nor done, so a later run or worker tries it again */
+	out = g_strdup_printf("%s%s", job->file, SUFFIX);
+	if( (err = save_cpabe_file(out, k->cph_buf, file_len, aes_buf, tag)) )
+		fprintf(stderr, "[%d] %s: %s\n", job->i, err, out);
+	else
+	{
+		if( job->key )
+			journal_record(journal, job->key);
+		if( job->claim )
+			spool_done(worker, job->claim);
+		printf("[%d] The encypted file is: %s.\n", job->i, out);
+	}
+
+	session_free(k);
+	g_byte_array_free(aes_buf, 1);
+
+	/* the next segment of this Representation finds a key ready */
+	if( job->warm )
+	{
+		g_mutex_lock(&crypto_lock);
+		if( !g_hash_table_lookup(warm_keys, job->policy) )
+			g_hash_table_insert(warm_keys, strdup(job->policy), session_new(job->policy));
+		g_mutex_unlock(&crypto_lock);
+	}
+
+	free(out);
+	enc_job_free(job);
+
+	return !err;
+}
+
+void
+enc_stream( FILE* out )
+{
+	session_t* k;
+	GByteArray* chunk;
+	GByteArray* aes_buf;
+	unsigned char raw[16];
+	unsigned char tag[CPABE_TAG_LEN];
+	guint32 seq;
+
+	k = session_new(policy);
+	free(policy);
+	session_key_bytes(k->m, raw);
+
+	cmaf_write_header(out, k->cph_buf);
+	fflush(out);
+
+	for( seq = 1; (chunk = cmaf_read_chunk(stdin)); seq++ )
+	{
+		aes_buf = aes_128_cbc_encrypt_seq(chunk, k->m, seq);
+		g_byte_array_free(chunk, 1);
+
+		cpabe_record_tag(raw, seq, 0, aes_buf, tag);
+		cmaf_write_record(out, aes_buf, tag);
+		g_byte_array_free(aes_buf, 1);
+		if( fflush(out) )
+			die("can't write stream output\n");
+	}
+
+	/* only reached when the input ends cleanly */
+	aes_buf = g_byte_array_new();
+	cpabe_record_tag(raw, seq, 1, aes_buf, tag);
+	cmaf_write_record(out, aes_buf, tag);
+	g_byte_array_free(aes_buf, 1);
+
+	memset(raw, 0, sizeof(raw));
+	session_free(k);
+}
+
+void
+enc_segment( char* file, char* policy, gpointer user_data )
+{
+	static int i = 0;
+	enc_job_t* job;
+
+	job = (enc_job_t*) malloc(sizeof(enc_job_t));
+	job->i = i++;
+	job->file = strdup(file);
+	job->policy = strdup(policy);
+	job->key = 0;
+	job->claim = 0;
+	job->warm = 1;
+
+	batch_push(user_data, job, enc_cost(file));
+}
+
 int
 main( int argc, char** argv )
 {
-	bswabe_pub_t* pub;
 	bswabe_cph_t* cph;
 	int file_len;
 	GByteArray* plt;
 	GByteArray* cph_buf;
 	GByteArray* aes_buf;
 	element_t m;
+	unsigned char raw[16];
+	unsigned char tag[CPABE_TAG_LEN];
+	int failed = 0;
 
 	parse_args(argc, argv);
-    suck_file(pub_file);
+
+	if( coordinator )
+	{
+		int i;
+
+		spool_init(coordinator);
+		for( i = 0; i < files_counter; i++ )
+		{
+			spool_put(coordinator, files_names[i], policies[i]);
+			free(files_names[i]);
+			free(policies[i]);
+		}
+		printf("Queued %d files in %s.\n", files_counter, coordinator);
+
+		return 0;
+	}
+
 	pub = bswabe_pub_unserialize(suck_file(pub_file), 1);
 
-    if (policies && files_names) {
-        int files_to_encrypt, i, file_name_len;
+	if( stream )
+	{
+		FILE* out;
+
+		out = out_file ? fopen_write_or_die(out_file) : stdout;
+		enc_stream(out);
+		if( fclose(out) )
+			die("can't write stream output\n");
+	}
+	else if( live_xml )
+	{
+		setvbuf(stdout, 0, _IOLBF, 0);
+		warm_keys = g_hash_table_new_full(g_str_hash, g_str_equal, free, session_free);
+		watch_mpd(live_xml, enc_segment, batch_new(jobs, max_memory, enc_file, 0));
+	}
+	else if( worker )
+	{
+		batch_t* b;
+		enc_job_t* job;
+		GHashTable* templates;
+		char* raw;
+		int i;
+
+		/* pick up what workers that died left half done */
+		if( (i = spool_recover(worker, SPOOL_STALE_AGE)) )
+			fprintf(stderr, "returned %d stale claims to %s\n", i, worker);
+
+		/* claim only as fast as the pool admits, leaving the rest to others */
+		templates = policy_template_cache_new();
+		b = batch_new(jobs, max_memory, enc_file, 0);
+		for( i = 0; ; i++ )
+		{
+			job = (enc_job_t*) malloc(sizeof(enc_job_t));
+			if( !(job->claim = spool_claim(worker, &job->file, &raw)) )
+			{
+				free(job);
+				break;
+			}
+			job->i = i;
+			job->key = 0;
+			job->warm = 0;
+			job->policy = parse_policy_lang_cached(templates, raw);
+			free(raw);
+
+			batch_push(b, job, enc_cost(job->file));
+		}
+		failed = batch_finish(b);
+		g_hash_table_destroy(templates);
+	}
+	else if (xml_file) {
+        int files_to_encrypt, i;
+        batch_t* b;
+        enc_job_t* job;
+        GHashTable* templates;
+        char* name;
+
+        name = g_strdup_printf("%s.journal", xml_file);
+        journal = journal_open(name, resume);
+        free(name);
+
+        b = batch_new(jobs, max_memory, enc_file, 0);
+        templates = policy_template_cache_new();
 
         files_to_encrypt = (policies_counter < files_counter) ? policies_counter : files_counter;
         for (i = 0; i < files_to_encrypt; i++) {
-            printf ("[%d] Trying to encrypt file %s.\n", i, files_names[i]);
-            policy = parse_policy_lang(policies[i]);
-            if( !(cph = bswabe_enc(pub, m, policy)) )
-		        die("%s", bswabe_error());
-            free(policy);
-
-	        cph_buf = bswabe_cph_serialize(cph);
-	        bswabe_cph_free(cph);
-
-            plt = suck_file(files_names[i]);
-            file_len = plt->len;
-            aes_buf = aes_128_cbc_encrypt(plt, m);
-            g_byte_array_free(plt, 1);
-            element_clear(m);
-            
-            file_name_len = strlen(files_names[i]) + 1;
-            out_file = malloc(file_name_len * sizeof(char));
-            assert(out_file);
-            memcpy(out_file, files_names[i], file_name_len);
-            strcat(out_file, SUFFIX);
-
-            write_cpabe_file(out_file, cph_buf, file_len, aes_buf);
-            printf("[%d] The encypted file is: %s.\n", i, out_file);
-
-	        g_byte_array_free(cph_buf, 1);
-	        g_byte_array_free(aes_buf, 1);
-
-            free(out_file);
+            job = (enc_job_t*) malloc(sizeof(enc_job_t));
+            job->i = i;
+            job->file = strdup(files_names[i]);
+            job->key = journal_key(files_names[i], policies[i]);
+            job->claim = 0;
+            job->warm = 0;
+
+            /* outputs are renamed into place before they are journaled */
+            if (journal_done(journal, job->key)) {
+                printf("[%d] Skipping file %s, already encrypted.\n", i, job->file);
+                free(job->file);
+                free(job->key);
+                free(job);
+                continue;
+            }
+
+            job->policy = parse_policy_lang_cached(templates, policies[i]);
+            batch_push(b, job, enc_cost(job->file));
         }
+        failed = batch_finish(b);
+        g_hash_table_destroy(templates);
+        journal_close(journal);
         
         /* Clean memory */
         for (i = 0; i < policies_counter; i++)
@@ -174,9 +599,12 @@ main( int argc, char** argv )
 	    file_len = plt->len;
 	    aes_buf = aes_128_cbc_encrypt(plt, m);
 	    g_byte_array_free(plt, 1);
+	    session_key_bytes(m, raw);
+	    cpabe_tag(raw, file_len, aes_buf, tag);
+	    memset(raw, 0, sizeof(raw));
 	    element_clear(m);
 
-	    write_cpabe_file(out_file, cph_buf, file_len, aes_buf);
+	    write_cpabe_file(out_file, cph_buf, file_len, aes_buf, tag);
         
 	    g_byte_array_free(cph_buf, 1);
 	    g_byte_array_free(aes_buf, 1);
@@ -185,5 +613,5 @@ main( int argc, char** argv )
 		    unlink(in_file);
     }
     
-	return 0;
+	return failed ? 1 : 0;
 }
@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+#include <pbc.h>
+#include <openssl/sha.h>
+
+#include "common.h"
+#include "journal.h"
+
+struct journal_s
+{
+	FILE* f;
+	GHashTable* done;
+	GMutex lock;
+};
+
+journal_t*
+journal_open( char* file, int resume )
+{
+	journal_t* j;
+	FILE* f;
+	char line[4096];
+	int len;
+
+	j = (journal_t*) malloc(sizeof(journal_t));
+	j->done = g_hash_table_new_full(g_str_hash, g_str_equal, free, 0);
+	g_mutex_init(&j->lock);
+
+	if( resume && (f = fopen(file, "r")) )
+	{
+		/* a torn last line (no newline) was never acknowledged */
+		while( fgets(line, sizeof(line), f) )
+			if( (len = strlen(line)) > 1 && line[len - 1] == '\n' )
+			{
+				line[len - 1] = 0;
+				g_hash_table_insert(j->done, strdup(line), (gpointer) 1);
+			}
+		fclose(f);
+	}
+
+	if( !(j->f = fopen(file, resume ? "a" : "w")) )
+		die("can't write file: %s\n", file);
+
+	return j;
+}
+
+void
+journal_close( journal_t* j )
+{
+	fclose(j->f);
+	g_hash_table_destroy(j->done);
+	g_mutex_clear(&j->lock);
+	free(j);
+}
+
+int
+journal_done( journal_t* j, char* key )
+{
+	return g_hash_table_lookup(j->done, key) != 0;
+}
+
+void
+journal_record( journal_t* j, char* key )
+{
+	g_mutex_lock(&j->lock);
+	fprintf(j->f, "%s\n", key);
+	fflush(j->f);
+	fsync(fileno(j->f));
+	g_mutex_unlock(&j->lock);
+}
+
+char*
+journal_key( char* file, char* policy )
+{
+	unsigned char md[SHA_DIGEST_LENGTH];
+	GString* k;
+	int i;
+
+	SHA1((unsigned char*) policy, strlen(policy), md);
+
+	k = g_string_new("");
+	for( i = 0; i < SHA_DIGEST_LENGTH; i++ )
+		g_string_append_printf(k, "%02x", md[i]);
+	g_string_append_printf(k, " %s", file);
+
+	return g_string_free(k, 0);
+}
@@ -0,0 +1,22 @@
+/*
+	Include glib.h before including this file.
+
+	An append-only record of finished work items, one key per line,
+	synced to disk as each item completes. Opening an existing journal
+	with resume set loads its keys so that a rerun can skip them;
+	otherwise the journal is started afresh.
+*/
+
+typedef struct journal_s journal_t;
+
+journal_t* journal_open( char* file, int resume );
+void       journal_close( journal_t* j );
+
+/* nonzero if key was recorded by an earlier run */
+int  journal_done( journal_t* j, char* key );
+
+/* safe to call from several threads */
+void journal_record( journal_t* j, char* key );
+
+/* key for a file encrypted under a policy, so a changed policy is redone */
+char* journal_key( char* file, char* policy );
@@ -0,0 +1,293 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <openssl/sha.h>
+
+#include "keycache.h"
+
+typedef struct
+{
+	unsigned char digest[SHA256_DIGEST_LENGTH];
+	unsigned char raw[16];
+	GList*        link; /* in lru, or null if the slot is free */
+}
+keycache_entry_t;
+
+struct keycache_s
+{
+	keycache_entry_t* entries;
+	int         max_entries;
+	int         used;
+	int         locked;
+	GHashTable* index; /* digest -> entry */
+	GQueue      lru;   /* most recently used at the head */
+	char*       dir;
+	GMutex      lock;
+};
+
+guint
+digest_hash( gconstpointer d )
+{
+	guint h;
+
+	memcpy(&h, d, sizeof(h));
+
+	return h;
+}
+
+gboolean
+digest_equal( gconstpointer a, gconstpointer b )
+{
+	return !memcmp(a, b, SHA256_DIGEST_LENGTH);
+}
+
+char*
+digest_path( keycache_t* c, unsigned char* digest )
+{
+	char hex[2 * SHA256_DIGEST_LENGTH + 1];
+	int i;
+
+	for( i = 0; i < SHA256_DIGEST_LENGTH; i++ )
+		sprintf(hex + 2 * i, "%02x", digest[i]);
+
+	return g_build_filename(c->dir, hex, (char*) 0);
+}
+
+typedef struct
+{
+	char*  path;
+	time_t mtime;
+}
+cached_file_t;
+
+int
+cmp_newest( const void* a, const void* b )
+{
+	time_t ta;
+	time_t tb;
+
+	ta = (*(cached_file_t**) a)->mtime;
+	tb = (*(cached_file_t**) b)->mtime;
+
+	return ta < tb ? 1 : ta > tb ? -1 : 0;
+}
+
+/* whether name could have come from digest_path() */
+int
+is_digest_name( const char* name )
+{
+	int i;
+
+	for( i = 0; i < 2 * SHA256_DIGEST_LENGTH; i++ )
+		if( !g_ascii_isdigit(name[i]) && (name[i] < 'a' || name[i] > 'f') )
+			return 0;
+
+	return !name[i];
+}
+
+/* only files named like ours are counted or removed, anything else is left alone */
+void
+trim_dir( keycache_t* c )
+{
+	GDir* d;
+	const char* name;
+	GPtrArray* files;
+	cached_file_t* f;
+	struct stat st;
+	guint i;
+
+	if( !(d = g_dir_open(c->dir, 0, 0)) )
+		return;
+
+	files = g_ptr_array_new();
+	while( (name = g_dir_read_name(d)) )
+	{
+		if( !is_digest_name(name) )
+			continue;
+		f = (cached_file_t*) malloc(sizeof(cached_file_t));
+		f->path = g_build_filename(c->dir, name, (char*) 0);
+		if( lstat(f->path, &st) || !S_ISREG(st.st_mode) )
+		{
+			free(f->path);
+			free(f);
+			continue;
+		}
+		f->mtime = st.st_mtime;
+		g_ptr_array_add(files, f);
+	}
+	g_dir_close(d);
+
+	qsort(files->pdata, files->len, sizeof(cached_file_t*), cmp_newest);
+	for( i = 0; i < files->len; i++ )
+	{
+		f = g_ptr_array_index(files, i);
+		if( i >= c->max_entries )
+			unlink(f->path);
+		free(f->path);
+		free(f);
+	}
+	g_ptr_array_free(files, 1);
+}
+
+keycache_t*
+keycache_new( int max_entries, char* dir, int lock )
+{
+	keycache_t* c;
+	size_t size;
+
+	c = (keycache_t*) malloc(sizeof(keycache_t));
+	c->max_entries = max_entries < 1 ? 1 : max_entries;
+	c->used = 0;
+	c->index = g_hash_table_new(digest_hash, digest_equal);
+	g_queue_init(&c->lru);
+	g_mutex_init(&c->lock);
+
+	size = c->max_entries * sizeof(keycache_entry_t);
+	c->entries = (keycache_entry_t*) calloc(c->max_entries, sizeof(keycache_entry_t));
+	c->locked = lock && !mlock(c->entries, size);
+	if( lock && !c->locked )
+		fprintf(stderr, "can't lock session key cache in memory, continuing unlocked\n");
+
+	c->dir = 0;
+	if( dir )
+	{
+		if( g_mkdir_with_parents(dir, 0700) )
+			fprintf(stderr, "can't create session key cache directory: %s\n", dir);
+		else
+		{
+			c->dir = strdup(dir);
+			trim_dir(c);
+		}
+	}
+
+	return c;
+}
+
+/* call with c->lock held */
+keycache_entry_t*
+insert_entry( keycache_t* c, unsigned char* digest, unsigned char* raw )
+{
+	keycache_entry_t* e;
+
+	if( c->used < c->max_entries )
+		e = &c->entries[c->used++];
+	else
+	{
+		e = g_queue_pop_tail(&c->lru);
+		g_hash_table_remove(c->index, e->digest);
+		memset(e, 0, sizeof(keycache_entry_t));
+	}
+
+	memcpy(e->digest, digest, SHA256_DIGEST_LENGTH);
+	memcpy(e->raw, raw, 16);
+	g_queue_push_head(&c->lru, e);
+	e->link = g_queue_peek_head_link(&c->lru);
+	g_hash_table_insert(c->index, e->digest, e);
+
+	return e;
+}
+
+int
+load_entry( keycache_t* c, unsigned char* digest, unsigned char* raw )
+{
+	char* path;
+	int fd;
+	int ok;
+
+	path = digest_path(c, digest);
+	ok = (fd = open(path, O_RDONLY)) >= 0 && read(fd, raw, 16) == 16;
+	if( fd >= 0 )
+		close(fd);
+	free(path);
+
+	return ok;
+}
+
+void
+store_entry( keycache_t* c, unsigned char* digest, unsigned char* raw )
+{
+	char* path;
+	char* tmp;
+	int fd;
+
+	path = digest_path(c, digest);
+	tmp = g_strdup_printf("%s.%d.tmp", path, (int) getpid());
+
+	if( (fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600)) >= 0 )
+	{
+		if( write(fd, raw, 16) != 16 || close(fd) || rename(tmp, path) )
+			unlink(tmp);
+	}
+
+	free(tmp);
+	free(path);
+}
+
+int
+keycache_get( keycache_t* c, GByteArray* cph_buf, unsigned char* raw )
+{
+	unsigned char digest[SHA256_DIGEST_LENGTH];
+	keycache_entry_t* e;
+	int found;
+
+	SHA256(cph_buf->data, cph_buf->len, digest);
+
+	g_mutex_lock(&c->lock);
+	if( (e = g_hash_table_lookup(c->index, digest)) )
+	{
+		g_queue_unlink(&c->lru, e->link);
+		g_queue_push_head_link(&c->lru, e->link);
+		memcpy(raw, e->raw, 16);
+		found = 1;
+	}
+	else if( c->dir && load_entry(c, digest, raw) )
+	{
+		insert_entry(c, digest, raw);
+		found = 1;
+	}
+	else
+		found = 0;
+	g_mutex_unlock(&c->lock);
+
+	return found;
+}
+
+void
+keycache_put( keycache_t* c, GByteArray* cph_buf, unsigned char* raw )
+{
+	unsigned char digest[SHA256_DIGEST_LENGTH];
+
+	SHA256(cph_buf->data, cph_buf->len, digest);
+
+	g_mutex_lock(&c->lock);
+	if( !g_hash_table_lookup(c->index, digest) )
+	{
+		insert_entry(c, digest, raw);
+		if( c->dir )
+			store_entry(c, digest, raw);
+	}
+	g_mutex_unlock(&c->lock);
+}
+
+void
+keycache_free( keycache_t* c )
+{
+	size_t size;
+
+	size = c->max_entries * sizeof(keycache_entry_t);
+	memset(c->entries, 0, size);
+	if( c->locked )
+		munlock(c->entries, size);
+	free(c->entries);
+
+	g_hash_table_destroy(c->index);
+	g_queue_clear(&c->lru);
+	g_mutex_clear(&c->lock);
+	free(c->dir);
+	free(c);
+}
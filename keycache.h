@@ -0,0 +1,28 @@
+/*
+	Include glib.h before including this file.
+
+	A bounded cache of recovered session keys, keyed by the SHA-256 of
+	the serialized ciphertext header they were decapsulated from, so a
+	header seen before costs no pairings. What is kept is the 16-byte
+	AES key of session_key_bytes(). The entries live in one array
+	allocated up front, optionally locked into memory with mlock(), and
+	the least recently used one is wiped and reused when it is full.
+
+	With a directory, entries are also kept there as files readable only
+	by the owner, so that later processes start warm. The directory is
+	trimmed to the newest max_entries files when the cache is opened.
+	Anyone who can read it can decrypt the files it has keys for.
+
+	All calls may be made from several threads at once.
+*/
+
+typedef struct keycache_s keycache_t;
+
+/* dir may be null for a cache in memory only */
+keycache_t* keycache_new( int max_entries, char* dir, int lock );
+
+/* copies the key for cph_buf to raw and returns nonzero if cached */
+int  keycache_get( keycache_t* c, GByteArray* cph_buf, unsigned char* raw );
+void keycache_put( keycache_t* c, GByteArray* cph_buf, unsigned char* raw );
+
+void keycache_free( keycache_t* c );
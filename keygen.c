@@ -9,9 +9,13 @@
 #include "bswabe.h"
 #include "common.h"
 #include "policy_lang.h"
+#include "threshold.h"
+#include "decrypt.h"
+#include "batch.h"
 
 char* usage =
 "Usage: cpabe-keygen [OPTION ...] PUB_KEY MASTER_KEY ATTR [ATTR ...]\n"
+"  or:  cpabe-keygen [OPTION ...] -b USERS PUB_KEY MASTER_KEY\n"
 "\n"
 "Generate a key with the listed attributes using public key PUB_KEY and\n"
 "master secret key MASTER_KEY. Output will be written to the file\n"
@@ -31,10 +35,32 @@ char* usage =
 "The keywords `and', `or', and `of', are reserved for the policy language\n"
 "of cpabe-enc (1) and may not be used for either type of attribute.\n"
 "\n"
+"With -i, the key is written in an indexed form, from which cpabe-dec\n"
+"reads only the components a policy needs. Only cpabe-dec, cpabe-decd\n"
+"and cpabe-transform of this version can read it.\n"
+"\n"
+"With -b, a key is generated for each line of the file USERS, which\n"
+"holds the file to write the key to and then its attributes, separated\n"
+"by tabs. Empty lines and lines starting with # are skipped. The keys\n"
+"are loaded once and the keys generated in parallel, each numerical\n"
+"attribute expanded only once however many lines it is on. A line is\n"
+"printed for each key that could not be written, then a summary, and\n"
+"the exit status is nonzero if any failed.\n"
+"\n"
+"With -t, the key is split for outsourced decryption: a transformation\n"
+"key, written to the output file with .tk appended, which can be handed\n"
+"to cpabe-transform (1) to do the pairings, and a short secret, written\n"
+"to the output file, which cpabe-dec -t needs to finish decryption.\n"
+"\n"
 "Mandatory arguments to long options are mandatory for short options too.\n\n"
 " -h, --help               print this message\n\n"
 " -v, --version            print version information\n\n"
 " -o, --output FILE        write resulting key to FILE\n\n"
+" -i, --indexed            write the key in indexed form\n\n"
+" -t, --transform          split the key for outsourced decryption\n\n"
+" -b, --batch USERS        generate the keys listed in USERS\n\n"
+" -j, --jobs N             with -b, generate up to N keys at once\n"
+"                          (default: one per processor, one with -d)\n\n"
 " -d, --deterministic      use deterministic \"random\" numbers\n"
 "                          (only for debugging)\n\n"
 "";
@@ -49,6 +75,32 @@ char*  msk_file = 0;
 char** attrs    = 0;
 
 char*  out_file = "priv_key";
+int    indexed   = 0;
+int    transform = 0;
+char*  users_file = 0;
+int    jobs       = 0;
+int    deterministic = 0;
+
+/* what each thread generating keys unserializes for itself */
+typedef struct
+{
+	bswabe_pub_t* pub;
+	bswabe_msk_t* msk;
+	dec_pub_t*    dpub;
+}
+keygen_state_t;
+
+GByteArray* pub_buf;
+GByteArray* msk_buf;
+
+typedef struct
+{
+	char*  out;
+	char** attrs; /* sorted, owned by the expansion cache */
+}
+keygen_job_t;
+
+GMutex report_lock;
 
 gint
 comp_string( gconstpointer a, gconstpointer b)
@@ -56,6 +108,12 @@ comp_string( gconstpointer a, gconstpointer b)
 	return strcmp(a, b);
 }
 
+gint
+comp_string_ptr( gconstpointer a, gconstpointer b)
+{
+	return strcmp(*(char**) a, *(char**) b);
+}
+
 void
 parse_args( int argc, char** argv )
 {
@@ -83,9 +141,30 @@ parse_args( int argc, char** argv )
 			else
 				out_file = argv[i];
 		}
+		else if( !strcmp(argv[i], "-i") || !strcmp(argv[i], "--indexed") )
+		{
+			indexed = 1;
+		}
+		else if( !strcmp(argv[i], "-t") || !strcmp(argv[i], "--transform") )
+		{
+			transform = 1;
+		}
+		else if( !strcmp(argv[i], "-b") || !strcmp(argv[i], "--batch") )
+		{
+			if( ++i >= argc )
+				die(usage);
+			else
+				users_file = argv[i];
+		}
+		else if( !strcmp(argv[i], "-j") || !strcmp(argv[i], "--jobs") )
+		{
+			if( ++i >= argc || (jobs = atoi(argv[i])) < 1 )
+				die(usage);
+		}
 		else if( !strcmp(argv[i], "-d") || !strcmp(argv[i], "--deterministic") )
 		{
 			pbc_random_set_deterministic(0);
+			deterministic = 1;
 		}
 		else if( !pub_file )
 		{
@@ -100,6 +179,13 @@ parse_args( int argc, char** argv )
 			parse_attribute(&alist, argv[i]);
 		}
 
+	if( users_file )
+	{
+		if( !pub_file || !msk_file || alist )
+			die(usage);
+		return;
+	}
+
 	if( !pub_file || !msk_file || !alist )
 		die(usage);
 
@@ -114,20 +200,236 @@ parse_args( int argc, char** argv )
 	attrs[i] = 0;
 }
 
+keygen_state_t*
+state_new()
+{
+	keygen_state_t* st;
+
+	st = (keygen_state_t*) malloc(sizeof(keygen_state_t));
+	st->pub = bswabe_pub_unserialize(copy_buf(pub_buf), 1);
+	st->msk = bswabe_msk_unserialize(st->pub, copy_buf(msk_buf), 1);
+	st->dpub = (transform || indexed) ? dec_pub_unserialize(copy_buf(pub_buf), 1) : 0;
+
+	return st;
+}
+
+void
+state_free( gpointer data )
+{
+	keygen_state_t* st;
+
+	st = data;
+	if( st->dpub )
+		dec_pub_free(st->dpub);
+	bswabe_msk_free(st->msk);
+	bswabe_pub_free(st->pub);
+	free(st);
+}
+
+GPrivate thread_state = G_PRIVATE_INIT(state_free);
+
 int
-main( int argc, char** argv )
+write_key( char* file, GByteArray* b )
+{
+	int ok;
+
+	ok = g_file_set_contents(file, (gchar*) b->data, b->len, 0);
+	g_byte_array_free(b, 1);
+
+	return ok;
+}
+
+/* returns the file that could not be written, or zero */
+char*
+make_key( keygen_state_t* st, char** attrs, char* out )
 {
-	bswabe_pub_t* pub;
-	bswabe_msk_t* msk;
 	bswabe_prv_t* prv;
+	dec_prv_t* dprv;
+	element_t z;
+	char* tk;
+	char* err;
+
+	prv = bswabe_keygen(st->pub, st->msk, attrs);
+	err = 0;
+
+	if( transform || indexed )
+	{
+		dprv = dec_prv_unserialize(st->dpub, bswabe_prv_serialize(prv), 1);
+		if( transform )
+		{
+			dec_prv_blind(st->dpub, dprv, z);
+			tk = g_strdup_printf("%s.tk", out);
+			if( !write_key(tk, dec_prv_serialize(dprv, indexed)) )
+				err = tk;
+			else
+			{
+				free(tk);
+				if( !write_key(out, dec_retained_serialize(z)) )
+					err = strdup(out);
+			}
+			element_clear(z);
+		}
+		else if( !write_key(out, dec_prv_serialize(dprv, 1)) )
+			err = strdup(out);
+		dec_prv_free(dprv);
+	}
+	else if( !write_key(out, bswabe_prv_serialize(prv)) )
+		err = strdup(out);
+
+	bswabe_prv_free(prv);
+
+	return err;
+}
+
+int
+keygen_job( gpointer data, gpointer user_data )
+{
+	keygen_job_t* job;
+	keygen_state_t* st;
+	char* err;
+
+	job = data;
+	if( !(st = g_private_get(&thread_state)) )
+	{
+		st = state_new();
+		g_private_set(&thread_state, st);
+	}
+
+	if( (err = make_key(st, job->attrs, job->out)) )
+	{
+		g_mutex_lock(&report_lock);
+		printf("can't write file: %s\n", err);
+		g_mutex_unlock(&report_lock);
+		free(err);
+	}
+
+	free(job->out);
+	free(job->attrs);
+	free(job);
+
+	return !err;
+}
+
+/*
+	The attributes of a line of USERS, each numerical one expanded the
+	first time it is seen and the expansion kept in expanded.
+*/
+char**
+line_attrs( char** fields, GHashTable* expanded )
+{
+	GSList* alist;
+	GSList* ap;
+	GPtrArray* a;
+	char** e;
+	int i;
+	int n;
+
+	a = g_ptr_array_new();
+	for( i = 0; fields[i]; i++ )
+	{
+		if( !*g_strstrip(fields[i]) )
+			continue;
+		if( !(e = g_hash_table_lookup(expanded, fields[i])) )
+		{
+			alist = 0;
+			parse_attribute(&alist, strdup(fields[i]));
+			e = malloc((g_slist_length(alist) + 1) * sizeof(char*));
+			for( n = 0, ap = alist; ap; ap = ap->next )
+				e[n++] = ap->data;
+			e[n] = 0;
+			g_slist_free(alist);
+			g_hash_table_insert(expanded, strdup(fields[i]), e);
+		}
+		for( ; *e; e++ )
+			g_ptr_array_add(a, *e);
+	}
+
+	g_ptr_array_sort(a, (GCompareFunc) comp_string_ptr);
+	g_ptr_array_add(a, 0);
+
+	return (char**) g_ptr_array_free(a, 0);
+}
+
+int
+keygen_batch()
+{
+	GHashTable* expanded;
+	keygen_job_t* job;
+	batch_t* b;
+	FILE* f;
+	char* line;
+	size_t size;
+	ssize_t n;
+	char** fields;
+	gint64 t0;
+	double secs;
+	int lineno;
+	int count;
+	int failed;
+
+	/* numerical attributes of a line are expanded by parse_attribute() */
+	expanded = g_hash_table_new(g_str_hash, g_str_equal);
+	f = fopen_read_or_die(users_file);
+
+	if( deterministic )
+		jobs = 1;
+	b = batch_new(jobs ? jobs : g_get_num_processors(), 0, keygen_job, 0);
+	t0 = g_get_monotonic_time();
+
+	line = 0;
+	size = 0;
+	lineno = 0;
+	count = 0;
+	while( (n = getline(&line, &size, f)) > 0 )
+	{
+		lineno++;
+		if( line[n - 1] == '\n' )
+			line[--n] = 0;
+		if( !*g_strstrip(line) || line[0] == '#' )
+			continue;
+
+		fields = g_strsplit(line, "\t", 0);
+		if( !fields[1] )
+			die("%s:%d: no attributes for %s\n", users_file, lineno, fields[0]);
+
+		job = (keygen_job_t*) malloc(sizeof(keygen_job_t));
+		job->out = strdup(g_strstrip(fields[0]));
+		job->attrs = line_attrs(fields + 1, expanded);
+		if( !job->attrs[0] )
+			die("%s:%d: no attributes for %s\n", users_file, lineno, job->out);
+		g_strfreev(fields);
+
+		batch_push(b, job, 0);
+		count++;
+	}
+	free(line);
+	fclose(f);
+
+	failed = batch_finish(b);
+	secs = (g_get_monotonic_time() - t0) / 1e6;
+	printf("%d keys, %d failed, in %.2f s (%.1f keys/s)\n",
+				 count, failed, secs, secs > 0 ? count / secs : 0.0);
+
+	return failed ? 1 : 0;
+}
+
+int
+main( int argc, char** argv )
+{
+	keygen_state_t* st;
+	char* err;
 
 	parse_args(argc, argv);
 
-	pub = bswabe_pub_unserialize(suck_file(pub_file), 1);
-	msk = bswabe_msk_unserialize(pub, suck_file(msk_file), 1);
+	pub_buf = suck_file(pub_file);
+	msk_buf = suck_file(msk_file);
+
+	if( users_file )
+		return keygen_batch();
 
-	prv = bswabe_keygen(pub, msk, attrs);
-	spit_file(out_file, bswabe_prv_serialize(prv), 1);
+	st = state_new();
+	if( (err = make_key(st, attrs, out_file)) )
+		die("can't write file: %s\n", err);
 
 	return 0;
 }
@@ -1,8 +1,9 @@
-/* A Bison parser, made by GNU Bison 3.0.2.  */
+/* A Bison parser, made by GNU Bison 3.8.2.  */
 
 /* Bison implementation for Yacc-like parsers in C
 
-   Copyright (C) 1984, 1989-1990, 2000-2013 Free Software Foundation, Inc.
+   Copyright (C) 1984, 1989-1990, 2000-2015, 2018-2021 Free Software Foundation,
+   Inc.
 
    This program is free software: you can redistribute it and/or modify
    it under the terms of the GNU General Public License as published by
@@ -15,7 +16,7 @@
    GNU General Public License for more details.
 
    You should have received a copy of the GNU General Public License
-   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
 
 /* As a special exception, you may create a larger work that contains
    part or all of the Bison parser skeleton and distribute that work
@@ -33,6 +34,10 @@
 /* C LALR(1) parser skeleton written by Richard Stallman, by
    simplifying the original so-called "semantic" parser.  */
 
+/* DO NOT RELY ON FEATURES THAT ARE NOT DOCUMENTED in the manual,
+   especially those whose name start with YY_ or yy_.  They are
+   private implementation details that can be changed or removed.  */
+
 /* All symbols defined below should begin with yy or YY, to avoid
    infringing on user name space.  This should be done even for local
    variables, as they might otherwise be expanded by user macros.
@@ -40,11 +45,11 @@
    define necessary library symbols; they are noted "INFRINGES ON
    USER NAME SPACE" below.  */
 
-/* Identify Bison output.  */
-#define YYBISON 1
+/* Identify Bison output, and Bison version.  */
+#define YYBISON 30802
 
-/* Bison version.  */
-#define YYBISON_VERSION "3.0.2"
+/* Bison version string.  */
+#define YYBISON_VERSION "3.8.2"
 
 /* Skeleton name.  */
 #define YYSKELETON_NAME "yacc.c"
@@ -61,8 +66,8 @@
 
 
 
-/* Copy the first part of user declarations.  */
-#line 1 "policy_lang.y" /* yacc.c:339  */
+/* First part of user prologue.  */
+#line 1 "policy_lang.y"
 
 #include <stdio.h>
 #include <ctype.h>
@@ -79,18 +84,36 @@ typedef struct
 {
 	uint64_t value;
 	int bits; /* zero if this is a flexint */
+	char* hole; /* placeholder name if the value comes later, otherwise null */
 }
 sized_integer_t;
 
+typedef struct
+{
+	char* name; /* without the leading '$' */
+	int   bits; /* zero if this is a flexint */
+	int   op;   /* '=', '<', '>', LEQ or GEQ with the attribute on the left */
+	char* attr;
+}
+policy_hole_t;
+
 typedef struct
 {
 	int k;               /* one if leaf, otherwise threshold */
 	char* attr;          /* attribute string if leaf, otherwise null */
 	GPtrArray* children; /* pointers to bswabe_policy_t's, len == 0 for leaves */
+	policy_hole_t* hole; /* placeholder leaf, otherwise null */
+	char* postfix;       /* cached for subtrees of a template without holes */
 }
 cpabe_policy_t;
 
+struct policy_template_s
+{
+	cpabe_policy_t* root;
+};
+
 cpabe_policy_t* final_policy = 0;
+int num_holes = 0;
 
 int yylex();
 void yyerror( const char* s );
@@ -105,24 +128,29 @@ cpabe_policy_t* gt_policy( sized_integer_t* n, char* attr );
 cpabe_policy_t* le_policy( sized_integer_t* n, char* attr );
 cpabe_policy_t* ge_policy( sized_integer_t* n, char* attr );
 
-#line 109 "policy_lang.c" /* yacc.c:339  */
+#line 132 "policy_lang.c"
 
+# ifndef YY_CAST
+#  ifdef __cplusplus
+#   define YY_CAST(Type, Val) static_cast<Type> (Val)
+#   define YY_REINTERPRET_CAST(Type, Val) reinterpret_cast<Type> (Val)
+#  else
+#   define YY_CAST(Type, Val) ((Type) (Val))
+#   define YY_REINTERPRET_CAST(Type, Val) ((Type) (Val))
+#  endif
+# endif
 # ifndef YY_NULLPTR
-#  if defined __cplusplus && 201103L <= __cplusplus
-#   define YY_NULLPTR nullptr
+#  if defined __cplusplus
+#   if 201103L <= __cplusplus
+#    define YY_NULLPTR nullptr
+#   else
+#    define YY_NULLPTR 0
+#   endif
 #  else
-#   define YY_NULLPTR 0
+#   define YY_NULLPTR ((void*)0)
 #  endif
 # endif
 
-/* Enabling verbose error messages.  */
-#ifdef YYERROR_VERBOSE
-# undef YYERROR_VERBOSE
-# define YYERROR_VERBOSE 1
-#else
-# define YYERROR_VERBOSE 0
-#endif
-
 
 /* Debug traces.  */
 #ifndef YYDEBUG
@@ -132,27 +160,32 @@ cpabe_policy_t* ge_policy( sized_integer_t* n, char* attr );
 extern int yydebug;
 #endif
 
-/* Token type.  */
+/* Token kinds.  */
 #ifndef YYTOKENTYPE
 # define YYTOKENTYPE
   enum yytokentype
   {
-    TAG = 258,
-    INTLIT = 259,
-    OR = 260,
-    AND = 261,
-    OF = 262,
-    LEQ = 263,
-    GEQ = 264
+    YYEMPTY = -2,
+    YYEOF = 0,                     /* "end of file"  */
+    YYerror = 256,                 /* error  */
+    YYUNDEF = 257,                 /* "invalid token"  */
+    TAG = 258,                     /* TAG  */
+    HOLE = 259,                    /* HOLE  */
+    INTLIT = 260,                  /* INTLIT  */
+    OR = 261,                      /* OR  */
+    AND = 262,                     /* AND  */
+    OF = 263,                      /* OF  */
+    LEQ = 264,                     /* LEQ  */
+    GEQ = 265                      /* GEQ  */
   };
+  typedef enum yytokentype yytoken_kind_t;
 #endif
 
 /* Value type.  */
 #if ! defined YYSTYPE && ! defined YYSTYPE_IS_DECLARED
-typedef union YYSTYPE YYSTYPE;
 union YYSTYPE
 {
-#line 45 "policy_lang.y" /* yacc.c:355  */
+#line 63 "policy_lang.y"
 
 	char* str;
 	uint64_t nat;
@@ -160,8 +193,10 @@ union YYSTYPE
 	cpabe_policy_t* tree;
 	GPtrArray* list;
 
-#line 164 "policy_lang.c" /* yacc.c:355  */
+#line 197 "policy_lang.c"
+
 };
+typedef union YYSTYPE YYSTYPE;
 # define YYSTYPE_IS_TRIVIAL 1
 # define YYSTYPE_IS_DECLARED 1
 #endif
@@ -169,40 +204,129 @@ union YYSTYPE
 
 extern YYSTYPE yylval;
 
+
 int yyparse (void);
 
 
 
-/* Copy the second part of user declarations.  */
+/* Symbol kind.  */
+enum yysymbol_kind_t
+{
+  YYSYMBOL_YYEMPTY = -2,
+  YYSYMBOL_YYEOF = 0,                      /* "end of file"  */
+  YYSYMBOL_YYerror = 1,                    /* error  */
+  YYSYMBOL_YYUNDEF = 2,                    /* "invalid token"  */
+  YYSYMBOL_TAG = 3,                        /* TAG  */
+  YYSYMBOL_HOLE = 4,                       /* HOLE  */
+  YYSYMBOL_INTLIT = 5,                     /* INTLIT  */
+  YYSYMBOL_OR = 6,                         /* OR  */
+  YYSYMBOL_AND = 7,                        /* AND  */
+  YYSYMBOL_OF = 8,                         /* OF  */
+  YYSYMBOL_LEQ = 9,                        /* LEQ  */
+  YYSYMBOL_GEQ = 10,                       /* GEQ  */
+  YYSYMBOL_11_ = 11,                       /* '#'  */
+  YYSYMBOL_12_ = 12,                       /* '('  */
+  YYSYMBOL_13_ = 13,                       /* ')'  */
+  YYSYMBOL_14_ = 14,                       /* '='  */
+  YYSYMBOL_15_ = 15,                       /* '<'  */
+  YYSYMBOL_16_ = 16,                       /* '>'  */
+  YYSYMBOL_17_ = 17,                       /* ','  */
+  YYSYMBOL_YYACCEPT = 18,                  /* $accept  */
+  YYSYMBOL_result = 19,                    /* result  */
+  YYSYMBOL_number = 20,                    /* number  */
+  YYSYMBOL_policy = 21,                    /* policy  */
+  YYSYMBOL_arg_list = 22                   /* arg_list  */
+};
+typedef enum yysymbol_kind_t yysymbol_kind_t;
+
+
 
-#line 179 "policy_lang.c" /* yacc.c:358  */
 
 #ifdef short
 # undef short
 #endif
 
-#ifdef YYTYPE_UINT8
-typedef YYTYPE_UINT8 yytype_uint8;
-#else
-typedef unsigned char yytype_uint8;
+/* On compilers that do not define __PTRDIFF_MAX__ etc., make sure
+   <limits.h> and (if available) <stdint.h> are included
+   so that the code can choose integer types of a good width.  */
+
+#ifndef __PTRDIFF_MAX__
+# include <limits.h> /* INFRINGES ON USER NAME SPACE */
+# if defined __STDC_VERSION__ && 199901 <= __STDC_VERSION__
+#  include <stdint.h> /* INFRINGES ON USER NAME SPACE */
+#  define YY_STDINT_H
+# endif
 #endif
 
-#ifdef YYTYPE_INT8
-typedef YYTYPE_INT8 yytype_int8;
+/* Narrow types that promote to a signed type and that can represent a
+   signed or unsigned integer of at least N bits.  In tables they can
+   save space and decrease cache pressure.  Promoting to a signed type
+   helps avoid bugs in integer arithmetic.  */
+
+#ifdef __INT_LEAST8_MAX__
+typedef __INT_LEAST8_TYPE__ yytype_int8;
+#elif defined YY_STDINT_H
+typedef int_least8_t yytype_int8;
 #else
 typedef signed char yytype_int8;
 #endif
 
-#ifdef YYTYPE_UINT16
-typedef YYTYPE_UINT16 yytype_uint16;
+#ifdef __INT_LEAST16_MAX__
+typedef __INT_LEAST16_TYPE__ yytype_int16;
+#elif defined YY_STDINT_H
+typedef int_least16_t yytype_int16;
+#else
+typedef short yytype_int16;
+#endif
+
+/* Work around bug in HP-UX 11.23, which defines these macros
+   incorrectly for preprocessor constants.  This workaround can likely
+   be removed in 2023, as HPE has promised support for HP-UX 11.23
+   (aka HP-UX 11i v2) only through the end of 2022; see Table 2 of
+   <https://h20195.www2.hpe.com/V2/getpdf.aspx/4AA4-7673ENW.pdf>.  */
+#ifdef __hpux
+# undef UINT_LEAST8_MAX
+# undef UINT_LEAST16_MAX
+# define UINT_LEAST8_MAX 255
+# define UINT_LEAST16_MAX 65535
+#endif
+
+#if defined __UINT_LEAST8_MAX__ && __UINT_LEAST8_MAX__ <= __INT_MAX__
+typedef __UINT_LEAST8_TYPE__ yytype_uint8;
+#elif (!defined __UINT_LEAST8_MAX__ && defined YY_STDINT_H \
+       && UINT_LEAST8_MAX <= INT_MAX)
+typedef uint_least8_t yytype_uint8;
+#elif !defined __UINT_LEAST8_MAX__ && UCHAR_MAX <= INT_MAX
+typedef unsigned char yytype_uint8;
 #else
-typedef unsigned short int yytype_uint16;
+typedef short yytype_uint8;
 #endif
 
-#ifdef YYTYPE_INT16
-typedef YYTYPE_INT16 yytype_int16;
+#if defined __UINT_LEAST16_MAX__ && __UINT_LEAST16_MAX__ <= __INT_MAX__
+typedef __UINT_LEAST16_TYPE__ yytype_uint16;
+#elif (!defined __UINT_LEAST16_MAX__ && defined YY_STDINT_H \
+       && UINT_LEAST16_MAX <= INT_MAX)
+typedef uint_least16_t yytype_uint16;
+#elif !defined __UINT_LEAST16_MAX__ && USHRT_MAX <= INT_MAX
+typedef unsigned short yytype_uint16;
 #else
-typedef short int yytype_int16;
+typedef int yytype_uint16;
+#endif
+
+#ifndef YYPTRDIFF_T
+# if defined __PTRDIFF_TYPE__ && defined __PTRDIFF_MAX__
+#  define YYPTRDIFF_T __PTRDIFF_TYPE__
+#  define YYPTRDIFF_MAXIMUM __PTRDIFF_MAX__
+# elif defined PTRDIFF_MAX
+#  ifndef ptrdiff_t
+#   include <stddef.h> /* INFRINGES ON USER NAME SPACE */
+#  endif
+#  define YYPTRDIFF_T ptrdiff_t
+#  define YYPTRDIFF_MAXIMUM PTRDIFF_MAX
+# else
+#  define YYPTRDIFF_T long
+#  define YYPTRDIFF_MAXIMUM LONG_MAX
+# endif
 #endif
 
 #ifndef YYSIZE_T
@@ -210,15 +334,28 @@ typedef short int yytype_int16;
 #  define YYSIZE_T __SIZE_TYPE__
 # elif defined size_t
 #  define YYSIZE_T size_t
-# elif ! defined YYSIZE_T
+# elif defined __STDC_VERSION__ && 199901 <= __STDC_VERSION__
 #  include <stddef.h> /* INFRINGES ON USER NAME SPACE */
 #  define YYSIZE_T size_t
 # else
-#  define YYSIZE_T unsigned int
+#  define YYSIZE_T unsigned
 # endif
 #endif
 
-#define YYSIZE_MAXIMUM ((YYSIZE_T) -1)
+#define YYSIZE_MAXIMUM                                  \
+  YY_CAST (YYPTRDIFF_T,                                 \
+           (YYPTRDIFF_MAXIMUM < YY_CAST (YYSIZE_T, -1)  \
+            ? YYPTRDIFF_MAXIMUM                         \
+            : YY_CAST (YYSIZE_T, -1)))
+
+#define YYSIZEOF(X) YY_CAST (YYPTRDIFF_T, sizeof (X))
+
+
+/* Stored state numbers (used for stacks). */
+typedef yytype_int8 yy_state_t;
+
+/* State numbers in computations.  */
+typedef int yy_state_fast_t;
 
 #ifndef YY_
 # if defined YYENABLE_NLS && YYENABLE_NLS
@@ -232,47 +369,43 @@ typedef short int yytype_int16;
 # endif
 #endif
 
-#ifndef YY_ATTRIBUTE
-# if (defined __GNUC__                                               \
-      && (2 < __GNUC__ || (__GNUC__ == 2 && 96 <= __GNUC_MINOR__)))  \
-     || defined __SUNPRO_C && 0x5110 <= __SUNPRO_C
-#  define YY_ATTRIBUTE(Spec) __attribute__(Spec)
-# else
-#  define YY_ATTRIBUTE(Spec) /* empty */
-# endif
-#endif
 
 #ifndef YY_ATTRIBUTE_PURE
-# define YY_ATTRIBUTE_PURE   YY_ATTRIBUTE ((__pure__))
+# if defined __GNUC__ && 2 < __GNUC__ + (96 <= __GNUC_MINOR__)
+#  define YY_ATTRIBUTE_PURE __attribute__ ((__pure__))
+# else
+#  define YY_ATTRIBUTE_PURE
+# endif
 #endif
 
 #ifndef YY_ATTRIBUTE_UNUSED
-# define YY_ATTRIBUTE_UNUSED YY_ATTRIBUTE ((__unused__))
-#endif
-
-#if !defined _Noreturn \
-     && (!defined __STDC_VERSION__ || __STDC_VERSION__ < 201112)
-# if defined _MSC_VER && 1200 <= _MSC_VER
-#  define _Noreturn __declspec (noreturn)
+# if defined __GNUC__ && 2 < __GNUC__ + (7 <= __GNUC_MINOR__)
+#  define YY_ATTRIBUTE_UNUSED __attribute__ ((__unused__))
 # else
-#  define _Noreturn YY_ATTRIBUTE ((__noreturn__))
+#  define YY_ATTRIBUTE_UNUSED
 # endif
 #endif
 
 /* Suppress unused-variable warnings by "using" E.  */
 #if ! defined lint || defined __GNUC__
-# define YYUSE(E) ((void) (E))
+# define YY_USE(E) ((void) (E))
 #else
-# define YYUSE(E) /* empty */
+# define YY_USE(E) /* empty */
 #endif
 
-#if defined __GNUC__ && 407 <= __GNUC__ * 100 + __GNUC_MINOR__
 /* Suppress an incorrect diagnostic about yylval being uninitialized.  */
-# define YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN \
-    _Pragma ("GCC diagnostic push") \
-    _Pragma ("GCC diagnostic ignored \"-Wuninitialized\"")\
+#if defined __GNUC__ && ! defined __ICC && 406 <= __GNUC__ * 100 + __GNUC_MINOR__
+# if __GNUC__ * 100 + __GNUC_MINOR__ < 407
+#  define YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN                           \
+    _Pragma ("GCC diagnostic push")                                     \
+    _Pragma ("GCC diagnostic ignored \"-Wuninitialized\"")
+# else
+#  define YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN                           \
+    _Pragma ("GCC diagnostic push")                                     \
+    _Pragma ("GCC diagnostic ignored \"-Wuninitialized\"")              \
     _Pragma ("GCC diagnostic ignored \"-Wmaybe-uninitialized\"")
-# define YY_IGNORE_MAYBE_UNINITIALIZED_END \
+# endif
+# define YY_IGNORE_MAYBE_UNINITIALIZED_END      \
     _Pragma ("GCC diagnostic pop")
 #else
 # define YY_INITIAL_VALUE(Value) Value
@@ -285,8 +418,22 @@ typedef short int yytype_int16;
 # define YY_INITIAL_VALUE(Value) /* Nothing. */
 #endif
 
+#if defined __cplusplus && defined __GNUC__ && ! defined __ICC && 6 <= __GNUC__
+# define YY_IGNORE_USELESS_CAST_BEGIN                          \
+    _Pragma ("GCC diagnostic push")                            \
+    _Pragma ("GCC diagnostic ignored \"-Wuseless-cast\"")
+# define YY_IGNORE_USELESS_CAST_END            \
+    _Pragma ("GCC diagnostic pop")
+#endif
+#ifndef YY_IGNORE_USELESS_CAST_BEGIN
+# define YY_IGNORE_USELESS_CAST_BEGIN
+# define YY_IGNORE_USELESS_CAST_END
+#endif
+
 
-#if ! defined yyoverflow || YYERROR_VERBOSE
+#define YY_ASSERT(E) ((void) (0 && (E)))
+
+#if !defined yyoverflow
 
 /* The parser invokes alloca or malloc; define the necessary symbols.  */
 
@@ -351,8 +498,7 @@ void free (void *); /* INFRINGES ON USER NAME SPACE */
 #   endif
 #  endif
 # endif
-#endif /* ! defined yyoverflow || YYERROR_VERBOSE */
-
+#endif /* !defined yyoverflow */
 
 #if (! defined yyoverflow \
      && (! defined __cplusplus \
@@ -361,17 +507,17 @@ void free (void *); /* INFRINGES ON USER NAME SPACE */
 /* A type that is properly aligned for any stack member.  */
 union yyalloc
 {
-  yytype_int16 yyss_alloc;
+  yy_state_t yyss_alloc;
   YYSTYPE yyvs_alloc;
 };
 
 /* The size of the maximum gap between one aligned stack and the next.  */
-# define YYSTACK_GAP_MAXIMUM (sizeof (union yyalloc) - 1)
+# define YYSTACK_GAP_MAXIMUM (YYSIZEOF (union yyalloc) - 1)
 
 /* The size of an array large to enough to hold all stacks, each with
    N elements.  */
 # define YYSTACK_BYTES(N) \
-     ((N) * (sizeof (yytype_int16) + sizeof (YYSTYPE)) \
+     ((N) * (YYSIZEOF (yy_state_t) + YYSIZEOF (YYSTYPE)) \
       + YYSTACK_GAP_MAXIMUM)
 
 # define YYCOPY_NEEDED 1
@@ -384,11 +530,11 @@ union yyalloc
 # define YYSTACK_RELOCATE(Stack_alloc, Stack)                           \
     do                                                                  \
       {                                                                 \
-        YYSIZE_T yynewbytes;                                            \
+        YYPTRDIFF_T yynewbytes;                                         \
         YYCOPY (&yyptr->Stack_alloc, Stack, yysize);                    \
         Stack = &yyptr->Stack_alloc;                                    \
-        yynewbytes = yystacksize * sizeof (*Stack) + YYSTACK_GAP_MAXIMUM; \
-        yyptr += yynewbytes / sizeof (*yyptr);                          \
+        yynewbytes = yystacksize * YYSIZEOF (*Stack) + YYSTACK_GAP_MAXIMUM; \
+        yyptr += yynewbytes / YYSIZEOF (*yyptr);                        \
       }                                                                 \
     while (0)
 
@@ -400,12 +546,12 @@ union yyalloc
 # ifndef YYCOPY
 #  if defined __GNUC__ && 1 < __GNUC__
 #   define YYCOPY(Dst, Src, Count) \
-      __builtin_memcpy (Dst, Src, (Count) * sizeof (*(Src)))
+      __builtin_memcpy (Dst, Src, YY_CAST (YYSIZE_T, (Count)) * sizeof (*(Src)))
 #  else
 #   define YYCOPY(Dst, Src, Count)              \
       do                                        \
         {                                       \
-          YYSIZE_T yyi;                         \
+          YYPTRDIFF_T yyi;                      \
           for (yyi = 0; yyi < (Count); yyi++)   \
             (Dst)[yyi] = (Src)[yyi];            \
         }                                       \
@@ -415,38 +561,41 @@ union yyalloc
 #endif /* !YYCOPY_NEEDED */
 
 /* YYFINAL -- State number of the termination state.  */
-#define YYFINAL  15
+#define YYFINAL  17
 /* YYLAST -- Last index in YYTABLE.  */
-#define YYLAST   45
+#define YYLAST   49
 
 /* YYNTOKENS -- Number of terminals.  */
-#define YYNTOKENS  17
+#define YYNTOKENS  18
 /* YYNNTS -- Number of nonterminals.  */
 #define YYNNTS  5
 /* YYNRULES -- Number of rules.  */
-#define YYNRULES  21
+#define YYNRULES  23
 /* YYNSTATES -- Number of states.  */
-#define YYNSTATES  44
+#define YYNSTATES  47
+
+/* YYMAXUTOK -- Last valid token kind.  */
+#define YYMAXUTOK   265
 
-/* YYTRANSLATE[YYX] -- Symbol number corresponding to YYX as returned
-   by yylex, with out-of-bounds checking.  */
-#define YYUNDEFTOK  2
-#define YYMAXUTOK   264
 
-#define YYTRANSLATE(YYX)                                                \
-  ((unsigned int) (YYX) <= YYMAXUTOK ? yytranslate[YYX] : YYUNDEFTOK)
+/* YYTRANSLATE(TOKEN-NUM) -- Symbol number corresponding to TOKEN-NUM
+   as returned by yylex, with out-of-bounds checking.  */
+#define YYTRANSLATE(YYX)                                \
+  (0 <= (YYX) && (YYX) <= YYMAXUTOK                     \
+   ? YY_CAST (yysymbol_kind_t, yytranslate[YYX])        \
+   : YYSYMBOL_YYUNDEF)
 
 /* YYTRANSLATE[TOKEN-NUM] -- Symbol number corresponding to TOKEN-NUM
-   as returned by yylex, without out-of-bounds checking.  */
-static const yytype_uint8 yytranslate[] =
+   as returned by yylex.  */
+static const yytype_int8 yytranslate[] =
 {
        0,     2,     2,     2,     2,     2,     2,     2,     2,     2,
        2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
        2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
-       2,     2,     2,     2,     2,    10,     2,     2,     2,     2,
-      11,    12,     2,     2,    16,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,    11,     2,     2,     2,     2,
+      12,    13,     2,     2,    17,     2,     2,     2,     2,     2,
        2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
-      14,    13,    15,     2,     2,     2,     2,     2,     2,     2,
+      15,    14,    16,     2,     2,     2,     2,     2,     2,     2,
        2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
        2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
        2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
@@ -466,167 +615,170 @@ static const yytype_uint8 yytranslate[] =
        2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
        2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
        2,     2,     2,     2,     2,     2,     1,     2,     3,     4,
-       5,     6,     7,     8,     9
+       5,     6,     7,     8,     9,    10
 };
 
 #if YYDEBUG
-  /* YYRLINE[YYN] -- Source line where rule number YYN was defined.  */
-static const yytype_uint8 yyrline[] =
+/* YYRLINE[YYN] -- Source line where rule number YYN was defined.  */
+static const yytype_int8 yyrline[] =
 {
-       0,    67,    67,    69,    70,    72,    73,    74,    75,    76,
-      77,    78,    79,    80,    81,    82,    83,    84,    85,    86,
-      88,    90
+       0,    86,    86,    88,    89,    90,    92,    95,    96,    97,
+      98,    99,   100,   101,   102,   103,   104,   105,   106,   107,
+     108,   109,   111,   113
 };
 #endif
 
-#if YYDEBUG || YYERROR_VERBOSE || 0
+/** Accessing symbol of state STATE.  */
+#define YY_ACCESSING_SYMBOL(State) YY_CAST (yysymbol_kind_t, yystos[State])
+
+#if YYDEBUG || 0
+/* The user-facing name of the symbol whose (internal) number is
+   YYSYMBOL.  No bounds checking.  */
+static const char *yysymbol_name (yysymbol_kind_t yysymbol) YY_ATTRIBUTE_UNUSED;
+
 /* YYTNAME[SYMBOL-NUM] -- String name of the symbol SYMBOL-NUM.
    First, the terminals, then, starting at YYNTOKENS, nonterminals.  */
 static const char *const yytname[] =
 {
-  "$end", "error", "$undefined", "TAG", "INTLIT", "OR", "AND", "OF",
-  "LEQ", "GEQ", "'#'", "'('", "')'", "'='", "'<'", "'>'", "','", "$accept",
-  "result", "number", "policy", "arg_list", YY_NULLPTR
+  "\"end of file\"", "error", "\"invalid token\"", "TAG", "HOLE",
+  "INTLIT", "OR", "AND", "OF", "LEQ", "GEQ", "'#'", "'('", "')'", "'='",
+  "'<'", "'>'", "','", "$accept", "result", "number", "policy", "arg_list", YY_NULLPTR
 };
-#endif
 
-# ifdef YYPRINT
-/* YYTOKNUM[NUM] -- (External) token number corresponding to the
-   (internal) symbol number NUM (which must be that of a token).  */
-static const yytype_uint16 yytoknum[] =
+static const char *
+yysymbol_name (yysymbol_kind_t yysymbol)
 {
-       0,   256,   257,   258,   259,   260,   261,   262,   263,   264,
-      35,    40,    41,    61,    60,    62,    44
-};
-# endif
+  return yytname[yysymbol];
+}
+#endif
 
-#define YYPACT_NINF -5
+#define YYPACT_NINF (-5)
 
-#define yypact_value_is_default(Yystate) \
-  (!!((Yystate) == (-5)))
+#define yypact_value_is_default(Yyn) \
+  ((Yyn) == YYPACT_NINF)
 
-#define YYTABLE_NINF -1
+#define YYTABLE_NINF (-1)
 
-#define yytable_value_is_error(Yytable_value) \
+#define yytable_value_is_error(Yyn) \
   0
 
-  /* YYPACT[STATE-NUM] -- Index in YYTABLE of the portion describing
-     STATE-NUM.  */
+/* YYPACT[STATE-NUM] -- Index in YYTABLE of the portion describing
+   STATE-NUM.  */
 static const yytype_int8 yypact[] =
 {
-      -2,    -1,    -4,    -2,     4,     2,    17,     1,     1,     1,
-       1,     1,    13,    29,    15,    -5,    32,    33,    34,    37,
-      38,    -2,    -2,    35,    -5,    -5,    -5,    -5,    -5,    -2,
-      -5,    -5,    -5,    -5,    -5,    -5,    -5,    19,    -5,    17,
-      22,    -5,    -2,    17
+      -2,    -3,    23,    16,    -2,    35,     7,    19,     0,     0,
+       0,     0,     0,    31,    25,    33,     2,    -5,    36,    37,
+      39,    40,    41,    -2,    -2,    34,    -5,    -5,    -5,    -5,
+      -5,    -5,    -2,    -5,    -5,    -5,    -5,    -5,    -5,    -5,
+      42,    -5,    19,     1,    -5,    -2,    19
 };
 
-  /* YYDEFACT[STATE-NUM] -- Default reduction number in state STATE-NUM.
-     Performed when YYTABLE does not specify something else to do.  Zero
-     means the default is an error.  */
-static const yytype_uint8 yydefact[] =
+/* YYDEFACT[STATE-NUM] -- Default reduction number in state STATE-NUM.
+   Performed when YYTABLE does not specify something else to do.  Zero
+   means the default is an error.  */
+static const yytype_int8 yydefact[] =
 {
-       0,     5,     4,     0,     0,     0,     2,     0,     0,     0,
-       0,     0,     0,     0,     0,     1,     0,     0,     0,     0,
-       0,     0,     0,     4,    12,    13,     9,    10,    11,     0,
-       3,    19,    17,    18,    14,    15,    16,     6,     7,    20,
-       0,     8,     0,    21
+       0,     7,     6,     4,     0,     0,     0,     2,     0,     0,
+       0,     0,     0,     0,     0,     0,     0,     1,     0,     0,
+       0,     0,     0,     0,     0,     4,    14,    15,    11,    12,
+      13,     5,     0,     3,    21,    19,    20,    16,    17,    18,
+       8,     9,    22,     0,    10,     0,    23
 };
 
-  /* YYPGOTO[NTERM-NUM].  */
+/* YYPGOTO[NTERM-NUM].  */
 static const yytype_int8 yypgoto[] =
 {
-      -5,    -5,    21,    -3,    -5
+      -5,    -5,    21,    -4,    -5
 };
 
-  /* YYDEFGOTO[NTERM-NUM].  */
+/* YYDEFGOTO[NTERM-NUM].  */
 static const yytype_int8 yydefgoto[] =
 {
-      -1,     4,     5,     6,    40
+       0,     5,     6,     7,    43
 };
 
-  /* YYTABLE[YYPACT[STATE-NUM]] -- What to do in state STATE-NUM.  If
-     positive, shift that token.  If negative, reduce the rule whose
-     number is the opposite.  If YYTABLE_NINF, syntax error.  */
-static const yytype_uint8 yytable[] =
+/* YYTABLE[YYPACT[STATE-NUM]] -- What to do in state STATE-NUM.  If
+   positive, shift that token.  If negative, reduce the rule whose
+   number is the opposite.  If YYTABLE_NINF, syntax error.  */
+static const yytype_int8 yytable[] =
 {
-      14,     1,     2,    12,    15,    23,    13,     7,     8,     3,
-      16,    17,     9,    10,    11,    18,    19,    20,    37,    38,
-      21,    22,    21,    22,    29,    22,    39,    31,    24,    25,
-      26,    27,    28,    30,    41,    32,    33,    34,    42,    43,
-      35,    36,     0,     0,     0,    13
+      16,     1,     2,     3,     2,    25,     8,     9,    23,    24,
+       4,    10,    11,    12,    44,    34,    18,    19,    45,    40,
+      41,    20,    21,    22,    14,    23,    24,    15,    42,    26,
+      27,    28,    29,    30,    13,    17,    31,    32,    33,    35,
+      36,    46,    37,    38,    39,    15,     0,     0,     0,    24
 };
 
 static const yytype_int8 yycheck[] =
 {
-       3,     3,     4,     7,     0,     4,    10,     8,     9,    11,
-       8,     9,    13,    14,    15,    13,    14,    15,    21,    22,
-       5,     6,     5,     6,    11,     6,    29,    12,     7,     8,
-       9,    10,    11,     4,    12,     3,     3,     3,    16,    42,
-       3,     3,    -1,    -1,    -1,    10
+       4,     3,     4,     5,     4,     5,     9,    10,     6,     7,
+      12,    14,    15,    16,    13,    13,     9,    10,    17,    23,
+      24,    14,    15,    16,     8,     6,     7,    11,    32,     8,
+       9,    10,    11,    12,    11,     0,     5,    12,     5,     3,
+       3,    45,     3,     3,     3,    11,    -1,    -1,    -1,     7
 };
 
-  /* YYSTOS[STATE-NUM] -- The (internal number of the) accessing
-     symbol of state STATE-NUM.  */
-static const yytype_uint8 yystos[] =
+/* YYSTOS[STATE-NUM] -- The symbol kind of the accessing symbol of
+   state STATE-NUM.  */
+static const yytype_int8 yystos[] =
 {
-       0,     3,     4,    11,    18,    19,    20,     8,     9,    13,
-      14,    15,     7,    10,    20,     0,     8,     9,    13,    14,
-      15,     5,     6,     4,    19,    19,    19,    19,    19,    11,
-       4,    12,     3,     3,     3,     3,     3,    20,    20,    20,
-      21,    12,    16,    20
+       0,     3,     4,     5,    12,    19,    20,    21,     9,    10,
+      14,    15,    16,    11,     8,    11,    21,     0,     9,    10,
+      14,    15,    16,     6,     7,     5,    20,    20,    20,    20,
+      20,     5,    12,     5,    13,     3,     3,     3,     3,     3,
+      21,    21,    21,    22,    13,    17,    21
 };
 
-  /* YYR1[YYN] -- Symbol number of symbol that rule YYN derives.  */
-static const yytype_uint8 yyr1[] =
+/* YYR1[RULE-NUM] -- Symbol kind of the left-hand side of rule RULE-NUM.  */
+static const yytype_int8 yyr1[] =
 {
-       0,    17,    18,    19,    19,    20,    20,    20,    20,    20,
-      20,    20,    20,    20,    20,    20,    20,    20,    20,    20,
-      21,    21
+       0,    18,    19,    20,    20,    20,    20,    21,    21,    21,
+      21,    21,    21,    21,    21,    21,    21,    21,    21,    21,
+      21,    21,    22,    22
 };
 
-  /* YYR2[YYN] -- Number of symbols on the right hand side of rule YYN.  */
-static const yytype_uint8 yyr2[] =
+/* YYR2[RULE-NUM] -- Number of symbols on the right-hand side of rule RULE-NUM.  */
+static const yytype_int8 yyr2[] =
 {
-       0,     2,     1,     3,     1,     1,     3,     3,     5,     3,
-       3,     3,     3,     3,     3,     3,     3,     3,     3,     3,
-       1,     3
+       0,     2,     1,     3,     1,     3,     1,     1,     3,     3,
+       5,     3,     3,     3,     3,     3,     3,     3,     3,     3,
+       3,     3,     1,     3
 };
 
 
+enum { YYENOMEM = -2 };
+
 #define yyerrok         (yyerrstatus = 0)
 #define yyclearin       (yychar = YYEMPTY)
-#define YYEMPTY         (-2)
-#define YYEOF           0
 
 #define YYACCEPT        goto yyacceptlab
 #define YYABORT         goto yyabortlab
 #define YYERROR         goto yyerrorlab
+#define YYNOMEM         goto yyexhaustedlab
 
 
 #define YYRECOVERING()  (!!yyerrstatus)
 
-#define YYBACKUP(Token, Value)                                  \
-do                                                              \
-  if (yychar == YYEMPTY)                                        \
-    {                                                           \
-      yychar = (Token);                                         \
-      yylval = (Value);                                         \
-      YYPOPSTACK (yylen);                                       \
-      yystate = *yyssp;                                         \
-      goto yybackup;                                            \
-    }                                                           \
-  else                                                          \
-    {                                                           \
-      yyerror (YY_("syntax error: cannot back up")); \
-      YYERROR;                                                  \
-    }                                                           \
-while (0)
-
-/* Error token number */
-#define YYTERROR        1
-#define YYERRCODE       256
-
+#define YYBACKUP(Token, Value)                                    \
+  do                                                              \
+    if (yychar == YYEMPTY)                                        \
+      {                                                           \
+        yychar = (Token);                                         \
+        yylval = (Value);                                         \
+        YYPOPSTACK (yylen);                                       \
+        yystate = *yyssp;                                         \
+        goto yybackup;                                            \
+      }                                                           \
+    else                                                          \
+      {                                                           \
+        yyerror (YY_("syntax error: cannot back up")); \
+        YYERROR;                                                  \
+      }                                                           \
+  while (0)
+
+/* Backward compatibility with an undocumented macro.
+   Use YYerror or YYUNDEF. */
+#define YYERRCODE YYUNDEF
 
 
 /* Enable debugging if requested.  */
@@ -643,55 +795,52 @@ do {                                            \
     YYFPRINTF Args;                             \
 } while (0)
 
-/* This macro is provided for backward compatibility. */
-#ifndef YY_LOCATION_PRINT
-# define YY_LOCATION_PRINT(File, Loc) ((void) 0)
-#endif
 
 
-# define YY_SYMBOL_PRINT(Title, Type, Value, Location)                    \
+
+# define YY_SYMBOL_PRINT(Title, Kind, Value, Location)                    \
 do {                                                                      \
   if (yydebug)                                                            \
     {                                                                     \
       YYFPRINTF (stderr, "%s ", Title);                                   \
       yy_symbol_print (stderr,                                            \
-                  Type, Value); \
+                  Kind, Value); \
       YYFPRINTF (stderr, "\n");                                           \
     }                                                                     \
 } while (0)
 
 
-/*----------------------------------------.
-| Print this symbol's value on YYOUTPUT.  |
-`----------------------------------------*/
+/*-----------------------------------.
+| Print this symbol's value on YYO.  |
+`-----------------------------------*/
 
 static void
-yy_symbol_value_print (FILE *yyoutput, int yytype, YYSTYPE const * const yyvaluep)
+yy_symbol_value_print (FILE *yyo,
+                       yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep)
 {
-  FILE *yyo = yyoutput;
-  YYUSE (yyo);
+  FILE *yyoutput = yyo;
+  YY_USE (yyoutput);
   if (!yyvaluep)
     return;
-# ifdef YYPRINT
-  if (yytype < YYNTOKENS)
-    YYPRINT (yyoutput, yytoknum[yytype], *yyvaluep);
-# endif
-  YYUSE (yytype);
+  YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
+  YY_USE (yykind);
+  YY_IGNORE_MAYBE_UNINITIALIZED_END
 }
 
 
-/*--------------------------------.
-| Print this symbol on YYOUTPUT.  |
-`--------------------------------*/
+/*---------------------------.
+| Print this symbol on YYO.  |
+`---------------------------*/
 
 static void
-yy_symbol_print (FILE *yyoutput, int yytype, YYSTYPE const * const yyvaluep)
+yy_symbol_print (FILE *yyo,
+                 yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep)
 {
-  YYFPRINTF (yyoutput, "%s %s (",
-             yytype < YYNTOKENS ? "token" : "nterm", yytname[yytype]);
+  YYFPRINTF (yyo, "%s %s (",
+             yykind < YYNTOKENS ? "token" : "nterm", yysymbol_name (yykind));
 
-  yy_symbol_value_print (yyoutput, yytype, yyvaluep);
-  YYFPRINTF (yyoutput, ")");
+  yy_symbol_value_print (yyo, yykind, yyvaluep);
+  YYFPRINTF (yyo, ")");
 }
 
 /*------------------------------------------------------------------.
@@ -700,7 +849,7 @@ yy_symbol_print (FILE *yyoutput, int yytype, YYSTYPE const * const yyvaluep)
 `------------------------------------------------------------------*/
 
 static void
-yy_stack_print (yytype_int16 *yybottom, yytype_int16 *yytop)
+yy_stack_print (yy_state_t *yybottom, yy_state_t *yytop)
 {
   YYFPRINTF (stderr, "Stack now");
   for (; yybottom <= yytop; yybottom++)
@@ -723,21 +872,21 @@ do {                                                            \
 `------------------------------------------------*/
 
 static void
-yy_reduce_print (yytype_int16 *yyssp, YYSTYPE *yyvsp, int yyrule)
+yy_reduce_print (yy_state_t *yyssp, YYSTYPE *yyvsp,
+                 int yyrule)
 {
-  unsigned long int yylno = yyrline[yyrule];
+  int yylno = yyrline[yyrule];
   int yynrhs = yyr2[yyrule];
   int yyi;
-  YYFPRINTF (stderr, "Reducing stack by rule %d (line %lu):\n",
+  YYFPRINTF (stderr, "Reducing stack by rule %d (line %d):\n",
              yyrule - 1, yylno);
   /* The symbols being reduced.  */
   for (yyi = 0; yyi < yynrhs; yyi++)
     {
       YYFPRINTF (stderr, "   $%d = ", yyi + 1);
       yy_symbol_print (stderr,
-                       yystos[yyssp[yyi + 1 - yynrhs]],
-                       &(yyvsp[(yyi + 1) - (yynrhs)])
-                                              );
+                       YY_ACCESSING_SYMBOL (+yyssp[yyi + 1 - yynrhs]),
+                       &yyvsp[(yyi + 1) - (yynrhs)]);
       YYFPRINTF (stderr, "\n");
     }
 }
@@ -752,8 +901,8 @@ do {                                    \
    multiple parsers can coexist.  */
 int yydebug;
 #else /* !YYDEBUG */
-# define YYDPRINTF(Args)
-# define YY_SYMBOL_PRINT(Title, Type, Value, Location)
+# define YYDPRINTF(Args) ((void) 0)
+# define YY_SYMBOL_PRINT(Title, Kind, Value, Location)
 # define YY_STACK_PRINT(Bottom, Top)
 # define YY_REDUCE_PRINT(Rule)
 #endif /* !YYDEBUG */
@@ -776,249 +925,30 @@ int yydebug;
 #endif
 
 
-#if YYERROR_VERBOSE
 
-# ifndef yystrlen
-#  if defined __GLIBC__ && defined _STRING_H
-#   define yystrlen strlen
-#  else
-/* Return the length of YYSTR.  */
-static YYSIZE_T
-yystrlen (const char *yystr)
-{
-  YYSIZE_T yylen;
-  for (yylen = 0; yystr[yylen]; yylen++)
-    continue;
-  return yylen;
-}
-#  endif
-# endif
 
-# ifndef yystpcpy
-#  if defined __GLIBC__ && defined _STRING_H && defined _GNU_SOURCE
-#   define yystpcpy stpcpy
-#  else
-/* Copy YYSRC to YYDEST, returning the address of the terminating '\0' in
-   YYDEST.  */
-static char *
-yystpcpy (char *yydest, const char *yysrc)
-{
-  char *yyd = yydest;
-  const char *yys = yysrc;
 
-  while ((*yyd++ = *yys++) != '\0')
-    continue;
-
-  return yyd - 1;
-}
-#  endif
-# endif
-
-# ifndef yytnamerr
-/* Copy to YYRES the contents of YYSTR after stripping away unnecessary
-   quotes and backslashes, so that it's suitable for yyerror.  The
-   heuristic is that double-quoting is unnecessary unless the string
-   contains an apostrophe, a comma, or backslash (other than
-   backslash-backslash).  YYSTR is taken from yytname.  If YYRES is
-   null, do not copy; instead, return the length of what the result
-   would have been.  */
-static YYSIZE_T
-yytnamerr (char *yyres, const char *yystr)
-{
-  if (*yystr == '"')
-    {
-      YYSIZE_T yyn = 0;
-      char const *yyp = yystr;
-
-      for (;;)
-        switch (*++yyp)
-          {
-          case '\'':
-          case ',':
-            goto do_not_strip_quotes;
-
-          case '\\':
-            if (*++yyp != '\\')
-              goto do_not_strip_quotes;
-            /* Fall through.  */
-          default:
-            if (yyres)
-              yyres[yyn] = *yyp;
-            yyn++;
-            break;
-
-          case '"':
-            if (yyres)
-              yyres[yyn] = '\0';
-            return yyn;
-          }
-    do_not_strip_quotes: ;
-    }
-
-  if (! yyres)
-    return yystrlen (yystr);
-
-  return yystpcpy (yyres, yystr) - yyres;
-}
-# endif
-
-/* Copy into *YYMSG, which is of size *YYMSG_ALLOC, an error message
-   about the unexpected token YYTOKEN for the state stack whose top is
-   YYSSP.
-
-   Return 0 if *YYMSG was successfully written.  Return 1 if *YYMSG is
-   not large enough to hold the message.  In that case, also set
-   *YYMSG_ALLOC to the required number of bytes.  Return 2 if the
-   required number of bytes is too large to store.  */
-static int
-yysyntax_error (YYSIZE_T *yymsg_alloc, char **yymsg,
-                yytype_int16 *yyssp, int yytoken)
-{
-  YYSIZE_T yysize0 = yytnamerr (YY_NULLPTR, yytname[yytoken]);
-  YYSIZE_T yysize = yysize0;
-  enum { YYERROR_VERBOSE_ARGS_MAXIMUM = 5 };
-  /* Internationalized format string. */
-  const char *yyformat = YY_NULLPTR;
-  /* Arguments of yyformat. */
-  char const *yyarg[YYERROR_VERBOSE_ARGS_MAXIMUM];
-  /* Number of reported tokens (one for the "unexpected", one per
-     "expected"). */
-  int yycount = 0;
-
-  /* There are many possibilities here to consider:
-     - If this state is a consistent state with a default action, then
-       the only way this function was invoked is if the default action
-       is an error action.  In that case, don't check for expected
-       tokens because there are none.
-     - The only way there can be no lookahead present (in yychar) is if
-       this state is a consistent state with a default action.  Thus,
-       detecting the absence of a lookahead is sufficient to determine
-       that there is no unexpected or expected token to report.  In that
-       case, just report a simple "syntax error".
-     - Don't assume there isn't a lookahead just because this state is a
-       consistent state with a default action.  There might have been a
-       previous inconsistent state, consistent state with a non-default
-       action, or user semantic action that manipulated yychar.
-     - Of course, the expected token list depends on states to have
-       correct lookahead information, and it depends on the parser not
-       to perform extra reductions after fetching a lookahead from the
-       scanner and before detecting a syntax error.  Thus, state merging
-       (from LALR or IELR) and default reductions corrupt the expected
-       token list.  However, the list is correct for canonical LR with
-       one exception: it will still contain any token that will not be
-       accepted due to an error action in a later state.
-  */
-  if (yytoken != YYEMPTY)
-    {
-      int yyn = yypact[*yyssp];
-      yyarg[yycount++] = yytname[yytoken];
-      if (!yypact_value_is_default (yyn))
-        {
-          /* Start YYX at -YYN if negative to avoid negative indexes in
-             YYCHECK.  In other words, skip the first -YYN actions for
-             this state because they are default actions.  */
-          int yyxbegin = yyn < 0 ? -yyn : 0;
-          /* Stay within bounds of both yycheck and yytname.  */
-          int yychecklim = YYLAST - yyn + 1;
-          int yyxend = yychecklim < YYNTOKENS ? yychecklim : YYNTOKENS;
-          int yyx;
-
-          for (yyx = yyxbegin; yyx < yyxend; ++yyx)
-            if (yycheck[yyx + yyn] == yyx && yyx != YYTERROR
-                && !yytable_value_is_error (yytable[yyx + yyn]))
-              {
-                if (yycount == YYERROR_VERBOSE_ARGS_MAXIMUM)
-                  {
-                    yycount = 1;
-                    yysize = yysize0;
-                    break;
-                  }
-                yyarg[yycount++] = yytname[yyx];
-                {
-                  YYSIZE_T yysize1 = yysize + yytnamerr (YY_NULLPTR, yytname[yyx]);
-                  if (! (yysize <= yysize1
-                         && yysize1 <= YYSTACK_ALLOC_MAXIMUM))
-                    return 2;
-                  yysize = yysize1;
-                }
-              }
-        }
-    }
-
-  switch (yycount)
-    {
-# define YYCASE_(N, S)                      \
-      case N:                               \
-        yyformat = S;                       \
-      break
-      YYCASE_(0, YY_("syntax error"));
-      YYCASE_(1, YY_("syntax error, unexpected %s"));
-      YYCASE_(2, YY_("syntax error, unexpected %s, expecting %s"));
-      YYCASE_(3, YY_("syntax error, unexpected %s, expecting %s or %s"));
-      YYCASE_(4, YY_("syntax error, unexpected %s, expecting %s or %s or %s"));
-      YYCASE_(5, YY_("syntax error, unexpected %s, expecting %s or %s or %s or %s"));
-# undef YYCASE_
-    }
-
-  {
-    YYSIZE_T yysize1 = yysize + yystrlen (yyformat);
-    if (! (yysize <= yysize1 && yysize1 <= YYSTACK_ALLOC_MAXIMUM))
-      return 2;
-    yysize = yysize1;
-  }
-
-  if (*yymsg_alloc < yysize)
-    {
-      *yymsg_alloc = 2 * yysize;
-      if (! (yysize <= *yymsg_alloc
-             && *yymsg_alloc <= YYSTACK_ALLOC_MAXIMUM))
-        *yymsg_alloc = YYSTACK_ALLOC_MAXIMUM;
-      return 1;
-    }
-
-  /* Avoid sprintf, as that infringes on the user's name space.
-     Don't have undefined behavior even if the translation
-     produced a string with the wrong number of "%s"s.  */
-  {
-    char *yyp = *yymsg;
-    int yyi = 0;
-    while ((*yyp = *yyformat) != '\0')
-      if (*yyp == '%' && yyformat[1] == 's' && yyi < yycount)
-        {
-          yyp += yytnamerr (yyp, yyarg[yyi++]);
-          yyformat += 2;
-        }
-      else
-        {
-          yyp++;
-          yyformat++;
-        }
-  }
-  return 0;
-}
-#endif /* YYERROR_VERBOSE */
 
 /*-----------------------------------------------.
 | Release the memory associated to this symbol.  |
 `-----------------------------------------------*/
 
 static void
-yydestruct (const char *yymsg, int yytype, YYSTYPE *yyvaluep)
+yydestruct (const char *yymsg,
+            yysymbol_kind_t yykind, YYSTYPE *yyvaluep)
 {
-  YYUSE (yyvaluep);
+  YY_USE (yyvaluep);
   if (!yymsg)
     yymsg = "Deleting";
-  YY_SYMBOL_PRINT (yymsg, yytype, yyvaluep, yylocationp);
+  YY_SYMBOL_PRINT (yymsg, yykind, yyvaluep, yylocationp);
 
   YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
-  YYUSE (yytype);
+  YY_USE (yykind);
   YY_IGNORE_MAYBE_UNINITIALIZED_END
 }
 
 
-
-
-/* The lookahead symbol.  */
+/* Lookahead token kind.  */
 int yychar;
 
 /* The semantic value of the lookahead symbol.  */
@@ -1027,6 +957,8 @@ YYSTYPE yylval;
 int yynerrs;
 
 
+
+
 /*----------.
 | yyparse.  |
 `----------*/
@@ -1034,43 +966,36 @@ int yynerrs;
 int
 yyparse (void)
 {
-    int yystate;
+    yy_state_fast_t yystate = 0;
     /* Number of tokens to shift before error messages enabled.  */
-    int yyerrstatus;
+    int yyerrstatus = 0;
 
-    /* The stacks and their tools:
-       'yyss': related to states.
-       'yyvs': related to semantic values.
-
-       Refer to the stacks through separate pointers, to allow yyoverflow
+    /* Refer to the stacks through separate pointers, to allow yyoverflow
        to reallocate them elsewhere.  */
 
-    /* The state stack.  */
-    yytype_int16 yyssa[YYINITDEPTH];
-    yytype_int16 *yyss;
-    yytype_int16 *yyssp;
+    /* Their size.  */
+    YYPTRDIFF_T yystacksize = YYINITDEPTH;
 
-    /* The semantic value stack.  */
-    YYSTYPE yyvsa[YYINITDEPTH];
-    YYSTYPE *yyvs;
-    YYSTYPE *yyvsp;
+    /* The state stack: array, bottom, top.  */
+    yy_state_t yyssa[YYINITDEPTH];
+    yy_state_t *yyss = yyssa;
+    yy_state_t *yyssp = yyss;
 
-    YYSIZE_T yystacksize;
+    /* The semantic value stack: array, bottom, top.  */
+    YYSTYPE yyvsa[YYINITDEPTH];
+    YYSTYPE *yyvs = yyvsa;
+    YYSTYPE *yyvsp = yyvs;
 
   int yyn;
+  /* The return value of yyparse.  */
   int yyresult;
-  /* Lookahead token as an internal (translated) token number.  */
-  int yytoken = 0;
+  /* Lookahead symbol kind.  */
+  yysymbol_kind_t yytoken = YYSYMBOL_YYEMPTY;
   /* The variables used to return semantic value and location from the
      action routines.  */
   YYSTYPE yyval;
 
-#if YYERROR_VERBOSE
-  /* Buffer for error messages, and its allocated size.  */
-  char yymsgbuf[128];
-  char *yymsg = yymsgbuf;
-  YYSIZE_T yymsg_alloc = sizeof yymsgbuf;
-#endif
+
 
 #define YYPOPSTACK(N)   (yyvsp -= (N), yyssp -= (N))
 
@@ -1078,71 +1003,75 @@ yyparse (void)
      Keep to zero when no symbol should be popped.  */
   int yylen = 0;
 
-  yyssp = yyss = yyssa;
-  yyvsp = yyvs = yyvsa;
-  yystacksize = YYINITDEPTH;
-
   YYDPRINTF ((stderr, "Starting parse\n"));
 
-  yystate = 0;
-  yyerrstatus = 0;
-  yynerrs = 0;
   yychar = YYEMPTY; /* Cause a token to be read.  */
+
   goto yysetstate;
 
+
 /*------------------------------------------------------------.
-| yynewstate -- Push a new state, which is found in yystate.  |
+| yynewstate -- push a new state, which is found in yystate.  |
 `------------------------------------------------------------*/
- yynewstate:
+yynewstate:
   /* In all cases, when you get here, the value and location stacks
      have just been pushed.  So pushing a state here evens the stacks.  */
   yyssp++;
 
- yysetstate:
-  *yyssp = yystate;
+
+/*--------------------------------------------------------------------.
+| yysetstate -- set current state (the top of the stack) to yystate.  |
+`--------------------------------------------------------------------*/
+yysetstate:
+  YYDPRINTF ((stderr, "Entering state %d\n", yystate));
+  YY_ASSERT (0 <= yystate && yystate < YYNSTATES);
+  YY_IGNORE_USELESS_CAST_BEGIN
+  *yyssp = YY_CAST (yy_state_t, yystate);
+  YY_IGNORE_USELESS_CAST_END
+  YY_STACK_PRINT (yyss, yyssp);
 
   if (yyss + yystacksize - 1 <= yyssp)
+#if !defined yyoverflow && !defined YYSTACK_RELOCATE
+    YYNOMEM;
+#else
     {
       /* Get the current used size of the three stacks, in elements.  */
-      YYSIZE_T yysize = yyssp - yyss + 1;
+      YYPTRDIFF_T yysize = yyssp - yyss + 1;
 
-#ifdef yyoverflow
+# if defined yyoverflow
       {
         /* Give user a chance to reallocate the stack.  Use copies of
            these so that the &'s don't force the real ones into
            memory.  */
+        yy_state_t *yyss1 = yyss;
         YYSTYPE *yyvs1 = yyvs;
-        yytype_int16 *yyss1 = yyss;
 
         /* Each stack pointer address is followed by the size of the
            data in use in that stack, in bytes.  This used to be a
            conditional around just the two extra args, but that might
            be undefined if yyoverflow is a macro.  */
         yyoverflow (YY_("memory exhausted"),
-                    &yyss1, yysize * sizeof (*yyssp),
-                    &yyvs1, yysize * sizeof (*yyvsp),
+                    &yyss1, yysize * YYSIZEOF (*yyssp),
+                    &yyvs1, yysize * YYSIZEOF (*yyvsp),
                     &yystacksize);
-
         yyss = yyss1;
         yyvs = yyvs1;
       }
-#else /* no yyoverflow */
-# ifndef YYSTACK_RELOCATE
-      goto yyexhaustedlab;
-# else
+# else /* defined YYSTACK_RELOCATE */
       /* Extend the stack our own way.  */
       if (YYMAXDEPTH <= yystacksize)
-        goto yyexhaustedlab;
+        YYNOMEM;
       yystacksize *= 2;
       if (YYMAXDEPTH < yystacksize)
         yystacksize = YYMAXDEPTH;
 
       {
-        yytype_int16 *yyss1 = yyss;
+        yy_state_t *yyss1 = yyss;
         union yyalloc *yyptr =
-          (union yyalloc *) YYSTACK_ALLOC (YYSTACK_BYTES (yystacksize));
+          YY_CAST (union yyalloc *,
+                   YYSTACK_ALLOC (YY_CAST (YYSIZE_T, YYSTACK_BYTES (yystacksize))));
         if (! yyptr)
-          goto yyexhaustedlab;
+          YYNOMEM;
         YYSTACK_RELOCATE (yyss_alloc, yyss);
         YYSTACK_RELOCATE (yyvs_alloc, yyvs);
 #  undef YYSTACK_RELOCATE
@@ -1150,30 +1079,31 @@ yyparse (void)
           YYSTACK_FREE (yyss1);
       }
 # endif
-#endif /* no yyoverflow */
 
       yyssp = yyss + yysize - 1;
       yyvsp = yyvs + yysize - 1;
 
-      YYDPRINTF ((stderr, "Stack size increased to %lu\n",
-                  (unsigned long int) yystacksize));
+      YY_IGNORE_USELESS_CAST_BEGIN
+      YYDPRINTF ((stderr, "Stack size increased to %ld\n",
+                  YY_CAST (long, yystacksize)));
+      YY_IGNORE_USELESS_CAST_END
 
       if (yyss + yystacksize - 1 <= yyssp)
         YYABORT;
     }
+#endif /* !defined yyoverflow && !defined YYSTACK_RELOCATE */
 
-  YYDPRINTF ((stderr, "Entering state %d\n", yystate));
 
   if (yystate == YYFINAL)
     YYACCEPT;
 
   goto yybackup;
 
+
 /*-----------.
 | yybackup.  |
 `-----------*/
 yybackup:
-
   /* Do appropriate processing given the current state.  Read a
      lookahead token if we need one and don't already have one.  */
 
@@ -1184,18 +1114,29 @@ yybackup:
 
   /* Not known => get a lookahead token if don't already have one.  */
 
-  /* YYCHAR is either YYEMPTY or YYEOF or a valid lookahead symbol.  */
+  /* YYCHAR is either empty, or end-of-input, or a valid lookahead.  */
   if (yychar == YYEMPTY)
     {
-      YYDPRINTF ((stderr, "Reading a token: "));
+      YYDPRINTF ((stderr, "Reading a token\n"));
       yychar = yylex ();
     }
 
   if (yychar <= YYEOF)
     {
-      yychar = yytoken = YYEOF;
+      yychar = YYEOF;
+      yytoken = YYSYMBOL_YYEOF;
       YYDPRINTF ((stderr, "Now at end of input.\n"));
     }
+  else if (yychar == YYerror)
+    {
+      /* The scanner already issued an error message, process directly
+         to error recovery.  But do not keep the error token as
+         lookahead, it is too special and may lead us to an endless
+         loop in error recovery. */
+      yychar = YYUNDEF;
+      yytoken = YYSYMBOL_YYerror;
+      goto yyerrlab1;
+    }
   else
     {
       yytoken = YYTRANSLATE (yychar);
@@ -1223,15 +1164,13 @@ yybackup:
 
   /* Shift the lookahead token.  */
   YY_SYMBOL_PRINT ("Shifting", yytoken, &yylval, &yylloc);
-
-  /* Discard the shifted token.  */
-  yychar = YYEMPTY;
-
   yystate = yyn;
   YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
   *++yyvsp = yylval;
   YY_IGNORE_MAYBE_UNINITIALIZED_END
 
+  /* Discard the shifted token.  */
+  yychar = YYEMPTY;
   goto yynewstate;
 
 
@@ -1246,7 +1185,7 @@ yydefault:
 
 
 /*-----------------------------.
-| yyreduce -- Do a reduction.  |
+| yyreduce -- do a reduction.  |
 `-----------------------------*/
 yyreduce:
   /* yyn is the number of a rule to reduce with.  */
@@ -1266,130 +1205,145 @@ yyreduce:
   YY_REDUCE_PRINT (yyn);
   switch (yyn)
     {
-        case 2:
-#line 67 "policy_lang.y" /* yacc.c:1646  */
-    { final_policy = (yyvsp[0].tree); }
-#line 1273 "policy_lang.c" /* yacc.c:1646  */
+  case 2: /* result: policy  */
+#line 86 "policy_lang.y"
+               { final_policy = (yyvsp[0].tree); }
+#line 1212 "policy_lang.c"
+    break;
+
+  case 3: /* number: INTLIT '#' INTLIT  */
+#line 88 "policy_lang.y"
+                                     { (yyval.sint) = expint((yyvsp[-2].nat), (yyvsp[0].nat)); }
+#line 1218 "policy_lang.c"
     break;
 
-  case 3:
-#line 69 "policy_lang.y" /* yacc.c:1646  */
-    { (yyval.sint) = expint((yyvsp[-2].nat), (yyvsp[0].nat)); }
-#line 1279 "policy_lang.c" /* yacc.c:1646  */
+  case 4: /* number: INTLIT  */
+#line 89 "policy_lang.y"
+                                     { (yyval.sint) = flexint((yyvsp[0].nat));    }
+#line 1224 "policy_lang.c"
     break;
 
-  case 4:
-#line 70 "policy_lang.y" /* yacc.c:1646  */
-    { (yyval.sint) = flexint((yyvsp[0].nat));    }
-#line 1285 "policy_lang.c" /* yacc.c:1646  */
+  case 5: /* number: HOLE '#' INTLIT  */
+#line 90 "policy_lang.y"
+                                     { (yyval.sint) = expint(0, (yyvsp[0].nat));
+                                       (yyval.sint)->hole = (yyvsp[-2].str);       }
+#line 1231 "policy_lang.c"
     break;
 
-  case 5:
-#line 72 "policy_lang.y" /* yacc.c:1646  */
-    { (yyval.tree) = leaf_policy((yyvsp[0].str));        }
-#line 1291 "policy_lang.c" /* yacc.c:1646  */
+  case 6: /* number: HOLE  */
+#line 92 "policy_lang.y"
+                                     { (yyval.sint) = flexint(0);
+                                       (yyval.sint)->hole = (yyvsp[0].str);       }
+#line 1238 "policy_lang.c"
     break;
 
-  case 6:
-#line 73 "policy_lang.y" /* yacc.c:1646  */
-    { (yyval.tree) = kof2_policy(1, (yyvsp[-2].tree), (yyvsp[0].tree)); }
-#line 1297 "policy_lang.c" /* yacc.c:1646  */
+  case 7: /* policy: TAG  */
+#line 95 "policy_lang.y"
+                                     { (yyval.tree) = leaf_policy((yyvsp[0].str));        }
+#line 1244 "policy_lang.c"
     break;
 
-  case 7:
-#line 74 "policy_lang.y" /* yacc.c:1646  */
-    { (yyval.tree) = kof2_policy(2, (yyvsp[-2].tree), (yyvsp[0].tree)); }
-#line 1303 "policy_lang.c" /* yacc.c:1646  */
+  case 8: /* policy: policy OR policy  */
+#line 96 "policy_lang.y"
+                                     { (yyval.tree) = kof2_policy(1, (yyvsp[-2].tree), (yyvsp[0].tree)); }
+#line 1250 "policy_lang.c"
     break;
 
-  case 8:
-#line 75 "policy_lang.y" /* yacc.c:1646  */
-    { (yyval.tree) = kof_policy((yyvsp[-4].nat), (yyvsp[-1].list));     }
-#line 1309 "policy_lang.c" /* yacc.c:1646  */
+  case 9: /* policy: policy AND policy  */
+#line 97 "policy_lang.y"
+                                     { (yyval.tree) = kof2_policy(2, (yyvsp[-2].tree), (yyvsp[0].tree)); }
+#line 1256 "policy_lang.c"
     break;
 
-  case 9:
-#line 76 "policy_lang.y" /* yacc.c:1646  */
-    { (yyval.tree) = eq_policy((yyvsp[0].sint), (yyvsp[-2].str));      }
-#line 1315 "policy_lang.c" /* yacc.c:1646  */
+  case 10: /* policy: INTLIT OF '(' arg_list ')'  */
+#line 98 "policy_lang.y"
+                                     { (yyval.tree) = kof_policy((yyvsp[-4].nat), (yyvsp[-1].list));     }
+#line 1262 "policy_lang.c"
     break;
 
-  case 10:
-#line 77 "policy_lang.y" /* yacc.c:1646  */
-    { (yyval.tree) = lt_policy((yyvsp[0].sint), (yyvsp[-2].str));      }
-#line 1321 "policy_lang.c" /* yacc.c:1646  */
+  case 11: /* policy: TAG '=' number  */
+#line 99 "policy_lang.y"
+                                     { (yyval.tree) = eq_policy((yyvsp[0].sint), (yyvsp[-2].str));      }
+#line 1268 "policy_lang.c"
     break;
 
-  case 11:
-#line 78 "policy_lang.y" /* yacc.c:1646  */
-    { (yyval.tree) = gt_policy((yyvsp[0].sint), (yyvsp[-2].str));      }
-#line 1327 "policy_lang.c" /* yacc.c:1646  */
+  case 12: /* policy: TAG '<' number  */
+#line 100 "policy_lang.y"
+                                     { (yyval.tree) = lt_policy((yyvsp[0].sint), (yyvsp[-2].str));      }
+#line 1274 "policy_lang.c"
     break;
 
-  case 12:
-#line 79 "policy_lang.y" /* yacc.c:1646  */
-    { (yyval.tree) = le_policy((yyvsp[0].sint), (yyvsp[-2].str));      }
-#line 1333 "policy_lang.c" /* yacc.c:1646  */
+  case 13: /* policy: TAG '>' number  */
+#line 101 "policy_lang.y"
+                                     { (yyval.tree) = gt_policy((yyvsp[0].sint), (yyvsp[-2].str));      }
+#line 1280 "policy_lang.c"
     break;
 
-  case 13:
-#line 80 "policy_lang.y" /* yacc.c:1646  */
-    { (yyval.tree) = ge_policy((yyvsp[0].sint), (yyvsp[-2].str));      }
-#line 1339 "policy_lang.c" /* yacc.c:1646  */
+  case 14: /* policy: TAG LEQ number  */
+#line 102 "policy_lang.y"
+                                     { (yyval.tree) = le_policy((yyvsp[0].sint), (yyvsp[-2].str));      }
+#line 1286 "policy_lang.c"
     break;
 
-  case 14:
-#line 81 "policy_lang.y" /* yacc.c:1646  */
-    { (yyval.tree) = eq_policy((yyvsp[-2].sint), (yyvsp[0].str));      }
-#line 1345 "policy_lang.c" /* yacc.c:1646  */
+  case 15: /* policy: TAG GEQ number  */
+#line 103 "policy_lang.y"
+                                     { (yyval.tree) = ge_policy((yyvsp[0].sint), (yyvsp[-2].str));      }
+#line 1292 "policy_lang.c"
     break;
 
-  case 15:
-#line 82 "policy_lang.y" /* yacc.c:1646  */
-    { (yyval.tree) = gt_policy((yyvsp[-2].sint), (yyvsp[0].str));      }
-#line 1351 "policy_lang.c" /* yacc.c:1646  */
+  case 16: /* policy: number '=' TAG  */
+#line 104 "policy_lang.y"
+                                     { (yyval.tree) = eq_policy((yyvsp[-2].sint), (yyvsp[0].str));      }
+#line 1298 "policy_lang.c"
     break;
 
-  case 16:
-#line 83 "policy_lang.y" /* yacc.c:1646  */
-    { (yyval.tree) = lt_policy((yyvsp[-2].sint), (yyvsp[0].str));      }
-#line 1357 "policy_lang.c" /* yacc.c:1646  */
+  case 17: /* policy: number '<' TAG  */
+#line 105 "policy_lang.y"
+                                     { (yyval.tree) = gt_policy((yyvsp[-2].sint), (yyvsp[0].str));      }
+#line 1304 "policy_lang.c"
     break;
 
-  case 17:
-#line 84 "policy_lang.y" /* yacc.c:1646  */
-    { (yyval.tree) = ge_policy((yyvsp[-2].sint), (yyvsp[0].str));      }
-#line 1363 "policy_lang.c" /* yacc.c:1646  */
+  case 18: /* policy: number '>' TAG  */
+#line 106 "policy_lang.y"
+                                     { (yyval.tree) = lt_policy((yyvsp[-2].sint), (yyvsp[0].str));      }
+#line 1310 "policy_lang.c"
     break;
 
-  case 18:
-#line 85 "policy_lang.y" /* yacc.c:1646  */
-    { (yyval.tree) = le_policy((yyvsp[-2].sint), (yyvsp[0].str));      }
-#line 1369 "policy_lang.c" /* yacc.c:1646  */
+  case 19: /* policy: number LEQ TAG  */
+#line 107 "policy_lang.y"
+                                     { (yyval.tree) = ge_policy((yyvsp[-2].sint), (yyvsp[0].str));      }
+#line 1316 "policy_lang.c"
     break;
 
-  case 19:
-#line 86 "policy_lang.y" /* yacc.c:1646  */
-    { (yyval.tree) = (yyvsp[-1].tree);                     }
-#line 1375 "policy_lang.c" /* yacc.c:1646  */
+  case 20: /* policy: number GEQ TAG  */
+#line 108 "policy_lang.y"
+                                     { (yyval.tree) = le_policy((yyvsp[-2].sint), (yyvsp[0].str));      }
+#line 1322 "policy_lang.c"
     break;
 
-  case 20:
-#line 88 "policy_lang.y" /* yacc.c:1646  */
-    { (yyval.list) = g_ptr_array_new();
+  case 21: /* policy: '(' policy ')'  */
+#line 109 "policy_lang.y"
+                                     { (yyval.tree) = (yyvsp[-1].tree);                     }
+#line 1328 "policy_lang.c"
+    break;
+
+  case 22: /* arg_list: policy  */
+#line 111 "policy_lang.y"
+                                     { (yyval.list) = g_ptr_array_new();
                                        g_ptr_array_add((yyval.list), (yyvsp[0].tree)); }
-#line 1382 "policy_lang.c" /* yacc.c:1646  */
+#line 1335 "policy_lang.c"
     break;
 
-  case 21:
-#line 90 "policy_lang.y" /* yacc.c:1646  */
-    { (yyval.list) = (yyvsp[-2].list);
+  case 23: /* arg_list: arg_list ',' policy  */
+#line 113 "policy_lang.y"
+                                     { (yyval.list) = (yyvsp[-2].list);
                                        g_ptr_array_add((yyval.list), (yyvsp[0].tree)); }
-#line 1389 "policy_lang.c" /* yacc.c:1646  */
+#line 1342 "policy_lang.c"
     break;
 
 
-#line 1393 "policy_lang.c" /* yacc.c:1646  */
+#line 1346 "policy_lang.c"
+
       default: break;
     }
   /* User semantic actions sometimes alter yychar, and that requires
@@ -1403,25 +1357,23 @@ yyreduce:
      case of YYERROR or YYBACKUP, subsequent parser actions might lead
      to an incorrect destructor call or verbose syntax error message
      before the lookahead is translated.  */
-  YY_SYMBOL_PRINT ("-> $$ =", yyr1[yyn], &yyval, &yyloc);
+  YY_SYMBOL_PRINT ("-> $$ =", YY_CAST (yysymbol_kind_t, yyr1[yyn]), &yyval, &yyloc);
 
   YYPOPSTACK (yylen);
   yylen = 0;
-  YY_STACK_PRINT (yyss, yyssp);
 
   *++yyvsp = yyval;
 
   /* Now 'shift' the result of the reduction.  Determine what state
      that goes to, based on the state we popped back to and the rule
      number reduced by.  */
-
-  yyn = yyr1[yyn];
-
-  yystate = yypgoto[yyn - YYNTOKENS] + *yyssp;
-  if (0 <= yystate && yystate <= YYLAST && yycheck[yystate] == *yyssp)
-    yystate = yytable[yystate];
-  else
-    yystate = yydefgoto[yyn - YYNTOKENS];
+  {
+    const int yylhs = yyr1[yyn] - YYNTOKENS;
+    const int yyi = yypgoto[yylhs] + *yyssp;
+    yystate = (0 <= yyi && yyi <= YYLAST && yycheck[yyi] == *yyssp
+               ? yytable[yyi]
+               : yydefgoto[yylhs]);
+  }
 
   goto yynewstate;
 
@@ -1432,50 +1384,14 @@ yyreduce:
 yyerrlab:
   /* Make sure we have latest lookahead translation.  See comments at
      user semantic actions for why this is necessary.  */
-  yytoken = yychar == YYEMPTY ? YYEMPTY : YYTRANSLATE (yychar);
-
+  yytoken = yychar == YYEMPTY ? YYSYMBOL_YYEMPTY : YYTRANSLATE (yychar);
   /* If not already recovering from an error, report this error.  */
   if (!yyerrstatus)
     {
       ++yynerrs;
-#if ! YYERROR_VERBOSE
       yyerror (YY_("syntax error"));
-#else
-# define YYSYNTAX_ERROR yysyntax_error (&yymsg_alloc, &yymsg, \
-                                        yyssp, yytoken)
-      {
-        char const *yymsgp = YY_("syntax error");
-        int yysyntax_error_status;
-        yysyntax_error_status = YYSYNTAX_ERROR;
-        if (yysyntax_error_status == 0)
-          yymsgp = yymsg;
-        else if (yysyntax_error_status == 1)
-          {
-            if (yymsg != yymsgbuf)
-              YYSTACK_FREE (yymsg);
-            yymsg = (char *) YYSTACK_ALLOC (yymsg_alloc);
-            if (!yymsg)
-              {
-                yymsg = yymsgbuf;
-                yymsg_alloc = sizeof yymsgbuf;
-                yysyntax_error_status = 2;
-              }
-            else
-              {
-                yysyntax_error_status = YYSYNTAX_ERROR;
-                yymsgp = yymsg;
-              }
-          }
-        yyerror (yymsgp);
-        if (yysyntax_error_status == 2)
-          goto yyexhaustedlab;
-      }
-# undef YYSYNTAX_ERROR
-#endif
     }
 
-
-
   if (yyerrstatus == 3)
     {
       /* If just tried and failed to reuse lookahead token after an
@@ -1504,12 +1420,11 @@ yyerrlab:
 | yyerrorlab -- error raised explicitly by YYERROR.  |
 `---------------------------------------------------*/
 yyerrorlab:
-
-  /* Pacify compilers like GCC when the user code never invokes
-     YYERROR and the label yyerrorlab therefore never appears in user
-     code.  */
-  if (/*CONSTCOND*/ 0)
-     goto yyerrorlab;
+  /* Pacify compilers when the user code never invokes YYERROR and the
+     label yyerrorlab therefore never appears in user code.  */
+  if (0)
+    YYERROR;
+  ++yynerrs;
 
   /* Do not reclaim the symbols of the rule whose action triggered
      this YYERROR.  */
@@ -1526,13 +1441,14 @@ yyerrorlab:
 yyerrlab1:
   yyerrstatus = 3;      /* Each real token shifted decrements this.  */
 
+  /* Pop stack until we find a state that shifts the error token.  */
   for (;;)
     {
       yyn = yypact[yystate];
       if (!yypact_value_is_default (yyn))
         {
-          yyn += YYTERROR;
-          if (0 <= yyn && yyn <= YYLAST && yycheck[yyn] == YYTERROR)
+          yyn += YYSYMBOL_YYerror;
+          if (0 <= yyn && yyn <= YYLAST && yycheck[yyn] == YYSYMBOL_YYerror)
             {
               yyn = yytable[yyn];
               if (0 < yyn)
@@ -1546,7 +1462,7 @@ yyerrlab1:
 
 
       yydestruct ("Error: popping",
-                  yystos[yystate], yyvsp);
+                  YY_ACCESSING_SYMBOL (yystate), yyvsp);
       YYPOPSTACK (1);
       yystate = *yyssp;
       YY_STACK_PRINT (yyss, yyssp);
@@ -1558,7 +1474,7 @@ yyerrlab1:
 
 
   /* Shift the error token.  */
-  YY_SYMBOL_PRINT ("Shifting", yystos[yyn], yyvsp, yylsp);
+  YY_SYMBOL_PRINT ("Shifting", YY_ACCESSING_SYMBOL (yyn), yyvsp, yylsp);
 
   yystate = yyn;
   goto yynewstate;
@@ -1569,26 +1485,30 @@ yyerrlab1:
 `-------------------------------------*/
 yyacceptlab:
   yyresult = 0;
-  goto yyreturn;
+  goto yyreturnlab;
+
 
 /*-----------------------------------.
 | yyabortlab -- YYABORT comes here.  |
 `-----------------------------------*/
 yyabortlab:
   yyresult = 1;
-  goto yyreturn;
+  goto yyreturnlab;
 
-#if !defined yyoverflow || YYERROR_VERBOSE
-/*-------------------------------------------------.
-| yyexhaustedlab -- memory exhaustion comes here.  |
-`-------------------------------------------------*/
+
+/*-----------------------------------------------------------.
+| yyexhaustedlab -- YYNOMEM (memory exhaustion) comes here.  |
+`-----------------------------------------------------------*/
 yyexhaustedlab:
   yyerror (YY_("memory exhausted"));
   yyresult = 2;
-  /* Fall through.  */
-#endif
+  goto yyreturnlab;
+
 
-yyreturn:
+/*----------------------------------------------------------.
+| yyreturnlab -- parsing is finished, clean up and return.  |
+`----------------------------------------------------------*/
+yyreturnlab:
   if (yychar != YYEMPTY)
     {
       /* Make sure we have latest lookahead translation.  See comments at
@@ -1604,20 +1524,18 @@ yyreturn:
   while (yyssp != yyss)
     {
       yydestruct ("Cleanup: popping",
-                  yystos[*yyssp], yyvsp);
+                  YY_ACCESSING_SYMBOL (+*yyssp), yyvsp);
       YYPOPSTACK (1);
     }
 #ifndef yyoverflow
   if (yyss != yyssa)
     YYSTACK_FREE (yyss);
 #endif
-#if YYERROR_VERBOSE
-  if (yymsg != yymsgbuf)
-    YYSTACK_FREE (yymsg);
-#endif
+
   return yyresult;
 }
-#line 94 "policy_lang.y" /* yacc.c:1906  */
+
+#line 117 "policy_lang.y"
 
 
 sized_integer_t*
@@ -1635,6 +1553,7 @@ expint( uint64_t value, uint64_t bits )
 	s = malloc(sizeof(sized_integer_t));
 	s->value = value;
 	s->bits = bits;
+	s->hole = 0;
 
 	return s;
 }
@@ -1647,6 +1566,7 @@ flexint( uint64_t value )
 	s = malloc(sizeof(sized_integer_t));
 	s->value = value;
 	s->bits = 0;
+	s->hole = 0;
 
 	return s;
 }
@@ -1658,6 +1578,14 @@ policy_free( cpabe_policy_t* p )
 
 	if( p->attr )
 		free(p->attr);
+	if( p->postfix )
+		free(p->postfix);
+	if( p->hole )
+	{
+		free(p->hole->name);
+		free(p->hole->attr);
+		free(p->hole);
+	}
 
 	for( i = 0; i < p->children->len; i++ )
 		policy_free(g_ptr_array_index(p->children, i));
@@ -1675,6 +1603,8 @@ leaf_policy( char* attr )
 	p->k = 1;
 	p->attr = attr;
 	p->children = g_ptr_array_new();
+	p->hole = 0;
+	p->postfix = 0;
 
 	return p;
 }
@@ -1688,6 +1618,8 @@ kof2_policy( int k, cpabe_policy_t* l, cpabe_policy_t* r )
 	p->k = k;
 	p->attr = 0;
 	p->children = g_ptr_array_new();
+	p->hole = 0;
+	p->postfix = 0;
 	g_ptr_array_add(p->children, l);
 	g_ptr_array_add(p->children, r);
 
@@ -1711,6 +1643,8 @@ kof_policy( int k, GPtrArray* list )
 	p->k = k;
 	p->attr = 0;
 	p->children = list;
+	p->hole = 0;
+	p->postfix = 0;
 
 	return p;
 }
@@ -1731,9 +1665,32 @@ bit_marker( char* base, char* tplate, int bit, char val )
 	return s;
 }
 
+/*
+	Stands in for the comparison of attr against n until a template is
+	instantiated. The attribute string only serves to sort it in tidy().
+*/
+cpabe_policy_t*
+hole_policy( sized_integer_t* n, int op, char* attr )
+{
+	cpabe_policy_t* p;
+
+	p = leaf_policy(g_strdup_printf("$%s", n->hole));
+	p->hole = (policy_hole_t*) malloc(sizeof(policy_hole_t));
+	p->hole->name = n->hole;
+	p->hole->bits = n->bits;
+	p->hole->op = op;
+	p->hole->attr = attr;
+	num_holes++;
+
+	return p;
+}
+
 cpabe_policy_t*
 eq_policy( sized_integer_t* n, char* attr )
 {
+	if( n->hole )
+		return hole_policy(n, '=', attr);
+
 	if( n->bits == 0 )
 		return leaf_policy
 			(g_strdup_printf("%s_flexint_%llu", attr, n->value));
@@ -1775,6 +1732,8 @@ flexint_leader( int gt, char* attr, uint64_t value )
 	p = (cpabe_policy_t*) malloc(sizeof(cpabe_policy_t));
 	p->attr = 0;
 	p->children = g_ptr_array_new();
+	p->hole = 0;
+	p->postfix = 0;
 
 	for( k = 2; k <= 32; k *= 2 )
 		if( ( gt && ((uint64_t)1<<k) >  value) ||
@@ -1851,18 +1810,24 @@ cmp_policy( sized_integer_t* n, int gt, char* attr )
 cpabe_policy_t*
 lt_policy( sized_integer_t* n, char* attr )
 {
+	if( n->hole )
+		return hole_policy(n, '<', attr);
 	return cmp_policy(n, 0, attr);
 }
 
 cpabe_policy_t*
 gt_policy( sized_integer_t* n, char* attr )
 {
+	if( n->hole )
+		return hole_policy(n, '>', attr);
 	return cmp_policy(n, 1, attr);
 }
 
 cpabe_policy_t*
 le_policy( sized_integer_t* n, char* attr )
 {
+	if( n->hole )
+		return hole_policy(n, LEQ, attr);
 	n->value++;
 	return cmp_policy(n, 0, attr);
 }
@@ -1870,6 +1835,8 @@ le_policy( sized_integer_t* n, char* attr )
 cpabe_policy_t*
 ge_policy( sized_integer_t* n, char* attr )
 {
+	if( n->hole )
+		return hole_policy(n, GEQ, attr);
 	n->value--;
 	return cmp_policy(n, 1, attr);
 }
@@ -1920,6 +1887,18 @@ yylex()
 		g_string_free(s, 1);
 		r = INTLIT;
 	}
+	else if( c == '$' && (isalpha(PEEK_CHAR) || PEEK_CHAR == '_') )
+	{
+		GString* s;
+
+		s = g_string_new("");
+		while( isalnum(PEEK_CHAR) || PEEK_CHAR == '_' )
+			g_string_append_c(s, NEXT_CHAR);
+
+		yylval.str = s->str;
+		g_string_free(s, 0);
+		r = HOLE;
+	}
 	else if( isalpha(c) )
 	{
 		GString* s;
@@ -2047,7 +2026,9 @@ format_policy_postfix( cpabe_policy_t* p )
 	char* s;
 	char* t;
 
-	if( p->children->len == 0 )
+	if( p->postfix )
+		return strdup(p->postfix);
+	else if( p->children->len == 0 )
 		return strdup(p->attr);
 
 	r = format_policy_postfix(g_ptr_array_index(p->children, 0));
@@ -2152,8 +2133,11 @@ parse_policy_lang( char* s )
 	char* parsed_policy;
 
 	cur_string = s;
+	num_holes = 0;
 
 	yyparse();
+	if( num_holes )
+		die("error parsing policy: placeholders are only allowed in templates\n");
  	simplify(final_policy);
  	tidy(final_policy);
 	parsed_policy = format_policy_postfix(final_policy);
@@ -2162,3 +2146,305 @@ parse_policy_lang( char* s )
 
 	return parsed_policy;
 }
+
+/* returns nonzero if p has no placeholders, caching its postfix if so */
+int
+cache_postfix( cpabe_policy_t* p )
+{
+	int i;
+	int complete;
+
+	complete = !p->hole;
+	for( i = 0; i < p->children->len; i++ )
+		if( !cache_postfix(g_ptr_array_index(p->children, i)) )
+			complete = 0;
+
+	if( complete )
+		p->postfix = format_policy_postfix(p);
+
+	return complete;
+}
+
+policy_template_t*
+compile_policy_template( char* s )
+{
+	policy_template_t* t;
+
+	cur_string = s;
+	num_holes = 0;
+
+	yyparse();
+ 	simplify(final_policy);
+ 	tidy(final_policy);
+	cache_postfix(final_policy);
+
+	t = (policy_template_t*) malloc(sizeof(policy_template_t));
+	t->root = final_policy;
+	final_policy = 0;
+
+	return t;
+}
+
+void
+policy_template_free( policy_template_t* t )
+{
+	policy_free(t->root);
+	free(t);
+}
+
+cpabe_policy_t*
+expand_hole( policy_hole_t* h, GHashTable* values )
+{
+	sized_integer_t n;
+	cpabe_policy_t* p;
+	char* v;
+	char* end;
+
+	if( !(v = g_hash_table_lookup(values, h->name)) )
+		die("no value given for placeholder $%s\n", h->name);
+
+	n.value = strtoull(v, &end, 10);
+	n.bits = h->bits;
+	n.hole = 0;
+	if( !isdigit(*v) || *end )
+		die("invalid value \"%s\" for placeholder $%s\n", v, h->name);
+	if( n.bits && n.bits < 64 && n.value >= ((uint64_t)1<<n.bits) )
+		die("value %llu of placeholder $%s too big for %d bits\n",
+				n.value, h->name, n.bits);
+
+	switch( h->op )
+	{
+	case '=': p = eq_policy(&n, h->attr); break;
+	case '<': p = lt_policy(&n, h->attr); break;
+	case '>': p = gt_policy(&n, h->attr); break;
+	case LEQ: p = le_policy(&n, h->attr); break;
+	default:  p = ge_policy(&n, h->attr); break;
+	}
+
+	simplify(p);
+	tidy(p);
+
+	return p;
+}
+
+void
+append_postfix( GString* s, char* t )
+{
+	if( s->len )
+		g_string_append_c(s, ' ');
+	g_string_append(s, t);
+	free(t);
+}
+
+/* a child of a node being instantiated, as tidy() sees it */
+typedef struct
+{
+	char* attr;    /* attribute string if leaf, otherwise null */
+	char* postfix;
+}
+tidy_item_t;
+
+int
+cmp_tidy_item( gconstpointer a, gconstpointer b, gpointer unused )
+{
+	const tidy_item_t* ia;
+	const tidy_item_t* ib;
+
+	ia = a;
+	ib = b;
+
+	if(      !ia->attr &&  ib->attr )
+		return -1;
+	else if(  ia->attr && !ib->attr )
+		return 1;
+	else if(  ia->attr &&  ib->attr )
+		return strcmp(ia->attr, ib->attr);
+	else
+		return 0;
+}
+
+void
+add_item( GArray* items, cpabe_policy_t* c, char* postfix )
+{
+	tidy_item_t it;
+
+	it.attr = c->children->len ? 0 : c->attr;
+	it.postfix = postfix;
+	g_array_append_val(items, it);
+}
+
+char*
+instantiate_node( cpabe_policy_t* p, GHashTable* values )
+{
+	cpabe_policy_t* c;
+	cpabe_policy_t* e;
+	GPtrArray* expanded;
+	GArray* items;
+	GString* s;
+	char* r;
+	int k;
+	int i;
+	int j;
+
+	if( p->postfix )
+		return strdup(p->postfix);
+	else if( p->hole )
+	{
+		e = expand_hole(p->hole, values);
+		r = format_policy_postfix(e);
+		policy_free(e);
+		return r;
+	}
+
+	items = g_array_new(0, 0, sizeof(tidy_item_t));
+	expanded = g_ptr_array_new();
+	k = p->k;
+	for( i = 0; i < p->children->len; i++ )
+	{
+		c = g_ptr_array_index(p->children, i);
+		if( !c->hole )
+		{
+			add_item(items, c, instantiate_node(c, values));
+			continue;
+		}
+
+		/* merge as simplify() would have, had the value been known */
+		e = expand_hole(c->hole, values);
+		g_ptr_array_add(expanded, e);
+		if( (POLICY_IS_OR(p)  && POLICY_IS_OR(e)) ||
+				(POLICY_IS_AND(p) && POLICY_IS_AND(e)) )
+		{
+			if( POLICY_IS_AND(p) )
+				k += e->k - 1;
+			for( j = 0; j < e->children->len; j++ )
+				add_item(items, g_ptr_array_index(e->children, j),
+								 format_policy_postfix(g_ptr_array_index(e->children, j)));
+		}
+		else
+			add_item(items, e, format_policy_postfix(e));
+	}
+
+	/* the leaves only now have their attributes to be sorted by */
+	g_array_sort_with_data(items, cmp_tidy_item, 0);
+
+	s = g_string_new("");
+	for( i = 0; i < items->len; i++ )
+		append_postfix(s, g_array_index(items, tidy_item_t, i).postfix);
+	g_string_append_printf(s, " %dof%d", k, items->len);
+
+	for( i = 0; i < expanded->len; i++ )
+		policy_free(g_ptr_array_index(expanded, i));
+	g_ptr_array_free(expanded, 1);
+	g_array_free(items, 1);
+
+	return g_string_free(s, 0);
+}
+
+char*
+instantiate_policy_template( policy_template_t* t, GHashTable* values )
+{
+	return instantiate_node(t->root, values);
+}
+
+int
+is_comparison( int tok )
+{
+	return tok == '=' || tok == '<' || tok == '>' || tok == LEQ || tok == GEQ;
+}
+
+/*
+	Rewrites s with each number it compares an attribute against replaced
+	by a placeholder $vN, adding N's value to values. Thresholds and bit
+	counts stay as they are.
+*/
+char*
+policy_shape( char* s, GHashTable* values )
+{
+	GArray* toks;
+	GPtrArray* texts;
+	GString* r;
+	char* t;
+	int tok;
+	int n;
+	int i;
+
+#define TOK(i) ((i) >= 0 && (i) < toks->len ? g_array_index(toks, int, i) : 0)
+
+	toks = g_array_new(0, 0, sizeof(int));
+	texts = g_ptr_array_new();
+	cur_string = s;
+	while( (tok = yylex()) )
+	{
+		switch( tok )
+		{
+		case TAG:    t = yylval.str;                              break;
+		case INTLIT: t = g_strdup_printf("%llu", yylval.nat);     break;
+		case HOLE:
+			die("error parsing policy: placeholders are only allowed in templates\n");
+		case AND:    t = strdup("and");                           break;
+		case OR:     t = strdup("or");                            break;
+		case OF:     t = strdup("of");                            break;
+		case LEQ:    t = strdup("<=");                            break;
+		case GEQ:    t = strdup(">=");                            break;
+		default:     t = g_strdup_printf("%c", tok);              break;
+		}
+		g_array_append_val(toks, tok);
+		g_ptr_array_add(texts, t);
+	}
+
+	r = g_string_new("");
+	n = 0;
+	for( i = 0; i < toks->len; i++ )
+	{
+		t = g_ptr_array_index(texts, i);
+		if( r->len )
+			g_string_append_c(r, ' ');
+		if( TOK(i) == INTLIT && TOK(i - 1) != '#' &&
+				(is_comparison(TOK(i - 1)) || is_comparison(TOK(i + 1)) ||
+				 (TOK(i + 1) == '#' && is_comparison(TOK(i + 3)))) )
+		{
+			g_string_append_printf(r, "$v%d", n);
+			g_hash_table_insert(values, g_strdup_printf("v%d", n++), t);
+		}
+		else
+		{
+			g_string_append(r, t);
+			free(t);
+		}
+	}
+	g_array_free(toks, 1);
+	g_ptr_array_free(texts, 1);
+
+#undef TOK
+
+	return g_string_free(r, 0);
+}
+
+GHashTable*
+policy_template_cache_new()
+{
+	return g_hash_table_new_full(g_str_hash, g_str_equal, free,
+															 (GDestroyNotify) policy_template_free);
+}
+
+char*
+parse_policy_lang_cached( GHashTable* templates, char* s )
+{
+	policy_template_t* t;
+	GHashTable* values;
+	char* shape;
+	char* r;
+
+	values = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+	shape = policy_shape(s, values);
+	if( !(t = g_hash_table_lookup(templates, shape)) )
+	{
+		t = compile_policy_template(shape);
+		g_hash_table_insert(templates, strdup(shape), t);
+	}
+	r = instantiate_policy_template(t, values);
+	g_hash_table_destroy(values);
+	free(shape);
+
+	return r;
+}
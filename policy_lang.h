@@ -4,3 +4,35 @@
 
 char* parse_policy_lang( char* s );
 void  parse_attribute( GSList** l, char* a );
+
+/*
+	A policy template is a policy in which some numbers are placeholders,
+	written $name for a flexint or $name#BITS for an expint, as in
+
+	  sysadmin and region = $region and release_date < $release#32
+
+	It is parsed and simplified once. Instantiating it formats only the
+	comparisons with placeholders, taking their values from a table
+	mapping names (without '$') to decimal strings, and copies the rest
+	from the compiled form. Leaves are put in the order tidy() gives
+	them, but subtrees keep their order in the template, which may not
+	be the one parse_policy_lang() gives for the same values: qsort()
+	keeps no order among them. Both describe the same policy. Like
+	parse_policy_lang(), compiling uses the global parser state;
+	instantiating may be done from any thread.
+*/
+typedef struct policy_template_s policy_template_t;
+
+policy_template_t* compile_policy_template( char* s );
+char*              instantiate_policy_template( policy_template_t* t,
+																								GHashTable* values );
+void               policy_template_free( policy_template_t* t );
+
+/*
+	As parse_policy_lang(), for the many policies of an MPD that differ
+	only in the numbers their attributes are compared against. Those
+	numbers are made placeholders, and each distinct policy left is
+	compiled once into templates, made by policy_template_cache_new().
+*/
+GHashTable* policy_template_cache_new();
+char*       parse_policy_lang_cached( GHashTable* templates, char* s );
@@ -14,18 +14,36 @@ typedef struct
 {
 	uint64_t value;
 	int bits; /* zero if this is a flexint */
+	char* hole; /* placeholder name if the value comes later, otherwise null */
 }
 sized_integer_t;
 
+typedef struct
+{
+	char* name; /* without the leading '$' */
+	int   bits; /* zero if this is a flexint */
+	int   op;   /* '=', '<', '>', LEQ or GEQ with the attribute on the left */
+	char* attr;
+}
+policy_hole_t;
+
 typedef struct
 {
 	int k;               /* one if leaf, otherwise threshold */
 	char* attr;          /* attribute string if leaf, otherwise null */
 	GPtrArray* children; /* pointers to bswabe_policy_t's, len == 0 for leaves */
+	policy_hole_t* hole; /* placeholder leaf, otherwise null */
+	char* postfix;       /* cached for subtrees of a template without holes */
 }
 cpabe_policy_t;
 
+struct policy_template_s
+{
+	cpabe_policy_t* root;
+};
+
 cpabe_policy_t* final_policy = 0;
+int num_holes = 0;
 
 int yylex();
 void yyerror( const char* s );
@@ -51,6 +69,7 @@ cpabe_policy_t* ge_policy( sized_integer_t* n, char* attr );
 }
 
 %token <str>  TAG
+%token <str>  HOLE
 %token <nat>  INTLIT
 %type  <sint> number
 %type  <tree> policy
@@ -68,6 +87,10 @@ result: policy { final_policy = $1; }
 
 number:   INTLIT '#' INTLIT          { $$ = expint($1, $3); }
         | INTLIT                     { $$ = flexint($1);    }
+        | HOLE '#' INTLIT            { $$ = expint(0, $3);
+                                       $$->hole = $1;       }
+        | HOLE                       { $$ = flexint(0);
+                                       $$->hole = $1;       }
 
 policy:   TAG                        { $$ = leaf_policy($1);        }
         | policy OR  policy          { $$ = kof2_policy(1, $1, $3); }
@@ -108,6 +131,7 @@ expint( uint64_t value, uint64_t bits )
 	s = malloc(sizeof(sized_integer_t));
 	s->value = value;
 	s->bits = bits;
+	s->hole = 0;
 
 	return s;
 }
@@ -120,6 +144,7 @@ flexint( uint64_t value )
 	s = malloc(sizeof(sized_integer_t));
 	s->value = value;
 	s->bits = 0;
+	s->hole = 0;
 
 	return s;
 }
@@ -131,6 +156,14 @@ policy_free( cpabe_policy_t* p )
 
 	if( p->attr )
 		free(p->attr);
+	if( p->postfix )
+		free(p->postfix);
+	if( p->hole )
+	{
+		free(p->hole->name);
+		free(p->hole->attr);
+		free(p->hole);
+	}
 
 	for( i = 0; i < p->children->len; i++ )
 		policy_free(g_ptr_array_index(p->children, i));
@@ -148,6 +181,8 @@ leaf_policy( char* attr )
 	p->k = 1;
 	p->attr = attr;
 	p->children = g_ptr_array_new();
+	p->hole = 0;
+	p->postfix = 0;
 
 	return p;
 }
@@ -161,6 +196,8 @@ kof2_policy( int k, cpabe_policy_t* l, cpabe_policy_t* r )
 	p->k = k;
 	p->attr = 0;
 	p->children = g_ptr_array_new();
+	p->hole = 0;
+	p->postfix = 0;
 	g_ptr_array_add(p->children, l);
 	g_ptr_array_add(p->children, r);
 
@@ -184,6 +221,8 @@ kof_policy( int k, GPtrArray* list )
 	p->k = k;
 	p->attr = 0;
 	p->children = list;
+	p->hole = 0;
+	p->postfix = 0;
 
 	return p;
 }
@@ -204,9 +243,32 @@ bit_marker( char* base, char* tplate, int bit, char val )
 	return s;
 }
 
+/*
+	Stands in for the comparison of attr against n until a template is
+	instantiated. The attribute string only serves to sort it in tidy().
+*/
+cpabe_policy_t*
+hole_policy( sized_integer_t* n, int op, char* attr )
+{
+	cpabe_policy_t* p;
+
+	p = leaf_policy(g_strdup_printf("$%s", n->hole));
+	p->hole = (policy_hole_t*) malloc(sizeof(policy_hole_t));
+	p->hole->name = n->hole;
+	p->hole->bits = n->bits;
+	p->hole->op = op;
+	p->hole->attr = attr;
+	num_holes++;
+
+	return p;
+}
+
 cpabe_policy_t*
 eq_policy( sized_integer_t* n, char* attr )
 {
+	if( n->hole )
+		return hole_policy(n, '=', attr);
+
 	if( n->bits == 0 )
 		return leaf_policy
 			(g_strdup_printf("%s_flexint_%llu", attr, n->value));
@@ -248,6 +310,8 @@ flexint_leader( int gt, char* attr, uint64_t value )
 	p = (cpabe_policy_t*) malloc(sizeof(cpabe_policy_t));
 	p->attr = 0;
 	p->children = g_ptr_array_new();
+	p->hole = 0;
+	p->postfix = 0;
 
 	for( k = 2; k <= 32; k *= 2 )
 		if( ( gt && ((uint64_t)1<<k) >  value) ||
@@ -324,18 +388,24 @@ cmp_policy( sized_integer_t* n, int gt, char* attr )
 cpabe_policy_t*
 lt_policy( sized_integer_t* n, char* attr )
 {
+	if( n->hole )
+		return hole_policy(n, '<', attr);
 	return cmp_policy(n, 0, attr);
 }
 
 cpabe_policy_t*
 gt_policy( sized_integer_t* n, char* attr )
 {
+	if( n->hole )
+		return hole_policy(n, '>', attr);
 	return cmp_policy(n, 1, attr);
 }
 
 cpabe_policy_t*
 le_policy( sized_integer_t* n, char* attr )
 {
+	if( n->hole )
+		return hole_policy(n, LEQ, attr);
 	n->value++;
 	return cmp_policy(n, 0, attr);
 }
@@ -343,6 +413,8 @@ le_policy( sized_integer_t* n, char* attr )
 cpabe_policy_t*
 ge_policy( sized_integer_t* n, char* attr )
 {
+	if( n->hole )
+		return hole_policy(n, GEQ, attr);
 	n->value--;
 	return cmp_policy(n, 1, attr);
 }
@@ -393,6 +465,18 @@ yylex()
 		g_string_free(s, 1);
 		r = INTLIT;
 	}
+	else if( c == '$' && (isalpha(PEEK_CHAR) || PEEK_CHAR == '_') )
+	{
+		GString* s;
+
+		s = g_string_new("");
+		while( isalnum(PEEK_CHAR) || PEEK_CHAR == '_' )
+			g_string_append_c(s, NEXT_CHAR);
+
+		yylval.str = s->str;
+		g_string_free(s, 0);
+		r = HOLE;
+	}
 	else if( isalpha(c) )
 	{
 		GString* s;
@@ -520,7 +604,9 @@ format_policy_postfix( cpabe_policy_t* p )
 	char* s;
 	char* t;
 
-	if( p->children->len == 0 )
+	if( p->postfix )
+		return strdup(p->postfix);
+	else if( p->children->len == 0 )
 		return strdup(p->attr);
 
 	r = format_policy_postfix(g_ptr_array_index(p->children, 0));
@@ -625,8 +711,11 @@ parse_policy_lang( char* s )
 	char* parsed_policy;
 
 	cur_string = s;
+	num_holes = 0;
 
 	yyparse();
+	if( num_holes )
+		die("error parsing policy: placeholders are only allowed in templates\n");
  	simplify(final_policy);
  	tidy(final_policy);
 	parsed_policy = format_policy_postfix(final_policy);
@@ -635,3 +724,305 @@ parse_policy_lang( char* s )
 
 	return parsed_policy;
 }
+
+/* returns nonzero if p has no placeholders, caching its postfix if so */
+int
+cache_postfix( cpabe_policy_t* p )
+{
+	int i;
+	int complete;
+
+	complete = !p->hole;
+	for( i = 0; i < p->children->len; i++ )
+		if( !cache_postfix(g_ptr_array_index(p->children, i)) )
+			complete = 0;
+
+	if( complete )
+		p->postfix = format_policy_postfix(p);
+
+	return complete;
+}
+
+policy_template_t*
+compile_policy_template( char* s )
+{
+	policy_template_t* t;
+
+	cur_string = s;
+	num_holes = 0;
+
+	yyparse();
+ 	simplify(final_policy);
+ 	tidy(final_policy);
+	cache_postfix(final_policy);
+
+	t = (policy_template_t*) malloc(sizeof(policy_template_t));
+	t->root = final_policy;
+	final_policy = 0;
+
+	return t;
+}
+
+void
+policy_template_free( policy_template_t* t )
+{
+	policy_free(t->root);
+	free(t);
+}
+
+cpabe_policy_t*
+expand_hole( policy_hole_t* h, GHashTable* values )
+{
+	sized_integer_t n;
+	cpabe_policy_t* p;
+	char* v;
+	char* end;
+
+	if( !(v = g_hash_table_lookup(values, h->name)) )
+		die("no value given for placeholder $%s\n", h->name);
+
+	n.value = strtoull(v, &end, 10);
+	n.bits = h->bits;
+	n.hole = 0;
+	if( !isdigit(*v) || *end )
+		die("invalid value \"%s\" for placeholder $%s\n", v, h->name);
+	if( n.bits && n.bits < 64 && n.value >= ((uint64_t)1<<n.bits) )
+		die("value %llu of placeholder $%s too big for %d bits\n",
+				n.value, h->name, n.bits);
+
+	switch( h->op )
+	{
+	case '=': p = eq_policy(&n, h->attr); break;
+	case '<': p = lt_policy(&n, h->attr); break;
+	case '>': p = gt_policy(&n, h->attr); break;
+	case LEQ: p = le_policy(&n, h->attr); break;
+	default:  p = ge_policy(&n, h->attr); break;
+	}
+
+	simplify(p);
+	tidy(p);
+
+	return p;
+}
+
+void
+append_postfix( GString* s, char* t )
+{
+	if( s->len )
+		g_string_append_c(s, ' ');
+	g_string_append(s, t);
+	free(t);
+}
+
+/* a child of a node being instantiated, as tidy() sees it */
+typedef struct
+{
+	char* attr;    /* attribute string if leaf, otherwise null */
+	char* postfix;
+}
+tidy_item_t;
+
+int
+cmp_tidy_item( gconstpointer a, gconstpointer b, gpointer unused )
+{
+	const tidy_item_t* ia;
+	const tidy_item_t* ib;
+
+	ia = a;
+	ib = b;
+
+	if(      !ia->attr &&  ib->attr )
+		return -1;
+	else if(  ia->attr && !ib->attr )
+		return 1;
+	else if(  ia->attr &&  ib->attr )
+		return strcmp(ia->attr, ib->attr);
+	else
+		return 0;
+}
+
+void
+add_item( GArray* items, cpabe_policy_t* c, char* postfix )
+{
+	tidy_item_t it;
+
+	it.attr = c->children->len ? 0 : c->attr;
+	it.postfix = postfix;
+	g_array_append_val(items, it);
+}
+
+char*
+instantiate_node( cpabe_policy_t* p, GHashTable* values )
+{
+	cpabe_policy_t* c;
+	cpabe_policy_t* e;
+	GPtrArray* expanded;
+	GArray* items;
+	GString* s;
+	char* r;
+	int k;
+	int i;
+	int j;
+
+	if( p->postfix )
+		return strdup(p->postfix);
+	else if( p->hole )
+	{
+		e = expand_hole(p->hole, values);
+		r = format_policy_postfix(e);
+		policy_free(e);
+		return r;
+	}
+
+	items = g_array_new(0, 0, sizeof(tidy_item_t));
+	expanded = g_ptr_array_new();
+	k = p->k;
+	for( i = 0; i < p->children->len; i++ )
+	{
+		c = g_ptr_array_index(p->children, i);
+		if( !c->hole )
+		{
+			add_item(items, c, instantiate_node(c, values));
+			continue;
+		}
+
+		/* merge as simplify() would have, had the value been known */
+		e = expand_hole(c->hole, values);
+		g_ptr_array_add(expanded, e);
+		if( (POLICY_IS_OR(p)  && POLICY_IS_OR(e)) ||
+				(POLICY_IS_AND(p) && POLICY_IS_AND(e)) )
+		{
+			if( POLICY_IS_AND(p) )
+				k += e->k - 1;
+			for( j = 0; j < e->children->len; j++ )
+				add_item(items, g_ptr_array_index(e->children, j),
+								 format_policy_postfix(g_ptr_array_index(e->children, j)));
+		}
+		else
+			add_item(items, e, format_policy_postfix(e));
+	}
+
+	/* the leaves only now have their attributes to be sorted by */
+	g_array_sort_with_data(items, cmp_tidy_item, 0);
+
+	s = g_string_new("");
+	for( i = 0; i < items->len; i++ )
+		append_postfix(s, g_array_index(items, tidy_item_t, i).postfix);
+	g_string_append_printf(s, " %dof%d", k, items->len);
+
+	for( i = 0; i < expanded->len; i++ )
+		policy_free(g_ptr_array_index(expanded, i));
+	g_ptr_array_free(expanded, 1);
+	g_array_free(items, 1);
+
+	return g_string_free(s, 0);
+}
+
+char*
+instantiate_policy_template( policy_template_t* t, GHashTable* values )
+{
+	return instantiate_node(t->root, values);
+}
+
+int
+is_comparison( int tok )
+{
+	return tok == '=' || tok == '<' || tok == '>' || tok == LEQ || tok == GEQ;
+}
+
+/*
+	Rewrites s with each number it compares an attribute against replaced
+	by a placeholder $vN, adding N's value to values. Thresholds and bit
+	counts stay as they are.
+*/
+char*
+policy_shape( char* s, GHashTable* values )
+{
+	GArray* toks;
+	GPtrArray* texts;
+	GString* r;
+	char* t;
+	int tok;
+	int n;
+	int i;
+
+#define TOK(i) ((i) >= 0 && (i) < toks->len ? g_array_index(toks, int, i) : 0)
+
+	toks = g_array_new(0, 0, sizeof(int));
+	texts = g_ptr_array_new();
+	cur_string = s;
+	while( (tok = yylex()) )
+	{
+		switch( tok )
+		{
+		case TAG:    t = yylval.str;                              break;
+		case INTLIT: t = g_strdup_printf("%llu", yylval.nat);     break;
+		case HOLE:
+			die("error parsing policy: placeholders are only allowed in templates\n");
+		case AND:    t = strdup("and");                           break;
+		case OR:     t = strdup("or");                            break;
+		case OF:     t = strdup("of");                            break;
+		case LEQ:    t = strdup("<=");                            break;
+		case GEQ:    t = strdup(">=");                            break;
+		default:     t = g_strdup_printf("%c", tok);              break;
+		}
+		g_array_append_val(toks, tok);
+		g_ptr_array_add(texts, t);
+	}
+
+	r = g_string_new("");
+	n = 0;
+	for( i = 0; i < toks->len; i++ )
+	{
+		t = g_ptr_array_index(texts, i);
+		if( r->len )
+			g_string_append_c(r, ' ');
+		if( TOK(i) == INTLIT && TOK(i - 1) != '#' &&
+				(is_comparison(TOK(i - 1)) || is_comparison(TOK(i + 1)) ||
+				 (TOK(i + 1) == '#' && is_comparison(TOK(i + 3)))) )
+		{
+			g_string_append_printf(r, "$v%d", n);
+			g_hash_table_insert(values, g_strdup_printf("v%d", n++), t);
+		}
+		else
+		{
+			g_string_append(r, t);
+			free(t);
+		}
+	}
+	g_array_free(toks, 1);
+	g_ptr_array_free(texts, 1);
+
+#undef TOK
+
+	return g_string_free(r, 0);
+}
+
+GHashTable*
+policy_template_cache_new()
+{
+	return g_hash_table_new_full(g_str_hash, g_str_equal, free,
+															 (GDestroyNotify) policy_template_free);
+}
+
+char*
+parse_policy_lang_cached( GHashTable* templates, char* s )
+{
+	policy_template_t* t;
+	GHashTable* values;
+	char* shape;
+	char* r;
+
+	values = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+	shape = policy_shape(s, values);
+	if( !(t = g_hash_table_lookup(templates, shape)) )
+	{
+		t = compile_policy_template(shape);
+		g_hash_table_insert(templates, strdup(shape), t);
+	}
+	r = instantiate_policy_template(t, values);
+	g_hash_table_destroy(values);
+	free(shape);
+
+	return r;
+}
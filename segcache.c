@@ -0,0 +1,256 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "segcache.h"
+
+typedef struct
+{
+	char*       path;
+	GByteArray* plt;     /* null while loading */
+	char*       err;     /* set if loading failed */
+	int         waiters; /* threads waiting for it to load */
+	GList*      link;    /* in lru once loaded */
+}
+segment_t;
+
+struct segcache_s
+{
+	segcache_load_t load;
+	size_t      max_bytes;
+	size_t      bytes;
+	int         lookahead;
+	GHashTable* segments; /* path -> segment_t */
+	GQueue      lru;      /* most recently used at the head */
+	GHashTable* last;     /* path without its number -> last number asked for */
+	GThreadPool* prefetch;
+	GMutex      lock;
+	GCond       loaded;
+};
+
+void
+segment_free( segment_t* s )
+{
+	if( s->plt )
+		g_byte_array_unref(s->plt);
+	free(s->path);
+	free(s);
+}
+
+/*
+	Splits path around the last number in its file name before the
+	extension, returning its value and leaving the text either side in
+	*pre and *post, or returns -1 if there is none.
+*/
+long
+segment_number( char* path, char** pre, char** post, int* width )
+{
+	char* base;
+	char* end;
+	char* start;
+
+	base = strrchr(path, '/');
+	base = base ? base + 1 : path;
+	if( !(end = strrchr(base, '.')) )
+		end = base + strlen(base);
+
+	for( ; end > base && !g_ascii_isdigit(end[-1]); end-- )
+		;
+	for( start = end; start > base && g_ascii_isdigit(start[-1]); start-- )
+		;
+	if( start == end || end - start > 9 )
+		return -1;
+
+	*pre = g_strndup(path, start - path);
+	*post = strdup(end);
+	*width = start[0] == '0' ? end - start : 0;
+
+	return strtol(start, 0, 10);
+}
+
+/* call with c->lock held; segments still being waited on are kept */
+void
+evict( segcache_t* c )
+{
+	segment_t* s;
+	GList* l;
+	GList* prev;
+
+	for( l = g_queue_peek_tail_link(&c->lru);
+			 l && l->prev && c->max_bytes && c->bytes > c->max_bytes; l = prev )
+	{
+		prev = l->prev;
+		s = l->data;
+		if( s->waiters )
+			continue;
+		g_queue_delete_link(&c->lru, l);
+		c->bytes -= s->plt->len;
+		g_hash_table_remove(c->segments, s->path);
+	}
+}
+
+/* call with c->lock held, returns it held */
+char*
+get_locked( segcache_t* c, char* path, GByteArray** plt )
+{
+	segment_t* s;
+	GByteArray* b;
+	char* err;
+
+	if( (s = g_hash_table_lookup(c->segments, path)) )
+	{
+		if( s->plt )
+		{
+			g_queue_unlink(&c->lru, s->link);
+			g_queue_push_head_link(&c->lru, s->link);
+			*plt = g_byte_array_ref(s->plt);
+			return 0;
+		}
+
+		s->waiters++;
+		while( !s->plt && !s->err )
+			g_cond_wait(&c->loaded, &c->lock);
+		s->waiters--;
+
+		if( (err = s->err) )
+		{
+			if( !s->waiters )
+				segment_free(s);
+			return err;
+		}
+		*plt = g_byte_array_ref(s->plt);
+		return 0;
+	}
+
+	s = (segment_t*) malloc(sizeof(segment_t));
+	s->path = strdup(path);
+	s->plt = 0;
+	s->err = 0;
+	s->waiters = 0;
+	s->link = 0;
+	g_hash_table_insert(c->segments, s->path, s);
+
+	g_mutex_unlock(&c->lock);
+	err = c->load(path, &b);
+	g_mutex_lock(&c->lock);
+
+	/* failures are not kept, so a segment that appears later is found */
+	if( err )
+	{
+		g_hash_table_steal(c->segments, s->path);
+		s->err = err;
+		g_cond_broadcast(&c->loaded);
+		if( !s->waiters )
+			segment_free(s);
+		return err;
+	}
+
+	s->plt = b;
+	g_queue_push_head(&c->lru, s);
+	s->link = g_queue_peek_head_link(&c->lru);
+	c->bytes += b->len;
+	g_cond_broadcast(&c->loaded);
+
+	*plt = g_byte_array_ref(b);
+	evict(c);
+
+	return 0;
+}
+
+void
+prefetch_segment( gpointer data, gpointer user_data )
+{
+	segcache_t* c;
+	GByteArray* plt;
+
+	c = user_data;
+	g_mutex_lock(&c->lock);
+	if( !get_locked(c, data, &plt) )
+		g_byte_array_unref(plt);
+	g_mutex_unlock(&c->lock);
+	free(data);
+}
+
+/* call with c->lock held */
+void
+note_request( segcache_t* c, char* path )
+{
+	char* pre;
+	char* post;
+	char* rep;
+	char* next;
+	gpointer last;
+	long n;
+	long i;
+	int width;
+
+	if( !c->lookahead || (n = segment_number(path, &pre, &post, &width)) < 0 )
+		return;
+
+	rep = g_strdup_printf("%s%s", pre, post);
+	if( g_hash_table_lookup_extended(c->last, rep, 0, &last) &&
+			GPOINTER_TO_INT(last) == n - 1 )
+	{
+		for( i = n + 1; i <= n + c->lookahead; i++ )
+		{
+			next = g_strdup_printf("%s%0*ld%s", pre, width, i, post);
+			if( g_hash_table_lookup(c->segments, next) )
+				free(next);
+			else
+				g_thread_pool_push(c->prefetch, next, 0);
+		}
+	}
+	g_hash_table_replace(c->last, rep, GINT_TO_POINTER(n));
+
+	free(pre);
+	free(post);
+}
+
+segcache_t*
+segcache_new( segcache_load_t load, size_t max_bytes, int lookahead, int threads )
+{
+	segcache_t* c;
+
+	c = (segcache_t*) malloc(sizeof(segcache_t));
+	c->load = load;
+	c->max_bytes = max_bytes;
+	c->bytes = 0;
+	c->lookahead = lookahead;
+	c->segments = g_hash_table_new_full(g_str_hash, g_str_equal, 0,
+																			(GDestroyNotify) segment_free);
+	g_queue_init(&c->lru);
+	c->last = g_hash_table_new_full(g_str_hash, g_str_equal, free, 0);
+	c->prefetch = lookahead ?
+		g_thread_pool_new(prefetch_segment, c, threads < 1 ? 1 : threads, 0, 0) : 0;
+	g_mutex_init(&c->lock);
+	g_cond_init(&c->loaded);
+
+	return c;
+}
+
+char*
+segcache_get( segcache_t* c, char* path, GByteArray** plt )
+{
+	char* err;
+
+	g_mutex_lock(&c->lock);
+	note_request(c, path);
+	err = get_locked(c, path, plt);
+	g_mutex_unlock(&c->lock);
+
+	return err;
+}
+
+void
+segcache_free( segcache_t* c )
+{
+	if( c->prefetch )
+		g_thread_pool_free(c->prefetch, 1, 1);
+	g_hash_table_destroy(c->segments);
+	g_queue_clear(&c->lru);
+	g_hash_table_destroy(c->last);
+	g_mutex_clear(&c->lock);
+	g_cond_clear(&c->loaded);
+	free(c);
+}
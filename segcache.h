@@ -0,0 +1,30 @@
+/*
+	Include glib.h before including this file.
+
+	A cache of decrypted segments by path, bounded in bytes, dropping the
+	least recently used ones once it is over budget. Segments are named
+	with a number, as in seg-41.m4s, and when two of a Representation
+	(the same name but for the number) are asked for one after the
+	other, the lookahead segments that follow are loaded by a pool of
+	prefetch threads, so playback in order finds them ready. A segment
+	being loaded is loaded once however many ask for it.
+
+	All calls may be made from several threads at once.
+*/
+
+typedef struct segcache_s segcache_t;
+
+/* returns an error message or zero, leaving the plaintext in *plt */
+typedef char* (*segcache_load_t)( char* path, GByteArray** plt );
+
+/* max_bytes == 0 means no budget, lookahead == 0 no prefetching */
+segcache_t* segcache_new( segcache_load_t load, size_t max_bytes,
+													int lookahead, int threads );
+
+/*
+	Returns an error message or zero, leaving in *plt a reference to the
+	plaintext which the caller must drop with g_byte_array_unref().
+*/
+char* segcache_get( segcache_t* c, char* path, GByteArray** plt );
+
+void segcache_free( segcache_t* c );
@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <glib.h>
+#include <pbc.h>
+
+#include "common.h"
+#include "spool.h"
+
+void
+spool_mkdir( char* dir, char* sub )
+{
+	char* d;
+
+	d = sub ? g_build_filename(dir, sub, (char*) 0) : strdup(dir);
+	if( mkdir(d, 0777) && errno != EEXIST )
+		die("can't create directory: %s\n", d);
+	free(d);
+}
+
+void
+spool_init( char* dir )
+{
+	spool_mkdir(dir, 0);
+	spool_mkdir(dir, "tmp");
+	spool_mkdir(dir, "todo");
+	spool_mkdir(dir, "claimed");
+	spool_mkdir(dir, "done");
+}
+
+void
+spool_put( char* dir, char* file, char* policy )
+{
+	static int seq = 0;
+	char* name;
+	char* tmp;
+	char* todo;
+	char* cwd;
+	char* abs;
+	FILE* f;
+
+	if( g_path_is_absolute(file) )
+		abs = strdup(file);
+	else
+	{
+		cwd = getcwd(0, 0);
+		abs = g_build_filename(cwd, file, (char*) 0);
+		free(cwd);
+	}
+
+	/* unique across coordinators, and sorts in submission order */
+	name = g_strdup_printf("%08d.%s.%d", seq++, g_get_host_name(), getpid());
+	tmp  = g_build_filename(dir, "tmp",  name, (char*) 0);
+	todo = g_build_filename(dir, "todo", name, (char*) 0);
+
+	f = fopen_write_or_die(tmp);
+	fprintf(f, "%s\n%s\n", abs, policy);
+	if( fclose(f) )
+		die("can't write file: %s\n", tmp);
+	if( rename(tmp, todo) )
+		die("can't rename %s to %s\n", tmp, todo);
+
+	free(name);
+	free(tmp);
+	free(todo);
+	free(abs);
+}
+
+gint
+spool_cmp_name( gconstpointer a, gconstpointer b )
+{
+	return strcmp(*(char**) a, *(char**) b);
+}
+
+char*
+spool_claim( char* dir, char** file, char** policy )
+{
+	GPtrArray* names;
+	GDir* d;
+	const char* n;
+	char* todo;
+	char* from;
+	char* claim;
+	char* s;
+	char* nl;
+	int i;
+
+	todo = g_build_filename(dir, "todo", (char*) 0);
+	if( !(d = g_dir_open(todo, 0, 0)) )
+		die("can't read directory: %s\n", todo);
+
+	names = g_ptr_array_new();
+	while( (n = g_dir_read_name(d)) )
+		g_ptr_array_add(names, strdup(n));
+	g_dir_close(d);
+	g_ptr_array_sort(names, spool_cmp_name);
+
+	claim = 0;
+	for( i = 0; i < names->len && !claim; i++ )
+	{
+		from  = g_build_filename(todo, g_ptr_array_index(names, i), (char*) 0);
+		claim = g_strdup_printf("%s/claimed/%s.%s.%d", dir,
+														(char*) g_ptr_array_index(names, i),
+														g_get_host_name(), getpid());
+
+		/* losing the race to another worker is not an error */
+		if( rename(from, claim) )
+		{
+			if( errno != ENOENT )
+				die("can't rename %s to %s\n", from, claim);
+			free(claim);
+			claim = 0;
+		}
+		else
+			utime(claim, 0); /* the age of a claim starts now */
+		free(from);
+	}
+
+	for( i = 0; i < names->len; i++ )
+		free(g_ptr_array_index(names, i));
+	g_ptr_array_free(names, 1);
+	free(todo);
+
+	if( !claim )
+		return 0;
+
+	s = suck_file_str(claim);
+	if( !(nl = strchr(s, '\n')) )
+		die("malformed spool item: %s\n", claim);
+	*file = g_strndup(s, nl - s);
+	*policy = strdup(nl + 1);
+	g_strchomp(*policy);
+	free(s);
+
+	return claim;
+}
+
+/* whether name was claimed by a process of this host that has since gone */
+int
+spool_owner_dead( const char* name )
+{
+	char* dot;
+	char* suffix;
+	long pid;
+	int dead;
+
+	if( !(dot = strrchr(name, '.')) || !(pid = strtol(dot + 1, 0, 10)) )
+		return 0;
+
+	suffix = g_strdup_printf(".%s.%ld", g_get_host_name(), pid);
+	dead = g_str_has_suffix(name, suffix) && pid != getpid() &&
+		kill(pid, 0) && errno == ESRCH;
+	free(suffix);
+
+	return dead;
+}
+
+int
+spool_recover( char* dir, int max_age )
+{
+	GDir* d;
+	const char* n;
+	struct stat st;
+	char* claimed;
+	char* from;
+	char* todo;
+	int count;
+
+	claimed = g_build_filename(dir, "claimed", (char*) 0);
+	if( !(d = g_dir_open(claimed, 0, 0)) )
+		die("can't read directory: %s\n", claimed);
+
+	/* put back under the whole claim name, which still sorts by its sequence */
+	count = 0;
+	while( (n = g_dir_read_name(d)) )
+	{
+		from = g_build_filename(claimed, n, (char*) 0);
+		if( !stat(from, &st) &&
+				(spool_owner_dead(n) || time(0) - st.st_mtime > max_age) )
+		{
+			todo = g_build_filename(dir, "todo", n, (char*) 0);
+			if( !rename(from, todo) )
+				count++;
+			else if( errno != ENOENT )
+				die("can't rename %s to %s\n", from, todo);
+			free(todo);
+		}
+		free(from);
+	}
+	g_dir_close(d);
+	free(claimed);
+
+	return count;
+}
+
+void
+spool_done( char* dir, char* claim )
+{
+	char* base;
+	char* done;
+
+	base = g_path_get_basename(claim);
+	done = g_build_filename(dir, "done", base, (char*) 0);
+	if( rename(claim, done) )
+		die("can't rename %s to %s\n", claim, done);
+
+	free(base);
+	free(done);
+}
@@ -0,0 +1,38 @@
+/*
+	Include glib.h before including this file.
+
+	A work queue kept in a directory on shared storage, so that any
+	number of processes on any number of hosts can share it without a
+	server. Items move between subdirectories by rename(), which is
+	atomic, so each one is claimed by exactly one worker:
+
+	  tmp/      items being written by the coordinator
+	  todo/     items waiting for a worker
+	  claimed/  items being worked on, suffixed with .HOST.PID
+	  done/     finished items, keeping the suffix of their worker
+
+	An item holds the absolute path of a file on its first line and the
+	policy to encrypt it under on the rest.
+
+	A claim whose worker died is put back in todo/ by spool_recover():
+	at once if the worker ran on this host and its process is gone, and
+	otherwise once it has been claimed for longer than max_age seconds.
+*/
+
+/* a day, longer than any one file should take */
+#define SPOOL_STALE_AGE (24 * 60 * 60)
+
+
+void  spool_init( char* dir );
+void  spool_put( char* dir, char* file, char* policy );
+
+/*
+	Claim the next waiting item, returning the path of the claim (to be
+	passed to spool_done()) and setting *file and *policy, or return
+	zero when nothing is left to do.
+*/
+char* spool_claim( char* dir, char** file, char** policy );
+void  spool_done( char* dir, char* claim );
+
+/* returns the number of claims put back */
+int   spool_recover( char* dir, int max_age );
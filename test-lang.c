@@ -1,3 +1,4 @@
+#include <string.h>
 #include <glib.h>
 #include <pbc.h>
 
@@ -12,7 +13,30 @@ main( int argc, char** argv )
 	if( argc < 2 )
 		die("specify policy\n");
 
-	p = parse_policy_lang(argv[1]);
+	if( argc == 2 )
+		p = parse_policy_lang(argv[1]);
+	else
+	{
+		/* a template followed by NAME=VALUE pairs */
+		policy_template_t* t;
+		GHashTable* values;
+		char* v;
+		int i;
+
+		values = g_hash_table_new(g_str_hash, g_str_equal);
+		for( i = 2; i < argc; i++ )
+		{
+			if( !(v = strchr(argv[i], '=')) )
+				die("expected NAME=VALUE, got \"%s\"\n", argv[i]);
+			*v++ = 0;
+			g_hash_table_insert(values, argv[i], v);
+		}
+
+		t = compile_policy_template(argv[1]);
+		p = instantiate_policy_template(t, values);
+		policy_template_free(t);
+		g_hash_table_destroy(values);
+	}
 
 	printf("parsed to: %s\n", p);
 
@@ -0,0 +1,179 @@
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <pbc.h>
+
+#include "threshold.h"
+
+struct threshold_cache_s
+{
+	pairing_ptr p;
+	GHashTable* sets; /* "i,j,k" -> threshold_coefs_t* */
+};
+
+typedef struct
+{
+	int len;
+	element_t* lambda;
+}
+threshold_coefs_t;
+
+void
+threshold_shares( element_t* shares, element_t* coef, int k, int n )
+{
+	int i;
+	int j;
+
+	/*
+		q(x) = (...(a_{k-1} x + a_{k-2}) x + ...) x + a_0, and since x is
+		a small integer each step is a cheap scalar multiplication rather
+		than a full multiplication in Zr.
+	*/
+	for( i = 0; i < n; i++ )
+	{
+		element_set(shares[i], coef[k - 1]);
+		for( j = k - 2; j >= 0; j-- )
+		{
+			element_mul_si(shares[i], shares[i], i + 1);
+			element_add(shares[i], shares[i], coef[j]);
+		}
+	}
+}
+
+static void
+coefs_free( gpointer data )
+{
+	threshold_coefs_t* e;
+	int i;
+
+	e = data;
+	for( i = 0; i < e->len; i++ )
+		element_clear(e->lambda[i]);
+	free(e->lambda);
+	free(e);
+}
+
+threshold_cache_t*
+threshold_cache_new( pairing_t p )
+{
+	threshold_cache_t* c;
+
+	c = (threshold_cache_t*) malloc(sizeof(threshold_cache_t));
+	c->p = p;
+	c->sets = g_hash_table_new_full(g_str_hash, g_str_equal, free, coefs_free);
+
+	return c;
+}
+
+void
+threshold_cache_free( threshold_cache_t* c )
+{
+	g_hash_table_destroy(c->sets);
+	free(c);
+}
+
+/*
+	Montgomery's trick: invert all n elements of a with one inversion
+	and 3(n - 1) multiplications.
+*/
+static void
+batch_invert( element_t* a, int n, pairing_ptr p )
+{
+	element_t* prefix;
+	element_t inv;
+	element_t t;
+	int i;
+
+	if( n < 1 )
+		return;
+
+	prefix = malloc(n * sizeof(element_t));
+	for( i = 0; i < n; i++ )
+	{
+		element_init_Zr(prefix[i], p);
+		if( i == 0 )
+			element_set(prefix[i], a[i]);
+		else
+			element_mul(prefix[i], prefix[i - 1], a[i]);
+	}
+
+	element_init_Zr(inv, p);
+	element_init_Zr(t,   p);
+	element_invert(inv, prefix[n - 1]);
+
+	for( i = n - 1; i > 0; i-- )
+	{
+		element_mul(t, inv, prefix[i - 1]);
+		element_mul(inv, inv, a[i]);
+		element_set(a[i], t);
+	}
+	element_set(a[0], inv);
+
+	element_clear(inv);
+	element_clear(t);
+	for( i = 0; i < n; i++ )
+		element_clear(prefix[i]);
+	free(prefix);
+}
+
+static char*
+index_set_key( int* s, int len )
+{
+	GString* k;
+	int i;
+
+	k = g_string_sized_new(4 * len);
+	for( i = 0; i < len; i++ )
+		g_string_append_printf(k, i ? ",%d" : "%d", s[i]);
+
+	return g_string_free(k, 0);
+}
+
+element_t*
+threshold_lagrange( threshold_cache_t* c, int* s, int len )
+{
+	threshold_coefs_t* e;
+	element_t num;
+	char* key;
+	int i;
+	int j;
+
+	if( len < 1 )
+		return 0;
+
+	key = index_set_key(s, len);
+	if( (e = g_hash_table_lookup(c->sets, key)) )
+	{
+		free(key);
+		return e->lambda;
+	}
+
+	/*
+		lambda_i = prod_{j != i} s_j / (s_j - s_i)
+		         = (prod_j s_j) / (s_i prod_{j != i} (s_j - s_i))
+	*/
+	e = (threshold_coefs_t*) malloc(sizeof(threshold_coefs_t));
+	e->len = len;
+	e->lambda = malloc(len * sizeof(element_t));
+
+	element_init_Zr(num, c->p);
+	element_set1(num);
+	for( i = 0; i < len; i++ )
+	{
+		element_init_Zr(e->lambda[i], c->p);
+		element_set_si(e->lambda[i], s[i]);
+		for( j = 0; j < len; j++ )
+			if( j != i )
+				element_mul_si(e->lambda[i], e->lambda[i], s[j] - s[i]);
+		element_mul_si(num, num, s[i]);
+	}
+
+	batch_invert(e->lambda, len, c->p);
+	for( i = 0; i < len; i++ )
+		element_mul(e->lambda[i], e->lambda[i], num);
+	element_clear(num);
+
+	g_hash_table_insert(c->sets, key, e);
+
+	return e->lambda;
+}
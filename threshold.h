@@ -0,0 +1,28 @@
+/*
+	Include glib.h and pbc.h before including this file.
+
+	Arithmetic for k-of-n threshold gates that stays cheap when n is
+	large: share generation by Horner evaluation with small integer
+	abscissae, and Lagrange coefficients computed with a single field
+	inversion per index set and cached for reuse.
+*/
+
+typedef struct threshold_cache_s threshold_cache_t;
+
+/*
+	Evaluate the degree k - 1 polynomial with coefficients coef[0..k-1]
+	at x = 1, ..., n, writing q(x) to shares[x - 1]. The shares must
+	already be initialized as elements of Zr.
+*/
+void threshold_shares( element_t* shares, element_t* coef, int k, int n );
+
+threshold_cache_t* threshold_cache_new( pairing_t p );
+void               threshold_cache_free( threshold_cache_t* c );
+
+/*
+	Return the Lagrange coefficients for interpolating at zero from the
+	len (one-based) indices in s, in the same order as s, or zero if len
+	is zero. The array is owned by the cache and stays valid until
+	threshold_cache_free().
+*/
+element_t* threshold_lagrange( threshold_cache_t* c, int* s, int len );
@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <pbc.h>
+#include <pbc_random.h>
+
+#include "common.h"
+#include "threshold.h"
+#include "decrypt.h"
+
+char* usage =
+"Usage: cpabe-transform [OPTION ...] PUB_KEY TRANSFORM_KEY FILE [FILE ...]\n"
+"\n"
+"Do the pairings of decrypting FILE with the transformation key\n"
+"TRANSFORM_KEY made by cpabe-keygen -t, without learning its contents.\n"
+"The result is written as X.tcpabe if FILE is named X.cpabe, and as\n"
+"FILE.tcpabe otherwise, and holds the encrypted file and two group\n"
+"elements in place of the policy. The holder of the matching secret\n"
+"key finishes decryption with cpabe-dec -t, at the cost of a single\n"
+"exponentiation.\n"
+"\n"
+"A line is printed for each file, and the exit status is nonzero if\n"
+"any of them failed.\n"
+"\n"
+"Mandatory arguments to long options are mandatory for short options too.\n\n"
+" -h, --help               print this message\n\n"
+" -v, --version            print version information\n\n"
+" -o, --output FILE        write output to FILE (only with one FILE)\n\n"
+" -d, --deterministic      use deterministic \"random\" numbers\n"
+"                          (only for debugging)\n\n"
+"";
+
+char*   pub_file = 0;
+char*   tk_file  = 0;
+char*   out_file = 0;
+GSList* in_files = 0;
+
+void
+parse_args( int argc, char** argv )
+{
+	int i;
+
+	for( i = 1; i < argc; i++ )
+		if(      !strcmp(argv[i], "-h") || !strcmp(argv[i], "--help") )
+		{
+			printf("%s", usage);
+			exit(0);
+		}
+		else if( !strcmp(argv[i], "-v") || !strcmp(argv[i], "--version") )
+		{
+			printf(CPABE_VERSION, "-transform");
+			exit(0);
+		}
+		else if( !strcmp(argv[i], "-o") || !strcmp(argv[i], "--output") )
+		{
+			if( ++i >= argc )
+				die(usage);
+			else
+				out_file = argv[i];
+		}
+		else if( !strcmp(argv[i], "-d") || !strcmp(argv[i], "--deterministic") )
+		{
+			pbc_random_set_deterministic(0);
+		}
+		else if( !pub_file )
+		{
+			pub_file = argv[i];
+		}
+		else if( !tk_file )
+		{
+			tk_file = argv[i];
+		}
+		else
+			in_files = g_slist_append(in_files, argv[i]);
+
+	if( !pub_file || !tk_file || !in_files )
+		die(usage);
+
+	if( out_file && in_files->next )
+		die("cannot use -o with more than one file\n");
+}
+
+/* returns an error message or zero */
+char*
+transform_file( dec_pub_t* pub, dec_prv_t* tk, dec_opts_t* opts,
+								char* file, char* out )
+{
+	GByteArray* cph_buf;
+	GByteArray* aes_buf;
+	GByteArray* t_buf;
+	GByteArray* tag;
+	dec_summary_t* summary;
+	dec_cph_t* cph;
+	element_t w;
+	char* err;
+	int file_len;
+	int ok;
+
+	if( (err = load_cpabe_header(file, &cph_buf)) )
+		return err;
+	if( !(summary = dec_summary_read(cph_buf)) )
+		err = "malformed ciphertext header";
+	else
+	{
+		if( !dec_summary_satisfied(summary, tk) )
+			err = "attributes in key do not satisfy policy";
+		dec_summary_free(summary);
+	}
+	g_byte_array_free(cph_buf, 1);
+	if( err )
+		return err;
+
+	if( (err = load_cpabe_file_tag(file, &cph_buf, &file_len, &aes_buf, &tag)) )
+		return err;
+
+	if( !(cph = dec_cph_unserialize(pub, cph_buf, 1)) )
+	{
+		g_byte_array_free(aes_buf, 1);
+		if( tag )
+			g_byte_array_free(tag, 1);
+		return "malformed ciphertext header";
+	}
+
+	if( (ok = dec_transform(pub, tk, cph, w, opts, 0)) )
+	{
+		/* the session key is unchanged, so the tag still holds */
+		t_buf = dec_transformed_serialize(cph, w);
+		write_cpabe_file(out, t_buf, file_len, aes_buf, tag ? tag->data : 0);
+		g_byte_array_free(t_buf, 1);
+		element_clear(w);
+	}
+	dec_cph_free(cph);
+	g_byte_array_free(aes_buf, 1);
+	if( tag )
+		g_byte_array_free(tag, 1);
+
+	return ok ? 0 : "attributes in key do not satisfy policy";
+}
+
+int
+main( int argc, char** argv )
+{
+	dec_pub_t* pub;
+	dec_prv_t* tk;
+	dec_opts_t opts = { DEC_MERGE, 0, 0, 0, 0, 0 };
+	GSList* l;
+	char* out;
+	char* err;
+	int failed;
+
+	parse_args(argc, argv);
+
+	if( !(pub = dec_pub_unserialize(suck_file(pub_file), 1)) )
+		die("malformed public key: %s\n", pub_file);
+	if( !(tk = dec_prv_unserialize(pub, suck_file(tk_file), 1)) )
+		die("malformed transformation key: %s\n", tk_file);
+
+	opts.lagrange = threshold_cache_new(pub->p);
+	opts.plans = dec_plancache_new(1024);
+	opts.preprocess = in_files->next != 0;
+
+	failed = 0;
+	for( l = in_files; l; l = l->next )
+	{
+		if( out_file )
+			out = strdup(out_file);
+		else if( g_str_has_suffix(l->data, ".cpabe") )
+			out = g_strdup_printf("%.*s.tcpabe", (int) strlen(l->data) - 6, (char*) l->data);
+		else
+			out = g_strdup_printf("%s.tcpabe", (char*) l->data);
+
+		if( (err = transform_file(pub, tk, &opts, l->data, out)) )
+		{
+			printf("%s: %s\n", (char*) l->data, err);
+			failed = 1;
+		}
+		else
+			printf("%s: transformed to %s\n", (char*) l->data, out);
+		free(out);
+	}
+
+	return failed;
+}
@@ -0,0 +1,443 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <pbc.h>
+#include <pbc_random.h>
+
+#include "common.h"
+#include "threshold.h"
+#include "decrypt.h"
+#include "batch.h"
+
+char* usage =
+"Usage: cpabe-verify [OPTION ...] PUB_KEY PRIV_KEY FILE [FILE ...]\n"
+"  or:  cpabe-verify [OPTION ...] -K KEYRING PUB_KEY [FILE ...]\n"
+"\n"
+"Check that each FILE can be decrypted with private key PRIV_KEY and\n"
+"is intact, without writing anything: that its header is well formed,\n"
+"that the session key can be recovered from it, and that the encrypted\n"
+"payload matches the tag cpabe-enc stores after the header. Files from\n"
+"older versions have no tag, and for them the payload is decrypted in\n"
+"memory and only its length and padding checked. No plaintext is\n"
+"written to disk.\n"
+"\n"
+"Files are checked in parallel. A line is printed for each file, in the\n"
+"order given, then a summary with the throughput, and the exit status\n"
+"is nonzero if any of them failed.\n"
+"\n"
+"Mandatory arguments to long options are mandatory for short options too.\n\n"
+" -h, --help               print this message\n\n"
+" -v, --version            print version information\n\n"
+" -K, --keyring DIR        use the private keys in DIR\n\n"
+" -R, --recursive DIR      check the encrypted files under DIR\n\n"
+" -j, --jobs N             check up to N files at once\n"
+"                          (default: one per processor)\n\n"
+" -p, --pairing-threads N  compute the pairings of a file on N threads\n"
+"                          (default: one per processor)\n\n"
+" -q, --quiet              print only the files that failed\n\n"
+" -d, --deterministic      use deterministic \"random\" numbers\n"
+"                          (only for debugging)\n\n"
+"";
+
+char*      pub_file = 0;
+char*      prv_file = 0;
+char*      keyring  = 0;
+GPtrArray* in_files = 0;
+int        jobs     = 0;
+int        quiet    = 0;
+int        pair_threads = 0;
+
+GByteArray* pub_buf;
+GPtrArray*  prv_bufs;
+
+/* only for choosing a key, each thread decrypts with its own copies */
+dec_pub_t* pub;
+GPtrArray* prvs;
+dec_opts_t opts = { DEC_MERGE, 0, 0, 0, 0, 0 };
+
+/* what each thread checking unserializes for itself */
+typedef struct
+{
+	dec_pub_t* pub;
+	GPtrArray* prvs; /* in the order of prvs */
+	dec_opts_t opts; /* with Lagrange and plan caches of its own */
+}
+verify_state_t;
+
+typedef struct
+{
+	char* file;
+	char* msg;  /* line to print once all files before this one are done */
+	int   done;
+	int   ok;
+}
+verify_job_t;
+
+verify_job_t* verify_jobs;
+int           verify_reported = 0;
+guint64       verified_bytes  = 0;
+int           untagged        = 0;
+GMutex        report_lock;
+
+/* adds the encrypted files under dir in name order */
+void
+add_dir( char* dir )
+{
+	GDir* d;
+	const char* name;
+	GSList* names;
+	GSList* l;
+	char* path;
+
+	if( !(d = g_dir_open(dir, 0, 0)) )
+		die("can't read directory: %s\n", dir);
+
+	names = 0;
+	while( (name = g_dir_read_name(d)) )
+		names = g_slist_prepend(names, strdup(name));
+	g_dir_close(d);
+	names = g_slist_sort(names, (GCompareFunc) strcmp);
+
+	for( l = names; l; l = l->next )
+	{
+		path = g_build_filename(dir, l->data, (char*) 0);
+		if( g_file_test(path, G_FILE_TEST_IS_DIR) )
+		{
+			add_dir(path);
+			free(path);
+		}
+		else if( g_str_has_suffix(l->data, ".cpabe") || g_str_has_suffix(l->data, "_out") )
+			g_ptr_array_add(in_files, path);
+		else
+			free(path);
+		free(l->data);
+	}
+	g_slist_free(names);
+}
+
+void
+parse_args( int argc, char** argv )
+{
+	int i;
+
+	in_files = g_ptr_array_new();
+	for( i = 1; i < argc; i++ )
+		if(      !strcmp(argv[i], "-h") || !strcmp(argv[i], "--help") )
+		{
+			printf("%s", usage);
+			exit(0);
+		}
+		else if( !strcmp(argv[i], "-v") || !strcmp(argv[i], "--version") )
+		{
+			printf(CPABE_VERSION, "-verify");
+			exit(0);
+		}
+		else if( !strcmp(argv[i], "-K") || !strcmp(argv[i], "--keyring") )
+		{
+			if( ++i >= argc )
+				die(usage);
+			else
+				keyring = argv[i];
+		}
+		else if( !strcmp(argv[i], "-R") || !strcmp(argv[i], "--recursive") )
+		{
+			if( ++i >= argc )
+				die(usage);
+			else
+				add_dir(argv[i]);
+		}
+		else if( !strcmp(argv[i], "-j") || !strcmp(argv[i], "--jobs") )
+		{
+			if( ++i >= argc || (jobs = atoi(argv[i])) < 1 )
+				die(usage);
+		}
+		else if( !strcmp(argv[i], "-p") || !strcmp(argv[i], "--pairing-threads") )
+		{
+			if( ++i >= argc || (pair_threads = atoi(argv[i])) < 1 )
+				die(usage);
+		}
+		else if( !strcmp(argv[i], "-q") || !strcmp(argv[i], "--quiet") )
+		{
+			quiet = 1;
+		}
+		else if( !strcmp(argv[i], "-d") || !strcmp(argv[i], "--deterministic") )
+		{
+			pbc_random_set_deterministic(0);
+		}
+		else if( !pub_file )
+		{
+			pub_file = argv[i];
+		}
+		else if( !prv_file && !keyring )
+		{
+			prv_file = argv[i];
+		}
+		else
+			g_ptr_array_add(in_files, strdup(argv[i]));
+
+	if( !pub_file || (!prv_file && !keyring) || !in_files->len )
+		die(usage);
+}
+
+/* loads every private key in dir, in name order */
+void
+load_keyring( char* dir )
+{
+	GDir* d;
+	const char* name;
+	GSList* names;
+	GSList* l;
+	char* path;
+	GByteArray* b;
+	dec_prv_t* prv;
+
+	if( !(d = g_dir_open(dir, 0, 0)) )
+		die("can't read directory: %s\n", dir);
+
+	names = 0;
+	while( (name = g_dir_read_name(d)) )
+		names = g_slist_prepend(names, strdup(name));
+	g_dir_close(d);
+	names = g_slist_sort(names, (GCompareFunc) strcmp);
+
+	for( l = names; l; l = l->next )
+	{
+		path = g_build_filename(dir, l->data, (char*) 0);
+		if( !g_file_test(path, G_FILE_TEST_IS_REGULAR) )
+			;
+		else if( (prv = dec_prv_unserialize(pub, copy_buf(b = suck_file(path)), 1)) )
+		{
+			g_ptr_array_add(prvs, prv);
+			g_ptr_array_add(prv_bufs, b);
+		}
+		else
+		{
+			fprintf(stderr, "skipping malformed private key: %s\n", path);
+			g_byte_array_free(b, 1);
+		}
+		free(path);
+		free(l->data);
+	}
+	g_slist_free(names);
+
+	if( !prvs->len )
+		die("no private keys in %s\n", dir);
+}
+
+verify_state_t*
+state_new()
+{
+	verify_state_t* st;
+	guint i;
+
+	st = (verify_state_t*) malloc(sizeof(verify_state_t));
+	st->pub = dec_pub_unserialize(copy_buf(pub_buf), 1);
+	st->prvs = g_ptr_array_new();
+	for( i = 0; i < prv_bufs->len; i++ )
+		g_ptr_array_add(st->prvs,
+										dec_prv_unserialize(st->pub, copy_buf(g_ptr_array_index(prv_bufs, i)), 1));
+	st->opts = opts;
+	st->opts.lagrange = threshold_cache_new(st->pub->p);
+	st->opts.plans = dec_plancache_new(1024);
+
+	return st;
+}
+
+void
+state_free( gpointer data )
+{
+	verify_state_t* st;
+	guint i;
+
+	st = data;
+	dec_plancache_free(st->opts.plans);
+	threshold_cache_free(st->opts.lagrange);
+	for( i = 0; i < st->prvs->len; i++ )
+		dec_prv_free(g_ptr_array_index(st->prvs, i));
+	g_ptr_array_free(st->prvs, 1);
+	dec_pub_free(st->pub);
+	free(st);
+}
+
+GPrivate thread_state = G_PRIVATE_INIT(state_free);
+
+verify_state_t*
+get_state()
+{
+	verify_state_t* st;
+
+	if( !(st = g_private_get(&thread_state)) )
+	{
+		st = state_new();
+		g_private_set(&thread_state, st);
+	}
+
+	return st;
+}
+
+/* print the lines of every file up to the first one still running */
+void
+verify_report( verify_job_t* job, char* msg, int ok, guint64 bytes, int tagged )
+{
+	g_mutex_lock(&report_lock);
+	job->msg = msg;
+	job->ok = ok;
+	job->done = 1;
+	verified_bytes += bytes;
+	if( ok && !tagged )
+		untagged++;
+	while( verify_reported < in_files->len && verify_jobs[verify_reported].done )
+	{
+		if( !quiet || !verify_jobs[verify_reported].ok )
+			printf("%s\n", verify_jobs[verify_reported].msg);
+		free(verify_jobs[verify_reported].msg);
+		verify_reported++;
+	}
+	g_mutex_unlock(&report_lock);
+}
+
+/*
+	Runs the checks on one file, returning an error message or zero.
+	*bytes is left holding the size of its payload and header.
+*/
+char*
+verify_file_checks( char* file, guint64* bytes, int* tagged )
+{
+	GByteArray* cph_buf;
+	GByteArray* aes_buf;
+	GByteArray* tag;
+	dec_summary_t* summary;
+	verify_state_t* st;
+	dec_prv_t* prv;
+	dec_cph_t* cph;
+	element_t m;
+	unsigned char raw[16];
+	char* err;
+	int file_len;
+	int ok;
+	guint i;
+
+	*bytes = 0;
+	*tagged = 0;
+	if( (err = load_cpabe_file_tag(file, &cph_buf, &file_len, &aes_buf, &tag)) )
+		return err;
+	*bytes = aes_buf->len + cph_buf->len;
+	*tagged = tag != 0;
+
+	prv = 0;
+	if( !(summary = dec_summary_read(cph_buf)) )
+		err = "malformed ciphertext header";
+	else
+	{
+		if( !(prv = dec_summary_pick(summary, prvs, 0)) )
+			err = "cannot check, attributes in key do not satisfy policy";
+		dec_summary_free(summary);
+	}
+
+	ok = 0;
+	if( !err )
+	{
+		st = get_state();
+		for( i = 0; g_ptr_array_index(prvs, i) != prv; i++ )
+			;
+		if( (cph = dec_cph_unserialize(st->pub, cph_buf, 0)) )
+		{
+			ok = dec_decrypt(st->pub, g_ptr_array_index(st->prvs, i), cph, m, &st->opts, 0);
+			dec_cph_free(cph);
+		}
+
+		if( !cph )
+			err = "malformed ciphertext header";
+		else if( !ok )
+			err = "cannot check, attributes in key do not satisfy policy";
+	}
+
+	if( ok )
+	{
+		session_key_bytes(m, raw);
+		element_clear(m);
+
+		if( tag && !cpabe_tag_ok(raw, file_len, aes_buf, tag) )
+			err = "payload does not match its tag, file damaged or altered";
+		else if( !tag && !aes_128_cbc_check_raw(aes_buf, raw, file_len) )
+			err = "payload length or padding is wrong, file damaged or altered";
+		memset(raw, 0, sizeof(raw));
+	}
+
+	g_byte_array_free(cph_buf, 1);
+	g_byte_array_free(aes_buf, 1);
+	if( tag )
+		g_byte_array_free(tag, 1);
+
+	return err;
+}
+
+int
+verify_file( gpointer data, gpointer user_data )
+{
+	verify_job_t* job;
+	guint64 bytes;
+	char* err;
+	int tagged;
+
+	job = data;
+	if( (err = verify_file_checks(job->file, &bytes, &tagged)) )
+	{
+		verify_report(job, g_strdup_printf("%s: %s", job->file, err), 0, bytes, tagged);
+		return 0;
+	}
+
+	verify_report(job, g_strdup_printf(tagged ? "%s: ok" : "%s: ok (no tag, padding checked only)",
+																		 job->file), 1, bytes, tagged);
+	return 1;
+}
+
+int
+main( int argc, char** argv )
+{
+	batch_t* b;
+	GByteArray* buf;
+	dec_prv_t* prv;
+	gint64 t0;
+	double secs;
+	guint i;
+	int failed;
+
+	parse_args(argc, argv);
+
+	pub_buf = suck_file(pub_file);
+	if( !(pub = dec_pub_unserialize(copy_buf(pub_buf), 1)) )
+		die("malformed public key: %s\n", pub_file);
+	prvs = g_ptr_array_new();
+	prv_bufs = g_ptr_array_new();
+	if( keyring )
+		load_keyring(keyring);
+	else if( (prv = dec_prv_unserialize(pub, copy_buf(buf = suck_file(prv_file)), 1)) )
+	{
+		g_ptr_array_add(prvs, prv);
+		g_ptr_array_add(prv_bufs, buf);
+	}
+	else
+		die("malformed private key: %s\n", prv_file);
+	opts.pool = dec_pool_new(pub, pair_threads ? pair_threads : g_get_num_processors());
+	opts.preprocess = 1;
+
+	t0 = g_get_monotonic_time();
+
+	verify_jobs = (verify_job_t*) calloc(in_files->len, sizeof(verify_job_t));
+	b = batch_new(jobs ? jobs : g_get_num_processors(), 0, verify_file, 0);
+	for( i = 0; i < in_files->len; i++ )
+	{
+		verify_jobs[i].file = g_ptr_array_index(in_files, i);
+		batch_push(b, &verify_jobs[i], 0);
+	}
+	failed = batch_finish(b);
+
+	secs = (g_get_monotonic_time() - t0) / 1e6;
+	printf("%u files, %d failed, %d without tags; %.1f MB in %.2f s (%.1f MB/s)\n",
+				 in_files->len, failed, untagged, verified_bytes / 1e6, secs,
+				 secs > 0 ? verified_bytes / 1e6 / secs : 0.0);
+
+	return failed ? 1 : 0;
+}
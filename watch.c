@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <glib.h>
+#include <pbc.h>
+
+#include "common.h"
+#include "policy_lang.h"
+#include "mpd_policy.h"
+#include "watch.h"
+
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_MOVED_TO)
+
+typedef struct
+{
+	char* mpd_dir;
+	char* mpd_base;
+	int fd;
+	GHashTable* dirs;     /* watch descriptor -> directory */
+	GHashTable* watched;  /* directory -> watch descriptor */
+	GHashTable* compiled;  /* policy as written in the MPD -> postfix */
+	GHashTable* files;     /* BaseURL -> postfix, owned by compiled */
+	GHashTable* templates; /* for parse_policy_lang_cached() */
+}
+watch_t;
+
+void
+watch_dir( watch_t* w, char* dir )
+{
+	int wd;
+
+	if( g_hash_table_lookup(w->watched, dir) )
+		return;
+
+	if( (wd = inotify_add_watch(w->fd, dir, WATCH_MASK)) < 0 )
+	{
+		fprintf(stderr, "can't watch directory: %s\n", dir);
+		return;
+	}
+
+	g_hash_table_insert(w->watched, strdup(dir), GINT_TO_POINTER(wd));
+	g_hash_table_insert(w->dirs, GINT_TO_POINTER(wd), strdup(dir));
+}
+
+/*
+	Returns zero and keeps the previous mapping if the MPD can't be
+	read, as happens when it is caught half written.
+*/
+int
+watch_parse( watch_t* w, char* mpd )
+{
+	GHashTable* compiled;
+	char** policies;
+	char** files;
+	char* postfix;
+	char* key;
+	char* dir;
+	int np;
+	int nf;
+	int i;
+
+	if( parse_xml(mpd, &policies, &np, &files, &nf) )
+		return 0;
+
+	compiled = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+	g_hash_table_remove_all(w->files);
+
+	for( i = 0; i < np && i < nf; i++ )
+	{
+		if( !(postfix = g_hash_table_lookup(compiled, policies[i])) )
+		{
+			/* carry over policies that have not changed, keys and all */
+			if( g_hash_table_lookup_extended(w->compiled, policies[i], (gpointer*) &key, (gpointer*) &postfix) )
+				g_hash_table_steal(w->compiled, policies[i]);
+			else
+			{
+				key = strdup(policies[i]);
+				postfix = parse_policy_lang_cached(w->templates, policies[i]);
+			}
+			g_hash_table_insert(compiled, key, postfix);
+		}
+		g_hash_table_insert(w->files, strdup(files[i]), postfix);
+
+		dir = g_str_has_suffix(files[i], "/") ?
+			g_strndup(files[i], strlen(files[i]) - 1) : g_path_get_dirname(files[i]);
+		watch_dir(w, *dir ? dir : ".");
+		free(dir);
+	}
+
+	for( i = 0; i < np; i++ )
+		free(policies[i]);
+	for( i = 0; i < nf; i++ )
+		free(files[i]);
+	free(policies);
+	free(files);
+
+	g_hash_table_destroy(w->compiled);
+	w->compiled = compiled;
+
+	return 1;
+}
+
+char*
+watch_lookup( watch_t* w, char* dir, char* name )
+{
+	char* path;
+	char* policy;
+
+	path = strcmp(dir, ".") ? g_build_filename(dir, name, (char*) 0) : strdup(name);
+	if( !(policy = g_hash_table_lookup(w->files, path)) )
+	{
+		char* d;
+
+		d = g_strdup_printf("%s/", dir);
+		policy = g_hash_table_lookup(w->files, d);
+		free(d);
+	}
+	free(path);
+
+	return policy;
+}
+
+void
+watch_mpd( char* mpd, watch_func_t func, gpointer user_data )
+{
+	watch_t w;
+	char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event* ev;
+	char* dir;
+	char* policy;
+	char* path;
+	ssize_t len;
+	char* p;
+
+	if( (w.fd = inotify_init()) < 0 )
+		die("can't initialize inotify\n");
+
+	w.mpd_dir  = g_path_get_dirname(mpd);
+	w.mpd_base = g_path_get_basename(mpd);
+	w.dirs     = g_hash_table_new_full(g_direct_hash, g_direct_equal, 0, free);
+	w.watched  = g_hash_table_new_full(g_str_hash, g_str_equal, free, 0);
+	w.compiled = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+	w.files    = g_hash_table_new_full(g_str_hash, g_str_equal, free, 0);
+	w.templates = policy_template_cache_new();
+
+	watch_dir(&w, w.mpd_dir);
+	if( !watch_parse(&w, mpd) )
+		die("can't parse xml file: %s\n", mpd);
+
+	while( (len = read(w.fd, buf, sizeof(buf))) > 0 || errno == EINTR )
+		for( p = buf; p < buf + len; p += sizeof(struct inotify_event) + ev->len )
+		{
+			ev = (struct inotify_event*) p;
+			if( !ev->len || !(dir = g_hash_table_lookup(w.dirs, GINT_TO_POINTER(ev->wd))) )
+				continue;
+
+			if( !strcmp(dir, w.mpd_dir) && !strcmp(ev->name, w.mpd_base) )
+			{
+				watch_parse(&w, mpd);
+				continue;
+			}
+
+			if( g_str_has_suffix(ev->name, SUFFIX) ||
+					g_str_has_suffix(ev->name, ".tmp") ||
+					g_str_has_suffix(ev->name, ".journal") )
+				continue;
+
+			if( (policy = watch_lookup(&w, dir, ev->name)) )
+			{
+				path = strcmp(dir, ".") ? g_build_filename(dir, ev->name, (char*) 0) : strdup(ev->name);
+				func(path, policy, user_data);
+				free(path);
+			}
+		}
+
+	die("can't read inotify events\n");
+}
@@ -0,0 +1,20 @@
+/*
+	Include glib.h before including this file.
+
+	Follow a live MPD with inotify. Whenever the MPD is rewritten it is
+	parsed again, compiling only the policies that are new since the
+	last parse, and the directories its BaseURLs point into are watched
+	for segments. A segment is matched to a Representation when its path
+	is that Representation's BaseURL, or when the BaseURL names a
+	directory (ends in '/') and the segment appears in it. Files ending
+	in _out, .tmp or .journal are ignored so outputs never retrigger.
+*/
+
+/*
+	Called with a segment path and its policy in postfix form, both only
+	valid for the duration of the call.
+*/
+typedef void (*watch_func_t)( char* file, char* policy, gpointer user_data );
+
+/* does not return */
+void watch_mpd( char* mpd, watch_func_t func, gpointer user_data );